@@ -0,0 +1,293 @@
+#include "Benchmark.h"
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <random>
+#include <thread>
+
+#include "RenderPass.h"
+#include "Mesh.h"
+#include "UniformBufferObject.h"
+#include "FrustumCuller.h"
+
+// Ressources vivantes au plus pendant le stress de l'allocateur
+const size_t MEMORY_STRESS_MAX_RESOURCES = 2000;
+// Au-dessus du seuil des allocations dediees de MemoryAllocator
+const VkDeviceSize MEMORY_STRESS_DEDICATED_SIZE = 20 * 1024 * 1024;
+// Plus de la moitie de l'anneau de staging, comme l'HDR 4k du demarrage : la tranche passe par un buffer dedie
+const VkDeviceSize MEMORY_STRESS_OVERSIZED_STAGING_SIZE = 64 * 1024 * 1024;
+// UBO model partages par les draws : les offsets dynamiques changent d'un draw a l'autre sans remplir l'arena
+const int RECORDING_NB_MODEL_UBOS = 256;
+const int RECORDING_NB_RECORDS = 50;
+// Vues autour de la camera : la part de spheres visibles change d'une vue a l'autre
+const int CULLING_NB_VIEWS = 16;
+const float CULLING_SCENE_HALF_SIZE = 500.0f;
+
+bool Benchmark::run(int argc, char** argv)
+{
+	if (argc < 3 || std::string(argv[1]) != "--benchmark")
+		return false;
+
+	std::string name = argv[2];
+	int size = argc > 3 ? std::stoi(argv[3]) : 0;
+
+	if (name == "memory")
+		memoryStress(size > 0 ? size : 100000);
+	else if (name == "recording")
+		recording(size > 0 ? size : 10000);
+	else if (name == "culling")
+		culling(size > 0 ? size : 1000000);
+	else
+		throw std::runtime_error("Erreur : benchmark inconnu : " + name);
+
+	return true;
+}
+
+void Benchmark::memoryStress(int nbOperations)
+{
+	Vulkan vk;
+	vk.initialize(640, 480, "Benchmark memoire", [](void*) {}, nullptr, false);
+	VkDevice device = vk.getDevice();
+	MemoryAllocator* allocator = vk.getMemoryAllocator();
+	MemoryAllocatorStatistics initialStatistics = allocator->getStatistics();
+
+	struct Resource
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		VkImage image = VK_NULL_HANDLE;
+		Allocation memory;
+	};
+	std::vector<Resource> resources;
+	std::mt19937 random(42);
+
+	auto checkOverlaps = [&resources]()
+	{
+		std::map<VkDeviceMemory, std::map<VkDeviceSize, VkDeviceSize>> ranges;
+		for (int i(0); i < resources.size(); ++i)
+			ranges[resources[i].memory.memory][resources[i].memory.offset] = resources[i].memory.size;
+		for (auto memory = ranges.begin(); memory != ranges.end(); ++memory)
+		{
+			VkDeviceSize end = 0;
+			for (auto range = memory->second.begin(); range != memory->second.end(); ++range)
+			{
+				if (range->first < end)
+					throw std::runtime_error("Erreur : allocations qui se chevauchent");
+				end = range->first + range->second;
+			}
+		}
+	};
+	auto destroy = [device](Resource& resource)
+	{
+		if (resource.buffer != VK_NULL_HANDLE)
+			vkDestroyBuffer(device, resource.buffer, nullptr);
+		if (resource.image != VK_NULL_HANDLE)
+			vkDestroyImage(device, resource.image, nullptr);
+		resource.memory.free();
+	};
+
+	uint32_t nbCreated = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int operation(0); operation < nbOperations; ++operation)
+	{
+		bool create = resources.empty() || (resources.size() < MEMORY_STRESS_MAX_RESOURCES && random() % 100 < 55);
+		if (create)
+		{
+			Resource resource;
+			VkMemoryRequirements memRequirements;
+			int kind = random() % 100;
+			if (kind < 60)
+			{
+				// Buffers de 256 octets a 1 Mo, visibles par l'hote ou non
+				VkDeviceSize size = (256 << (random() % 12)) + random() % 256;
+				VkMemoryPropertyFlags properties = random() % 2 ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT :
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+				vk.createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, properties, resource.buffer, resource.memory);
+				vkGetBufferMemoryRequirements(device, resource.buffer, &memRequirements);
+			}
+			else if (kind < 98)
+			{
+				// Images optimales de 16 a 1024 pixels de cote
+				uint32_t side = 16 << (random() % 7);
+				vk.createImage(side, side, 1, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT,
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1, 0, resource.image, resource.memory);
+				vkGetImageMemoryRequirements(device, resource.image, &memRequirements);
+			}
+			else
+			{
+				vk.createBuffer(MEMORY_STRESS_DEDICATED_SIZE, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, resource.buffer, resource.memory);
+				vkGetBufferMemoryRequirements(device, resource.buffer, &memRequirements);
+			}
+
+			if (resource.memory.offset % memRequirements.alignment != 0)
+				throw std::runtime_error("Erreur : allocation mal alignee");
+
+			resources.push_back(std::move(resource));
+			nbCreated++;
+		}
+		else
+		{
+			size_t i = random() % resources.size();
+			destroy(resources[i]);
+			resources[i] = std::move(resources.back());
+			resources.pop_back();
+		}
+
+		if (operation % 1000 == 0)
+			checkOverlaps();
+	}
+	checkOverlaps();
+
+	for (int i(0); i < resources.size(); ++i)
+		destroy(resources[i]);
+	resources.clear();
+	float duration = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	auto stagingStart = std::chrono::steady_clock::now();
+	Resource stagingTarget;
+	vk.createBuffer(MEMORY_STRESS_OVERSIZED_STAGING_SIZE, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, stagingTarget.buffer, stagingTarget.memory);
+	StagingSlice staging = vk.getStagingRing()->allocate(&vk, MEMORY_STRESS_OVERSIZED_STAGING_SIZE);
+	if (staging.buffer == VK_NULL_HANDLE || staging.data == nullptr)
+		throw std::runtime_error("Erreur : tranche de staging hors de l'anneau sans memoire mappee");
+	memset(staging.data, 0x5a, static_cast<size_t>(MEMORY_STRESS_OVERSIZED_STAGING_SIZE));
+	vk.copyBuffer(staging.buffer, stagingTarget.buffer, MEMORY_STRESS_OVERSIZED_STAGING_SIZE, 0, staging.offset);
+	vk.flushUploadBatch(true);
+	destroy(stagingTarget);
+	float stagingDuration = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - stagingStart).count();
+
+	MemoryAllocatorStatistics statistics = allocator->getStatistics();
+	if (statistics.nbAllocations != initialStatistics.nbAllocations || statistics.usedBytes != initialStatistics.usedBytes ||
+		statistics.nbDedicatedAllocations != initialStatistics.nbDedicatedAllocations)
+		throw std::runtime_error("Erreur : memoire non rendue a l'allocateur");
+
+	std::cout << "[Benchmark memoire] " << nbOperations << " operations (" << nbCreated << " ressources creees) en " << duration << " ms, "
+		<< duration * 1000.0f / nbOperations << " us par operation" << std::endl;
+	std::cout << "[Benchmark memoire] " << statistics.nbVkAllocateMemoryCalls - initialStatistics.nbVkAllocateMemoryCalls
+		<< " appels a vkAllocateMemory pour " << nbCreated << " ressources" << std::endl;
+	std::cout << "[Benchmark memoire] tranche de staging de " << MEMORY_STRESS_OVERSIZED_STAGING_SIZE / (1024 * 1024) << " Mo copiee en " << stagingDuration
+		<< " ms" << std::endl;
+	allocator->printStatistics();
+
+	vk.cleanup();
+}
+
+void Benchmark::recording(int nbDraws)
+{
+	Vulkan vk;
+	vk.initialize(1066, 600, "Benchmark enregistrement", [](void*) {}, nullptr, false);
+
+	RenderPass renderPass;
+	renderPass.initialize(&vk);
+	renderPass.setAutomaticInstancing(false);
+
+	MeshPBR sphere;
+	sphere.loadObj(&vk, "Models/sphere.obj", true);
+
+	UniformBufferObject<UniformBufferObjectVP> uboVP;
+	uboVP.load(&vk, UniformBufferObjectVP(), VK_SHADER_STAGE_VERTEX_BIT);
+	std::vector<UniformBufferObject<UniformBufferObjectModel>> uboModels(std::min(nbDraws, RECORDING_NB_MODEL_UBOS));
+	for (int i(0); i < uboModels.size(); ++i)
+		uboModels[i].load(&vk, { glm::translate(glm::mat4(1.0f), glm::vec3((float)i, 0.0f, 0.0f)) }, VK_SHADER_STAGE_VERTEX_BIT);
+
+	std::vector<MeshRender> meshes(nbDraws);
+	for (int i(0); i < nbDraws; ++i)
+	{
+		meshes[i].mesh = &sphere;
+		meshes[i].ubos = { &uboModels[i % uboModels.size()], &uboVP };
+	}
+	renderPass.addMesh(&vk, meshes, "Shaders/vertSphere.spv", "Shaders/fragSphere.spv", 0);
+	renderPass.recordDraw(&vk);
+
+	std::vector<int> nbThreads = { 1 };
+	int maxThreads = std::max(1, (int)std::thread::hardware_concurrency());
+	for (int t = 2; t < maxThreads; t *= 2)
+		nbThreads.push_back(t);
+	if (maxThreads > 1)
+		nbThreads.push_back(maxThreads);
+
+	float singleThreadDuration = 0.0f;
+	for (int i(0); i < nbThreads.size(); ++i)
+	{
+		vk.setNbRecordThreads(nbThreads[i]);
+		// Premier enregistrement : allocation des secondaires de chaque thread
+		vk.recordFrameCommandBuffers(0);
+
+		auto start = std::chrono::steady_clock::now();
+		for (int r(0); r < RECORDING_NB_RECORDS; ++r)
+			vk.recordFrameCommandBuffers(0);
+		float duration = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count() / RECORDING_NB_RECORDS;
+		if (i == 0)
+			singleThreadDuration = duration;
+
+		std::cout << "[Benchmark enregistrement] " << nbDraws << " draws, " << nbThreads[i] << " thread(s) : " << duration << " ms (x"
+			<< singleThreadDuration / duration << ")" << std::endl;
+	}
+
+	vkDeviceWaitIdle(vk.getDevice());
+	renderPass.cleanup(&vk);
+	sphere.cleanup(vk.getDevice());
+	uboVP.cleanup(vk.getDevice());
+	for (int i(0); i < uboModels.size(); ++i)
+		uboModels[i].cleanup(vk.getDevice());
+	vk.cleanup();
+}
+
+void Benchmark::culling(int nbObjects)
+{
+	std::mt19937 random(42);
+	std::uniform_real_distribution<float> position(-CULLING_SCENE_HALF_SIZE, CULLING_SCENE_HALF_SIZE);
+	std::uniform_real_distribution<float> radius(0.1f, 2.0f);
+
+	FrustumCuller culler;
+	std::vector<glm::vec4> spheres(nbObjects);
+	for (int i(0); i < nbObjects; ++i)
+	{
+		spheres[i] = glm::vec4(position(random), position(random), position(random), radius(random));
+		culler.add(glm::vec3(spheres[i]), spheres[i].w);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	culler.build();
+	float buildDuration = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	glm::mat4 projection = glm::perspective(glm::radians(70.0f), 16.0f / 9.0f, 0.1f, CULLING_SCENE_HALF_SIZE);
+	std::vector<uint8_t> visible;
+	std::vector<uint8_t> expected(nbObjects);
+	float cullDuration = 0.0f, referenceDuration = 0.0f;
+	for (int v(0); v < CULLING_NB_VIEWS; ++v)
+	{
+		float angle = glm::two_pi<float>() * v / CULLING_NB_VIEWS;
+		glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(std::cos(angle), 0.0f, std::sin(angle)), glm::vec3(0.0f, 1.0f, 0.0f));
+		std::array<glm::vec4, 6> planes = FrustumCuller::extractPlanes(projection * view);
+
+		start = std::chrono::steady_clock::now();
+		culler.cull(planes, visible);
+		cullDuration += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		// Reference : chaque sphere testee seule, avec les memes operations que les chemins SIMD
+		start = std::chrono::steady_clock::now();
+		for (int i(0); i < nbObjects; ++i)
+		{
+			bool inFrustum = true;
+			for (int p(0); p < 6; ++p)
+			{
+				float distance = (spheres[i].x * planes[p].x + spheres[i].y * planes[p].y) + (spheres[i].z * planes[p].z + planes[p].w);
+				inFrustum = inFrustum && distance >= -spheres[i].w;
+			}
+			expected[i] = inFrustum ? 1 : 0;
+		}
+		referenceDuration += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+		if (visible != expected)
+			throw std::runtime_error("Erreur : le culling ne donne pas le resultat de reference");
+	}
+
+	FrustumCuller::Statistics statistics = culler.getStatistics();
+	cullDuration /= CULLING_NB_VIEWS;
+	referenceDuration /= CULLING_NB_VIEWS;
+	std::cout << "[Benchmark culling] " << nbObjects << " objets, construction en " << buildDuration << " ms" << std::endl;
+	std::cout << "[Benchmark culling] " << (FrustumCuller::isAvxAvailable() ? "AVX" : "SSE") << " : " << cullDuration << " ms par vue, "
+		<< statistics.nbTestedSpheres / statistics.nbCulls << " spheres testees, " << statistics.nbVisibleObjects / statistics.nbCulls << " visibles" << std::endl;
+	std::cout << "[Benchmark culling] Test de chaque sphere : " << referenceDuration << " ms par vue (x" << referenceDuration / cullDuration << ")" << std::endl;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+#include "Vulkan.h"
+
+// Mesures lancees a la place de la demo : "Demo VK __1.exe --benchmark <nom> [taille]"
+class Benchmark
+{
+public:
+	// Renvoie false si la ligne de commande ne demande pas de benchmark
+	static bool run(int argc, char** argv);
+
+private:
+	// Creations et destructions aleatoires de buffers et d'images : verifie l'alignement et l'absence de
+	// chevauchement des allocations et une tranche de staging trop grosse pour l'anneau, puis que tout est rendu a l'allocateur
+	static void memoryStress(int nbOperations);
+	// Enregistrement des command buffers de la swapchain pour nbDraws draws, de 1 thread a tous les coeurs
+	static void recording(int nbDraws);
+	// FrustumCuller sur nbObjects spheres aleatoires, compare au test de chaque sphere. Sans device Vulkan
+	static void culling(int nbObjects);
+};
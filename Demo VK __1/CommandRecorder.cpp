@@ -0,0 +1,86 @@
+#include "CommandRecorder.h"
+
+void CommandRecorder::bindPipeline(VkPipeline pipeline)
+{
+	if (skip(pipeline == m_pipeline))
+		return;
+
+	vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+	m_pipeline = pipeline;
+}
+
+void CommandRecorder::bindVertexBuffer(uint32_t binding, VkBuffer buffer, VkDeviceSize offset)
+{
+	if (binding >= m_vertexBuffers.size())
+	{
+		m_vertexBuffers.resize(binding + 1, VK_NULL_HANDLE);
+		m_vertexBufferOffsets.resize(binding + 1, 0);
+	}
+	if (skip(buffer == m_vertexBuffers[binding] && offset == m_vertexBufferOffsets[binding]))
+		return;
+
+	vkCmdBindVertexBuffers(m_commandBuffer, binding, 1, &buffer, &offset);
+	m_vertexBuffers[binding] = buffer;
+	m_vertexBufferOffsets[binding] = offset;
+}
+
+void CommandRecorder::bindIndexBuffer(VkBuffer buffer, VkIndexType indexType)
+{
+	if (skip(buffer == m_indexBuffer && indexType == m_indexType))
+		return;
+
+	vkCmdBindIndexBuffer(m_commandBuffer, buffer, 0, indexType);
+	m_indexBuffer = buffer;
+	m_indexType = indexType;
+}
+
+void CommandRecorder::bindDescriptorSet(VkPipelineLayout pipelineLayout, VkDescriptorSet descriptorSet, const std::vector<uint32_t>& dynamicOffsets)
+{
+	if (skip(pipelineLayout == m_pipelineLayout && descriptorSet == m_descriptorSet && dynamicOffsets == m_dynamicOffsets))
+		return;
+
+	vkCmdBindDescriptorSets(m_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet,
+		static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+	m_pipelineLayout = pipelineLayout;
+	m_descriptorSet = descriptorSet;
+	m_dynamicOffsets = dynamicOffsets;
+}
+
+void CommandRecorder::drawIndexed(uint32_t nbIndices, uint32_t nbInstances, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance)
+{
+	vkCmdDrawIndexed(m_commandBuffer, nbIndices, nbInstances, firstIndex, vertexOffset, firstInstance);
+	m_statistics.nbDraws++;
+}
+
+void CommandRecorder::drawIndexedIndirect(VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount)
+{
+	vkCmdDrawIndexedIndirect(m_commandBuffer, buffer, offset, drawCount, sizeof(VkDrawIndexedIndirectCommand));
+	m_statistics.nbDraws++;
+}
+
+void CommandRecorder::setViewport(VkExtent2D extent)
+{
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)extent.width;
+	viewport.height = (float)extent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(m_commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor = {};
+	scissor.offset = { 0, 0 };
+	scissor.extent = extent;
+	vkCmdSetScissor(m_commandBuffer, 0, 1, &scissor);
+}
+
+bool CommandRecorder::skip(bool redundant)
+{
+	if (redundant)
+		m_statistics.nbSkippedBinds++;
+	else
+		m_statistics.nbBinds++;
+
+	return redundant;
+}
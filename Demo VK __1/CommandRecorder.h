@@ -0,0 +1,59 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+
+// Enregistre dans un command buffer en ignorant les binds de l'etat deja lie
+// (pipeline, vertex/index buffers, descriptor set et offsets dynamiques)
+class CommandRecorder
+{
+public:
+	struct Statistics
+	{
+		uint32_t nbBinds = 0;
+		uint32_t nbSkippedBinds = 0;
+		uint32_t nbDraws = 0;
+
+		void add(const Statistics& statistics)
+		{
+			nbBinds += statistics.nbBinds;
+			nbSkippedBinds += statistics.nbSkippedBinds;
+			nbDraws += statistics.nbDraws;
+		}
+	};
+
+public:
+	CommandRecorder(VkCommandBuffer commandBuffer) : m_commandBuffer(commandBuffer) {}
+
+	void bindPipeline(VkPipeline pipeline);
+	void bindVertexBuffer(uint32_t binding, VkBuffer buffer, VkDeviceSize offset = 0);
+	void bindIndexBuffer(VkBuffer buffer, VkIndexType indexType);
+	void bindDescriptorSet(VkPipelineLayout pipelineLayout, VkDescriptorSet descriptorSet, const std::vector<uint32_t>& dynamicOffsets);
+	void drawIndexed(uint32_t nbIndices, uint32_t nbInstances, uint32_t firstIndex, int32_t vertexOffset, uint32_t firstInstance);
+	void drawIndexedIndirect(VkBuffer buffer, VkDeviceSize offset, uint32_t drawCount);
+	// Viewport et scissor couvrant toute la cible (etat dynamique des pipelines)
+	void setViewport(VkExtent2D extent);
+
+	VkCommandBuffer getCommandBuffer() { return m_commandBuffer; }
+	Statistics getStatistics() { return m_statistics; }
+
+private:
+	bool skip(bool redundant);
+
+private:
+	VkCommandBuffer m_commandBuffer;
+
+	VkPipeline m_pipeline = VK_NULL_HANDLE;
+	std::vector<VkBuffer> m_vertexBuffers; // par binding
+	std::vector<VkDeviceSize> m_vertexBufferOffsets;
+	VkBuffer m_indexBuffer = VK_NULL_HANDLE;
+	VkIndexType m_indexType = VK_INDEX_TYPE_MAX_ENUM;
+	// Un set lie avec un autre layout n'est pas forcement compatible : le layout fait partie de l'etat
+	VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+	VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
+	std::vector<uint32_t> m_dynamicOffsets;
+
+	Statistics m_statistics;
+};
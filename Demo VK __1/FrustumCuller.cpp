@@ -0,0 +1,310 @@
+#include "FrustumCuller.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define FRUSTUM_CULLER_SSE
+// Chemin AVX compile a part et choisi a l'execution : le programme tourne aussi sans AVX
+#define FRUSTUM_CULLER_AVX
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define FRUSTUM_CULLER_AVX_FUNCTION
+#else
+#define FRUSTUM_CULLER_AVX_FUNCTION __attribute__((target("avx")))
+#endif
+#endif
+
+const size_t CULLING_OBJECTS_PER_GROUP = 64;
+// En dessous, un seul passage sur les objets coute moins que les groupes
+const size_t CULLING_FLAT_MAX_OBJECTS = 512;
+
+// 10 bits -> 30 bits, deux zeros entre chaque bit
+static uint32_t expandMortonBits(uint32_t v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+void FrustumCuller::Spheres::resize(size_t size)
+{
+	size_t paddedSize = (size + 7) / 8 * 8;
+	x.assign(paddedSize, 0.0f);
+	y.assign(paddedSize, 0.0f);
+	z.assign(paddedSize, 0.0f);
+	radius.assign(paddedSize, 0.0f);
+}
+
+void FrustumCuller::Spheres::set(size_t i, glm::vec3 center, float r)
+{
+	x[i] = center.x;
+	y[i] = center.y;
+	z[i] = center.z;
+	radius[i] = r;
+}
+
+void FrustumCuller::clear()
+{
+	m_centers.clear();
+	m_radii.clear();
+	m_objectIDs.clear();
+	m_objects.resize(0);
+	m_groups.resize(0);
+	m_nbGroups = 0;
+}
+
+uint32_t FrustumCuller::add(glm::vec3 center, float radius)
+{
+	m_centers.push_back(center);
+	m_radii.push_back(radius);
+
+	return static_cast<uint32_t>(m_centers.size() - 1);
+}
+
+void FrustumCuller::build()
+{
+	size_t nbObjects = m_centers.size();
+
+	// Tri par code de Morton des centres : les objets voisins dans l'espace se suivent en memoire
+	glm::vec3 minCenter(std::numeric_limits<float>::max());
+	glm::vec3 maxCenter(-std::numeric_limits<float>::max());
+	for (size_t i(0); i < nbObjects; ++i)
+	{
+		minCenter = glm::min(minCenter, m_centers[i]);
+		maxCenter = glm::max(maxCenter, m_centers[i]);
+	}
+	glm::vec3 extent = glm::max(maxCenter - minCenter, glm::vec3(1e-6f));
+
+	std::vector<std::pair<uint32_t, uint32_t>> mortonCodes(nbObjects);
+	for (size_t i(0); i < nbObjects; ++i)
+	{
+		glm::vec3 cell = glm::clamp((m_centers[i] - minCenter) / extent, 0.0f, 1.0f) * 1023.0f;
+		uint32_t code = (expandMortonBits(static_cast<uint32_t>(cell.x)) << 2) | (expandMortonBits(static_cast<uint32_t>(cell.y)) << 1) |
+			expandMortonBits(static_cast<uint32_t>(cell.z));
+		mortonCodes[i] = { code, static_cast<uint32_t>(i) };
+	}
+	std::sort(mortonCodes.begin(), mortonCodes.end());
+
+	m_objects.resize(nbObjects);
+	m_objectIDs.resize(nbObjects);
+	for (size_t i(0); i < nbObjects; ++i)
+	{
+		uint32_t objectID = mortonCodes[i].second;
+		m_objectIDs[i] = objectID;
+		m_objects.set(i, m_centers[objectID], m_radii[objectID]);
+	}
+	m_objectResults.resize(m_objects.x.size());
+
+	// Sphere de chaque groupe : centre de la boite des spheres, rayon jusqu'a la plus eloignee
+	m_nbGroups = nbObjects > CULLING_FLAT_MAX_OBJECTS ? (nbObjects + CULLING_OBJECTS_PER_GROUP - 1) / CULLING_OBJECTS_PER_GROUP : 0;
+	m_groups.resize(m_nbGroups);
+	for (size_t group(0); group < m_nbGroups; ++group)
+	{
+		size_t first = group * CULLING_OBJECTS_PER_GROUP;
+		size_t last = std::min(first + CULLING_OBJECTS_PER_GROUP, nbObjects);
+
+		glm::vec3 minPoint(std::numeric_limits<float>::max());
+		glm::vec3 maxPoint(-std::numeric_limits<float>::max());
+		for (size_t i(first); i < last; ++i)
+		{
+			glm::vec3 center(m_objects.x[i], m_objects.y[i], m_objects.z[i]);
+			minPoint = glm::min(minPoint, center - m_objects.radius[i]);
+			maxPoint = glm::max(maxPoint, center + m_objects.radius[i]);
+		}
+
+		glm::vec3 groupCenter = (minPoint + maxPoint) * 0.5f;
+		float groupRadius = 0.0f;
+		for (size_t i(first); i < last; ++i)
+			groupRadius = std::max(groupRadius, glm::length(glm::vec3(m_objects.x[i], m_objects.y[i], m_objects.z[i]) - groupCenter) + m_objects.radius[i]);
+
+		m_groups.set(group, groupCenter, groupRadius);
+	}
+	m_groupResults.resize(m_groups.x.size());
+}
+
+void FrustumCuller::cull(const std::array<glm::vec4, 6>& planes, std::vector<uint8_t>& visible)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	size_t nbObjects = m_objectIDs.size();
+	visible.assign(m_centers.size(), 0);
+
+	if (m_nbGroups == 0)
+	{
+		testSpheres(m_objects, 0, nbObjects, planes, m_objectResults.data());
+		m_statistics.nbTestedSpheres += nbObjects;
+	}
+	else
+	{
+		testSpheres(m_groups, 0, m_nbGroups, planes, m_groupResults.data());
+		m_statistics.nbTestedSpheres += m_nbGroups;
+
+		for (size_t group(0); group < m_nbGroups; ++group)
+		{
+			size_t first = group * CULLING_OBJECTS_PER_GROUP;
+			size_t last = std::min(first + CULLING_OBJECTS_PER_GROUP, nbObjects);
+			if (m_groupResults[group] == 1)
+			{
+				testSpheres(m_objects, first, last, planes, m_objectResults.data());
+				m_statistics.nbTestedSpheres += last - first;
+			}
+			else
+				std::fill(m_objectResults.begin() + first, m_objectResults.begin() + last, m_groupResults[group]);
+		}
+	}
+
+	size_t nbVisible = 0;
+	for (size_t i(0); i < nbObjects; ++i)
+	{
+		if (m_objectResults[i])
+		{
+			visible[m_objectIDs[i]] = 1;
+			nbVisible++;
+		}
+	}
+
+	m_statistics.nbCulls++;
+	m_statistics.nbVisibleObjects += nbVisible;
+	m_statistics.cullTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+}
+
+std::array<glm::vec4, 6> FrustumCuller::extractPlanes(glm::mat4 viewProj)
+{
+	// Plans extraits des lignes de la matrice
+	std::array<glm::vec4, 4> rows;
+	for (int i(0); i < 4; ++i)
+		rows[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+
+	std::array<glm::vec4, 6> planes;
+	planes[0] = rows[3] + rows[0];
+	planes[1] = rows[3] - rows[0];
+	planes[2] = rows[3] + rows[1];
+	planes[3] = rows[3] - rows[1];
+	planes[4] = rows[2];
+	planes[5] = rows[3] - rows[2];
+	for (int i(0); i < planes.size(); ++i)
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+
+	return planes;
+}
+
+bool FrustumCuller::isAvxAvailable()
+{
+#if defined(FRUSTUM_CULLER_AVX)
+	static const bool avx = []()
+	{
+#if defined(_MSC_VER)
+		// AVX et registres YMM sauvegardes par le systeme (OSXSAVE puis XCR0)
+		int cpuInfo[4];
+		__cpuid(cpuInfo, 1);
+		bool avxSupported = (cpuInfo[2] & (1 << 28)) != 0 && (cpuInfo[2] & (1 << 27)) != 0;
+		return avxSupported && (_xgetbv(0) & 0x6) == 0x6;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx") != 0;
+#endif
+	}();
+	return avx;
+#else
+	return false;
+#endif
+}
+
+#if defined(FRUSTUM_CULLER_AVX)
+FRUSTUM_CULLER_AVX_FUNCTION static void testSpheresAvx(const float* sphereX, const float* sphereY, const float* sphereZ, const float* sphereRadius,
+	size_t first, size_t last, const std::array<glm::vec4, 6>& planes, uint8_t* result)
+{
+	__m256 planeCoefficients[24];
+	for (int p(0); p < 6; ++p)
+		for (int c(0); c < 4; ++c)
+			planeCoefficients[p * 4 + c] = _mm256_set1_ps(planes[p][c]);
+
+	for (size_t i(first); i < last; i += 8)
+	{
+		__m256 x = _mm256_loadu_ps(&sphereX[i]);
+		__m256 y = _mm256_loadu_ps(&sphereY[i]);
+		__m256 z = _mm256_loadu_ps(&sphereZ[i]);
+		__m256 radius = _mm256_loadu_ps(&sphereRadius[i]);
+		__m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), radius);
+
+		__m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		__m256 inside = visible;
+		for (int p(0); p < 6; ++p)
+		{
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, planeCoefficients[p * 4]), _mm256_mul_ps(y, planeCoefficients[p * 4 + 1])),
+				_mm256_add_ps(_mm256_mul_ps(z, planeCoefficients[p * 4 + 2]), planeCoefficients[p * 4 + 3]));
+			visible = _mm256_and_ps(visible, _mm256_cmp_ps(distance, negRadius, _CMP_GE_OQ));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, radius, _CMP_GE_OQ));
+		}
+
+		int visibleMask = _mm256_movemask_ps(visible);
+		int insideMask = _mm256_movemask_ps(inside);
+		for (int k(0); k < 8; ++k)
+			result[i + k] = static_cast<uint8_t>(((visibleMask >> k) & 1) + ((insideMask >> k) & 1));
+	}
+	// Pas de penalite de transition vers le code SSE qui suit
+	_mm256_zeroupper();
+}
+#endif
+
+void FrustumCuller::testSpheres(const Spheres& spheres, size_t first, size_t last, const std::array<glm::vec4, 6>& planes, uint8_t* result)
+{
+#if defined(FRUSTUM_CULLER_AVX)
+	if (isAvxAvailable())
+	{
+		testSpheresAvx(spheres.x.data(), spheres.y.data(), spheres.z.data(), spheres.radius.data(), first, last, planes, result);
+		return;
+	}
+#endif
+
+#if defined(FRUSTUM_CULLER_SSE)
+	__m128 planeCoefficients[24];
+	for (int p(0); p < 6; ++p)
+		for (int c(0); c < 4; ++c)
+			planeCoefficients[p * 4 + c] = _mm_set1_ps(planes[p][c]);
+
+	for (size_t i(first); i < last; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(&spheres.x[i]);
+		__m128 y = _mm_loadu_ps(&spheres.y[i]);
+		__m128 z = _mm_loadu_ps(&spheres.z[i]);
+		__m128 radius = _mm_loadu_ps(&spheres.radius[i]);
+		__m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+
+		__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		__m128 inside = visible;
+		for (int p(0); p < 6; ++p)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, planeCoefficients[p * 4]), _mm_mul_ps(y, planeCoefficients[p * 4 + 1])),
+				_mm_add_ps(_mm_mul_ps(z, planeCoefficients[p * 4 + 2]), planeCoefficients[p * 4 + 3]));
+			visible = _mm_and_ps(visible, _mm_cmpge_ps(distance, negRadius));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, radius));
+		}
+
+		int visibleMask = _mm_movemask_ps(visible);
+		int insideMask = _mm_movemask_ps(inside);
+		for (int k(0); k < 4; ++k)
+			result[i + k] = static_cast<uint8_t>(((visibleMask >> k) & 1) + ((insideMask >> k) & 1));
+	}
+#else
+	for (size_t i(first); i < last; ++i)
+	{
+		uint8_t state = 2;
+		for (int p(0); p < 6 && state > 0; ++p)
+		{
+			float distance = planes[p].x * spheres.x[i] + planes[p].y * spheres.y[i] + planes[p].z * spheres.z[i] + planes[p].w;
+			if (distance < -spheres.radius[i])
+				state = 0;
+			else if (distance < spheres.radius[i])
+				state = 1;
+		}
+		result[i] = state;
+	}
+#endif
+}
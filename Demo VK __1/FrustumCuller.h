@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <cstdint>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+
+// Culling de spheres englobantes par le frustum sur le CPU, 8 (AVX si le processeur le permet) ou 4 (SSE) spheres par iteration.
+// Les objets sont ranges par code de Morton en groupes de 64 qui ont leur propre sphere :
+// les objets d'un groupe hors du frustum ou entierement dedans ne sont pas testes
+class FrustumCuller
+{
+public:
+	struct Statistics
+	{
+		uint64_t nbCulls = 0;
+		uint64_t nbTestedSpheres = 0;
+		uint64_t nbVisibleObjects = 0;
+		double cullTime = 0.0; // ms
+	};
+
+	void clear();
+	// Renvoie l'identifiant de l'objet, build doit etre rappele ensuite
+	uint32_t add(glm::vec3 center, float radius);
+	void build();
+	// visible[id] vaut 1 si la sphere de l'objet id touche le frustum
+	void cull(const std::array<glm::vec4, 6>& planes, std::vector<uint8_t>& visible);
+
+	size_t getNbObjects() { return m_centers.size(); }
+	Statistics getStatistics() { return m_statistics; }
+
+	// Plans normalises, normales vers l'interieur (profondeur de 0 a 1)
+	static std::array<glm::vec4, 6> extractPlanes(glm::mat4 viewProj);
+	// Detecte une fois : le chemin AVX est compile sans option du compilateur
+	static bool isAvxAvailable();
+
+private:
+	// SoA, completee a un multiple de 8
+	struct Spheres
+	{
+		std::vector<float> x, y, z, radius;
+
+		void resize(size_t size);
+		void set(size_t i, glm::vec3 center, float r);
+	};
+
+	// result[i] : 0 dehors, 1 coupe le frustum, 2 entierement dedans. first est un multiple de 8
+	static void testSpheres(const Spheres& spheres, size_t first, size_t last, const std::array<glm::vec4, 6>& planes, uint8_t* result);
+
+private:
+	std::vector<glm::vec3> m_centers; // ordre d'ajout
+	std::vector<float> m_radii;
+
+	Spheres m_objects; // ordre de Morton
+	std::vector<uint32_t> m_objectIDs;
+	std::vector<uint8_t> m_objectResults;
+	Spheres m_groups; // aucun pour les petites scenes : un seul passage sur les objets
+	size_t m_nbGroups = 0;
+	std::vector<uint8_t> m_groupResults;
+
+	Statistics m_statistics;
+};
@@ -0,0 +1,75 @@
+#include "GeometryArena.h"
+
+#include "Vulkan.h"
+
+void GeometryArena::initialize(Vulkan* vk, VkDeviceSize vertexCapacity, VkDeviceSize indexCapacity)
+{
+	createPool(vk, m_vertexPool, vertexCapacity, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+	createPool(vk, m_indexPool, indexCapacity, VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+}
+
+void GeometryArena::cleanup(VkDevice device)
+{
+	Pool* pools[] = { &m_vertexPool, &m_indexPool };
+	for (Pool* pool : pools)
+	{
+		vkDestroyBuffer(device, pool->buffer, nullptr);
+		pool->memory.free();
+		*pool = Pool();
+	}
+}
+
+GeometryRange GeometryArena::uploadVertices(Vulkan* vk, const void* data, VkDeviceSize size, VkDeviceSize stride)
+{
+	GeometryRange range = allocate(m_vertexPool, size, stride);
+	upload(vk, m_vertexPool, range, data);
+
+	return range;
+}
+
+GeometryRange GeometryArena::uploadIndices(Vulkan* vk, const void* data, VkDeviceSize size)
+{
+	GeometryRange range = allocate(m_indexPool, size, 4);
+	upload(vk, m_indexPool, range, data);
+
+	return range;
+}
+
+void GeometryArena::freeVertices(GeometryRange range)
+{
+	free(m_vertexPool, range);
+}
+
+void GeometryArena::freeIndices(GeometryRange range)
+{
+	free(m_indexPool, range);
+}
+
+void GeometryArena::createPool(Vulkan* vk, Pool& pool, VkDeviceSize capacity, VkBufferUsageFlags usage)
+{
+	vk->createBuffer(capacity, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, pool.buffer, pool.memory);
+	pool.ranges.initialize(capacity);
+}
+
+GeometryRange GeometryArena::allocate(Pool& pool, VkDeviceSize size, VkDeviceSize alignment)
+{
+	GeometryRange range;
+	if (!pool.ranges.allocate(size, alignment, range.offset))
+		throw std::runtime_error("Erreur : plus de place dans l'arena de geometrie");
+	range.size = size;
+
+	return range;
+}
+
+void GeometryArena::free(Pool& pool, GeometryRange range)
+{
+	pool.ranges.free(range.offset, range.size);
+}
+
+void GeometryArena::upload(Vulkan* vk, Pool& pool, GeometryRange range, const void* data)
+{
+	StagingSlice staging = vk->getStagingRing()->allocate(vk, range.size);
+	memcpy(staging.data, data, (size_t)range.size);
+
+	vk->copyBuffer(staging.buffer, pool.buffer, range.size, range.offset, staging.offset);
+}
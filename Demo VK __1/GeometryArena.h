@@ -0,0 +1,51 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "MemoryAllocator.h"
+#include "RangeAllocator.h"
+
+class Vulkan;
+
+struct GeometryRange
+{
+	VkDeviceSize offset = 0; // en octets
+	VkDeviceSize size = 0;
+};
+
+// Vertex et index buffers partages par tous les meshes : chaque mesh y occupe une plage.
+// Un seul bind par passe, les draws utilisent vertexOffset et firstIndex
+class GeometryArena
+{
+public:
+	void initialize(Vulkan* vk, VkDeviceSize vertexCapacity, VkDeviceSize indexCapacity);
+	void cleanup(VkDevice device);
+
+	// La plage est alignee sur stride pour que offset / stride donne le vertexOffset
+	GeometryRange uploadVertices(Vulkan* vk, const void* data, VkDeviceSize size, VkDeviceSize stride);
+	// Alignement sur 4 octets : firstIndex = offset / taille d'un index, en 16 comme en 32 bits
+	GeometryRange uploadIndices(Vulkan* vk, const void* data, VkDeviceSize size);
+	void freeVertices(GeometryRange range);
+	void freeIndices(GeometryRange range);
+
+	VkBuffer getVertexBuffer() { return m_vertexPool.buffer; }
+	VkBuffer getIndexBuffer() { return m_indexPool.buffer; }
+
+private:
+	struct Pool
+	{
+		VkBuffer buffer = VK_NULL_HANDLE;
+		Allocation memory;
+		RangeAllocator ranges;
+	};
+
+	void createPool(Vulkan* vk, Pool& pool, VkDeviceSize capacity, VkBufferUsageFlags usage);
+	GeometryRange allocate(Pool& pool, VkDeviceSize size, VkDeviceSize alignment);
+	void free(Pool& pool, GeometryRange range);
+	void upload(Vulkan* vk, Pool& pool, GeometryRange range, const void* data);
+
+private:
+	Pool m_vertexPool;
+	Pool m_indexPool;
+};
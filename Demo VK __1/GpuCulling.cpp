@@ -0,0 +1,289 @@
+#include "GpuCulling.h"
+
+#include "FrustumCuller.h"
+
+const std::string CULLING_SHADER_PATH = "Shaders/compCullInstances.spv";
+const uint32_t CULLING_GROUP_SIZE = 64;
+const uint32_t MAX_CULLING_BATCHES = 256;
+
+bool GpuCulling::isAvailable(Vulkan* vk)
+{
+	return vk->hasDrawIndirectFirstInstance() && vk->hasShader(CULLING_SHADER_PATH);
+}
+
+uint32_t GpuCulling::addBatch(MeshPBR* mesh, Instance* instance)
+{
+	std::vector<MeshLod> lods = mesh->getLods();
+	std::vector<float> lodMaxScreenRadii = mesh->getLodMaxScreenRadii();
+	if (lods.size() > 8)
+		throw std::runtime_error("Erreur : trop de LODs pour le culling GPU");
+	if (instance->getStride() != sizeof(ModelInstance))
+		throw std::runtime_error("Erreur : le culling GPU attend des instances au format ModelInstance");
+
+	Batch batch;
+	batch.constants.boundingSphere = mesh->getBoundingSphere();
+	batch.constants.nbInstances = 0;
+	batch.constants.firstDraw = static_cast<uint32_t>(m_drawTemplates.size());
+	batch.constants.nbLods = static_cast<uint32_t>(lods.size());
+	batch.constants.padding = 0.0f;
+	batch.constants.lodMaxScreenRadius.fill(0.0f);
+	batch.instance = instance;
+	batch.descriptorSet = VK_NULL_HANDLE;
+
+	// Chaque LOD a une plage de toutes les instances : aucune limite sur la repartition
+	for (uint32_t i(0); i < lods.size(); ++i)
+	{
+		batch.constants.lodMaxScreenRadius[i] = lodMaxScreenRadii[i];
+
+		VkDrawIndexedIndirectCommand drawTemplate = {};
+		drawTemplate.indexCount = lods[i].nbIndices;
+		drawTemplate.instanceCount = 0;
+		drawTemplate.firstIndex = mesh->getFirstIndex() + lods[i].firstIndex;
+		drawTemplate.vertexOffset = mesh->getVertexOffset();
+		drawTemplate.firstInstance = m_nbOutputInstances;
+		m_drawTemplates.push_back(drawTemplate);
+
+		m_nbOutputInstances += instance->getCapacity();
+	}
+
+	m_batches.push_back(batch);
+
+	return batch.constants.firstDraw;
+}
+
+void GpuCulling::build(Vulkan* vk)
+{
+	if (m_batches.size() > MAX_CULLING_BATCHES)
+		throw std::runtime_error("Erreur : trop de lots pour le culling GPU");
+
+	if (!m_initialized)
+	{
+		createDescriptorSetLayout(vk->getDevice());
+
+		VkPushConstantRange pushConstantRange = {};
+		pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		pushConstantRange.offset = 0;
+		pushConstantRange.size = sizeof(CullingBatch);
+		m_pipeline.initializeCompute(vk, &m_descriptorSetLayout, CULLING_SHADER_PATH, { pushConstantRange });
+
+		m_uboCulling.load(vk, UniformBufferObjectCulling(), VK_SHADER_STAGE_COMPUTE_BIT);
+		m_uniformFrameSize = static_cast<uint32_t>(vk->getUniformArena()->getFrameSize());
+
+		m_initialized = true;
+	}
+
+	// Nouveau lot : les buffers sont recrees a la bonne taille
+	destroyBuffers(vk);
+
+	VkDeviceSize drawBufferSize = m_drawTemplates.size() * sizeof(VkDrawIndexedIndirectCommand);
+	StagingSlice staging = vk->getStagingRing()->allocate(vk, drawBufferSize);
+	memcpy(staging.data, m_drawTemplates.data(), (size_t)drawBufferSize);
+	vk->createBuffer(drawBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		m_drawTemplateBuffer, m_drawTemplateBufferMemory);
+	vk->copyBuffer(staging.buffer, m_drawTemplateBuffer, drawBufferSize, 0, staging.offset);
+
+	vk->createBuffer(drawBufferSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_drawBuffer, m_drawBufferMemory);
+	vk->createBuffer(std::max<VkDeviceSize>(m_nbOutputInstances, 1) * sizeof(ModelInstance), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_instanceBuffer, m_instanceBufferMemory);
+
+	std::array<VkDescriptorPoolSize, 3> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[0].descriptorCount = MAX_CULLING_BATCHES;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	poolSizes[1].descriptorCount = MAX_CULLING_BATCHES;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[2].descriptorCount = 2 * MAX_CULLING_BATCHES;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = MAX_CULLING_BATCHES;
+
+	if (vkCreateDescriptorPool(vk->getDevice(), &poolInfo, nullptr, &m_descriptorPool) != VK_SUCCESS)
+		throw std::runtime_error("Erreur : descriptor pool du culling");
+
+	for (int i(0); i < m_batches.size(); ++i)
+	{
+		VkDescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = m_descriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &m_descriptorSetLayout;
+
+		if (vkAllocateDescriptorSets(vk->getDevice(), &allocInfo, &m_batches[i].descriptorSet) != VK_SUCCESS)
+			throw std::runtime_error("Erreur : allocation du descriptor set du culling");
+
+		std::array<VkDescriptorBufferInfo, 4> bufferInfos = {};
+		bufferInfos[0].buffer = m_uboCulling.getUniformBuffer();
+		bufferInfos[0].offset = 0;
+		bufferInfos[0].range = m_uboCulling.getSize();
+		// Instances dynamiques : la copie de la frame est choisie par l'offset dynamique
+		Instance* instance = m_batches[i].instance;
+		bufferInfos[1].buffer = instance->getInstanceBuffer();
+		bufferInfos[1].offset = 0;
+		bufferInfos[1].range = instance->getFrameStride() > 0 ? instance->getFrameStride() : VK_WHOLE_SIZE;
+		bufferInfos[2].buffer = m_instanceBuffer;
+		bufferInfos[2].offset = 0;
+		bufferInfos[2].range = VK_WHOLE_SIZE;
+		bufferInfos[3].buffer = m_drawBuffer;
+		bufferInfos[3].offset = 0;
+		bufferInfos[3].range = VK_WHOLE_SIZE;
+
+		std::array<VkWriteDescriptorSet, 4> descriptorWrites = {};
+		for (uint32_t binding(0); binding < descriptorWrites.size(); ++binding)
+		{
+			descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[binding].dstSet = m_batches[i].descriptorSet;
+			descriptorWrites[binding].dstBinding = binding;
+			descriptorWrites[binding].dstArrayElement = 0;
+			descriptorWrites[binding].descriptorType = getDescriptorType(binding);
+			descriptorWrites[binding].descriptorCount = 1;
+			descriptorWrites[binding].pBufferInfo = &bufferInfos[binding];
+		}
+
+		vkUpdateDescriptorSets(vk->getDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+	}
+}
+
+void GpuCulling::update(Vulkan* vk, glm::mat4 view, glm::mat4 projection, float viewportHeight)
+{
+	UniformBufferObjectCulling data;
+	data.frustumPlanes = FrustumCuller::extractPlanes(projection * view);
+
+	data.cameraPosition = glm::vec4(glm::vec3(glm::inverse(view)[3]), std::abs(projection[1][1]) * 0.5f * viewportHeight);
+
+	m_uboCulling.update(vk, data);
+}
+
+void GpuCulling::record(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+	// Les draws de la frame precedente lisent encore les commandes et les instances
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+	VkBufferCopy copyRegion = {};
+	copyRegion.size = m_drawTemplates.size() * sizeof(VkDrawIndexedIndirectCommand);
+	vkCmdCopyBuffer(commandBuffer, m_drawTemplateBuffer, m_drawBuffer, 1, &copyRegion);
+
+	VkBufferMemoryBarrier resetBarrier = {};
+	resetBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	resetBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	resetBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	resetBarrier.buffer = m_drawBuffer;
+	resetBarrier.offset = 0;
+	resetBarrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &resetBarrier, 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline.GetComputePipeline());
+	for (int i(0); i < m_batches.size(); ++i)
+	{
+		// Nombre d'instances lu a l'enregistrement : la passe reenregistre quand il change
+		CullingBatch constants = m_batches[i].constants;
+		constants.nbInstances = m_batches[i].instance->getNbInstances();
+		if (constants.nbInstances == 0)
+			continue;
+
+		std::array<uint32_t, 2> dynamicOffsets = { m_uboCulling.getOffset() + m_uniformFrameSize * frame,
+			static_cast<uint32_t>(m_batches[i].instance->getFrameStride() * frame) };
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline.GetPipelineLayout(), 0, 1, &m_batches[i].descriptorSet,
+			static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+		vkCmdPushConstants(commandBuffer, m_pipeline.GetPipelineLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullingBatch), &constants);
+		vkCmdDispatch(commandBuffer, (constants.nbInstances + CULLING_GROUP_SIZE - 1) / CULLING_GROUP_SIZE, 1, 1);
+	}
+
+	std::array<VkBufferMemoryBarrier, 2> cullBarriers = {};
+	for (int i(0); i < cullBarriers.size(); ++i)
+	{
+		cullBarriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		cullBarriers[i].srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		cullBarriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		cullBarriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		cullBarriers[i].offset = 0;
+		cullBarriers[i].size = VK_WHOLE_SIZE;
+	}
+	cullBarriers[0].dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+	cullBarriers[0].buffer = m_drawBuffer;
+	cullBarriers[1].dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+	cullBarriers[1].buffer = m_instanceBuffer;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+		0, 0, nullptr, static_cast<uint32_t>(cullBarriers.size()), cullBarriers.data(), 0, nullptr);
+}
+
+void GpuCulling::cleanup(Vulkan* vk)
+{
+	if (!m_initialized)
+		return;
+
+	destroyBuffers(vk);
+	vkDestroyPipeline(vk->getDevice(), m_pipeline.GetComputePipeline(), nullptr);
+	vkDestroyPipelineLayout(vk->getDevice(), m_pipeline.GetPipelineLayout(), nullptr);
+	vkDestroyDescriptorSetLayout(vk->getDevice(), m_descriptorSetLayout, nullptr);
+	m_uboCulling.cleanup(vk->getDevice());
+
+	m_batches.clear();
+	m_drawTemplates.clear();
+	m_nbOutputInstances = 0;
+	m_initialized = false;
+}
+
+VkDescriptorType GpuCulling::getDescriptorType(uint32_t binding)
+{
+	// UBO du frustum et instances d'entree sont choisis par frame
+	if (binding == 0)
+		return VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	if (binding == 1)
+		return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+}
+
+void GpuCulling::createDescriptorSetLayout(VkDevice device)
+{
+	std::array<VkDescriptorSetLayoutBinding, 4> bindings = {};
+	for (uint32_t i(0); i < bindings.size(); ++i)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = getDescriptorType(i);
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &m_descriptorSetLayout) != VK_SUCCESS)
+		throw std::runtime_error("Erreur : descriptor set layout du culling");
+}
+
+void GpuCulling::destroyBuffers(Vulkan* vk)
+{
+	if (m_drawBuffer == VK_NULL_HANDLE)
+		return;
+
+	// Les command buffers deja enregistres peuvent encore les utiliser. Les allocations ne se copient pas
+	// et std::function demande une lambda copiable : elles sont deplacees dans des shared_ptr
+	VkDevice device = vk->getDevice();
+	VkBuffer drawTemplateBuffer = m_drawTemplateBuffer, drawBuffer = m_drawBuffer, instanceBuffer = m_instanceBuffer;
+	std::shared_ptr<Allocation> drawTemplateBufferMemory = std::make_shared<Allocation>(std::move(m_drawTemplateBufferMemory));
+	std::shared_ptr<Allocation> drawBufferMemory = std::make_shared<Allocation>(std::move(m_drawBufferMemory));
+	std::shared_ptr<Allocation> instanceBufferMemory = std::make_shared<Allocation>(std::move(m_instanceBufferMemory));
+	VkDescriptorPool descriptorPool = m_descriptorPool;
+	vk->deferDestroy([=]()
+	{
+		vkDestroyBuffer(device, drawTemplateBuffer, nullptr);
+		drawTemplateBufferMemory->free();
+		vkDestroyBuffer(device, drawBuffer, nullptr);
+		drawBufferMemory->free();
+		vkDestroyBuffer(device, instanceBuffer, nullptr);
+		instanceBufferMemory->free();
+		vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+	});
+
+	m_drawTemplateBuffer = m_drawBuffer = m_instanceBuffer = VK_NULL_HANDLE;
+	m_descriptorPool = VK_NULL_HANDLE;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+
+#include "Vulkan.h"
+#include "Pipeline.h"
+#include "Mesh.h"
+#include "Instance.h"
+#include "UniformBufferObject.h"
+
+// Lot d'instances d'un mesh, passe au compute shader en push constants
+struct CullingBatch
+{
+	glm::vec4 boundingSphere; // repere du mesh
+	uint32_t nbInstances;
+	uint32_t firstDraw; // commande du LOD 0, les LODs suivants a la suite
+	uint32_t nbLods;
+	float padding;
+	std::array<float, 8> lodMaxScreenRadius;
+};
+
+// Culling par frustum et choix du LOD des instances sur le GPU.
+// Le compute shader compacte les instances visibles par LOD et remplit les VkDrawIndexedIndirectCommand :
+// le cout CPU d'une frame ne depend plus du nombre d'instances
+class GpuCulling
+{
+public:
+	// Les draws des LODs commencent a firstInstance : sans drawIndirectFirstInstance ou sans le compute shader,
+	// le rendu reste instancie sur le CPU
+	static bool isAvailable(Vulkan* vk);
+
+	// Renvoie l'indice de la commande du LOD 0 du lot, build doit etre rappele ensuite.
+	// Le nombre d'instances est relu a chaque enregistrement, dans la limite de la capacite de l'Instance
+	uint32_t addBatch(MeshPBR* mesh, Instance* instance);
+	void build(Vulkan* vk);
+	void update(Vulkan* vk, glm::mat4 view, glm::mat4 projection, float viewportHeight);
+	// Hors de la passe de rendu, avant les draws indirects
+	void record(VkCommandBuffer commandBuffer, uint32_t frame);
+	void cleanup(Vulkan* vk);
+
+	bool hasBatches() { return !m_batches.empty(); }
+	VkBuffer getDrawBuffer() { return m_drawBuffer; }
+	VkBuffer getInstanceBuffer() { return m_instanceBuffer; }
+
+private:
+	static VkDescriptorType getDescriptorType(uint32_t binding);
+	void createDescriptorSetLayout(VkDevice device);
+	void destroyBuffers(Vulkan* vk);
+
+private:
+	struct Batch
+	{
+		CullingBatch constants;
+		Instance* instance;
+		VkDescriptorSet descriptorSet;
+	};
+	std::vector<Batch> m_batches;
+	std::vector<VkDrawIndexedIndirectCommand> m_drawTemplates; // instanceCount a 0, recopie a chaque frame
+	uint32_t m_nbOutputInstances = 0;
+
+	bool m_initialized = false;
+	Pipeline m_pipeline;
+	VkDescriptorSetLayout m_descriptorSetLayout;
+	VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+	UniformBufferObject<UniformBufferObjectCulling> m_uboCulling;
+	uint32_t m_uniformFrameSize = 0;
+
+	VkBuffer m_drawTemplateBuffer = VK_NULL_HANDLE;
+	Allocation m_drawTemplateBufferMemory;
+	VkBuffer m_drawBuffer = VK_NULL_HANDLE;
+	Allocation m_drawBufferMemory;
+	VkBuffer m_instanceBuffer = VK_NULL_HANDLE; // instances visibles, une plage par lot et par LOD
+	Allocation m_instanceBufferMemory;
+};
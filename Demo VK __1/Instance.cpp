@@ -1,20 +1,146 @@
 #include "Instance.h"
 
-void Instance::load(Vulkan* vk, VkDeviceSize bufferSize, void* data)
+#include <limits>
+
+// Les offsets dynamiques de storage buffer du culling GPU sont alignes au plus sur 256 octets
+const VkDeviceSize INSTANCE_FRAME_ALIGNMENT = 256;
+
+void Instance::load(Vulkan* vk, uint32_t stride, uint32_t nbInstances, const void* data)
+{
+	m_stride = stride;
+	m_nbInstances = m_capacity = nbInstances;
+	m_frameStride = 0;
+
+	// Aussi lu en storage buffer par le culling GPU
+	VkDeviceSize bufferSize = std::max<VkDeviceSize>(static_cast<VkDeviceSize>(stride) * nbInstances, 1);
+	StagingSlice staging = vk->getStagingRing()->allocate(vk, bufferSize);
+	memcpy(staging.data, data, static_cast<size_t>(stride) * nbInstances);
+
+	vk->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_instanceBuffer, m_instanceBufferMemory);
+
+	vk->copyBuffer(staging.buffer, m_instanceBuffer, bufferSize, 0, staging.offset);
+}
+
+void Instance::loadDynamic(Vulkan* vk, uint32_t stride, uint32_t capacity, uint32_t nbInstances, const void* data)
 {
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	vk->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	if (nbInstances > capacity)
+		throw std::runtime_error("Erreur : plus d'instances que la capacite du buffer");
+
+	m_stride = stride;
+	m_nbInstances = nbInstances;
+	m_capacity = capacity;
+	m_frameStride = (std::max<VkDeviceSize>(static_cast<VkDeviceSize>(stride) * capacity, 1) + INSTANCE_FRAME_ALIGNMENT - 1) / INSTANCE_FRAME_ALIGNMENT * INSTANCE_FRAME_ALIGNMENT;
+
+	vk->createBuffer(m_frameStride * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_instanceBuffer, m_instanceBufferMemory);
+
+	m_data.assign(static_cast<size_t>(stride) * capacity, 0);
+	if (nbInstances > 0)
+		memcpy(m_data.data(), data, static_cast<size_t>(stride) * nbInstances);
+	for (uint32_t frame(0); frame < MAX_FRAMES_IN_FLIGHT; ++frame)
+	{
+		memcpy(static_cast<char*>(m_instanceBufferMemory.mapped) + m_frameStride * frame, m_data.data(), m_data.size());
+		m_dirtyRanges[frame] = { 0, 0 };
+	}
+}
+
+void Instance::cleanup(VkDevice device)
+{
+	if (m_instanceBuffer == VK_NULL_HANDLE)
+		return;
+
+	vkDestroyBuffer(device, m_instanceBuffer, nullptr);
+	m_instanceBufferMemory.free();
+	m_instanceBuffer = VK_NULL_HANDLE;
+
+	m_data.clear();
+	m_nbInstances = m_capacity = 0;
+	m_frameStride = 0;
+}
+
+void Instance::update(uint32_t firstInstance, uint32_t nbInstances, const void* data)
+{
+	if (m_frameStride == 0)
+		throw std::runtime_error("Erreur : mise a jour d'instances statiques");
+	if (firstInstance + nbInstances > m_capacity)
+		throw std::runtime_error("Erreur : mise a jour hors du buffer d'instances");
+	if (nbInstances == 0)
+		return;
+
+	memcpy(m_data.data() + static_cast<size_t>(m_stride) * firstInstance, data, static_cast<size_t>(m_stride) * nbInstances);
+
+	// Chaque copie de frame rattrape la modification a son tour
+	for (uint32_t frame(0); frame < MAX_FRAMES_IN_FLIGHT; ++frame)
+	{
+		std::pair<uint32_t, uint32_t>& range = m_dirtyRanges[frame];
+		if (range.first == range.second)
+			range = { firstInstance, firstInstance + nbInstances };
+		else
+			range = { std::min(range.first, firstInstance), std::max(range.second, firstInstance + nbInstances) };
+	}
+}
+
+void Instance::resize(uint32_t nbInstances)
+{
+	if (m_frameStride == 0)
+		throw std::runtime_error("Erreur : redimensionnement d'instances statiques");
+	if (nbInstances > m_capacity)
+		throw std::runtime_error("Erreur : plus d'instances que la capacite du buffer");
+
+	// Les nouvelles instances doivent etre ecrites par update avant d'etre dessinees
+	m_nbInstances = nbInstances;
+}
+
+void Instance::flush(Vulkan* vk)
+{
+	if (m_frameStride == 0)
+		return;
+
+	// La copie de cette frame n'est plus lue par le GPU une fois sa fence passee
+	vk->beginFrame();
+
+	uint32_t frame = vk->getCurrentFrame();
+	std::pair<uint32_t, uint32_t>& range = m_dirtyRanges[frame];
+	if (range.first == range.second)
+		return;
+
+	size_t offset = static_cast<size_t>(m_stride) * range.first;
+	memcpy(static_cast<char*>(m_instanceBufferMemory.mapped) + m_frameStride * frame + offset, m_data.data() + offset, static_cast<size_t>(m_stride) * (range.second - range.first));
+	range = { 0, 0 };
+}
+
+void Instance::computeBuckets(std::vector<glm::mat4> models, glm::vec4 meshBoundingSphere, uint32_t bucketSize)
+{
+	m_buckets.clear();
+
+	// Les instances consecutives sont regroupees : elles doivent donc etre proches dans le buffer
+	for (uint32_t first(0); first < models.size(); first += bucketSize)
+	{
+		InstanceBucket bucket;
+		bucket.firstInstance = first;
+		bucket.nbInstances = std::min(bucketSize, static_cast<uint32_t>(models.size()) - first);
 
-	void* pData;
-	vkMapMemory(vk->getDevice(), stagingBufferMemory, 0, bufferSize, 0, &pData);
-	memcpy(pData, data, (size_t)bufferSize);
-	vkUnmapMemory(vk->getDevice(), stagingBufferMemory);
+		std::vector<glm::vec3> centers(bucket.nbInstances);
+		glm::vec3 minPos(std::numeric_limits<float>::max());
+		glm::vec3 maxPos(-std::numeric_limits<float>::max());
+		bucket.instanceRadius = 0.0f;
+		for (uint32_t i(0); i < bucket.nbInstances; ++i)
+		{
+			const glm::mat4& model = models[first + i];
+			float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
 
-	vk->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_instanceBuffer, m_instanceBufferMemory);
+			centers[i] = glm::vec3(model * glm::vec4(glm::vec3(meshBoundingSphere), 1.0f));
+			bucket.instanceRadius = std::max(bucket.instanceRadius, meshBoundingSphere.w * scale);
+			minPos = glm::min(minPos, centers[i]);
+			maxPos = glm::max(maxPos, centers[i]);
+		}
 
-	vk->copyBuffer(stagingBuffer, m_instanceBuffer, bufferSize);
+		bucket.center = (minPos + maxPos) * 0.5f;
+		bucket.radius = 0.0f;
+		for (uint32_t i(0); i < bucket.nbInstances; ++i)
+			bucket.radius = std::max(bucket.radius, glm::length(centers[i] - bucket.center));
+		bucket.radius += bucket.instanceRadius;
 
-	vkDestroyBuffer(vk->getDevice(), stagingBuffer, nullptr);
-	vkFreeMemory(vk->getDevice(), stagingBufferMemory, nullptr);
-}
\ No newline at end of file
+		m_buckets.push_back(bucket);
+	}
+}
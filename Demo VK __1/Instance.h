@@ -1,15 +1,52 @@
 #pragma once
 
 #include "Vulkan.h"
+#include "Pipeline.h"
+
+struct InstanceBucket
+{
+	uint32_t firstInstance;
+	uint32_t nbInstances;
+	glm::vec3 center;
+	float radius; // englobe toutes les instances du paquet
+	float instanceRadius; // rayon de la plus grande instance
+};
 
 class Instance
 {
 public:
-	void load(Vulkan* vk, VkDeviceSize bufferSize, void* data);
+	// Instances statiques : copiees une fois en memoire du GPU
+	void load(Vulkan* vk, uint32_t stride, uint32_t nbInstances, const void* data);
+	// Instances modifiees en cours de rendu : une copie par frame en vol dans un buffer mappe en permanence
+	void loadDynamic(Vulkan* vk, uint32_t stride, uint32_t capacity, uint32_t nbInstances, const void* data);
+	void cleanup(VkDevice device);
+
+	// Instances dynamiques seulement, prises en compte au prochain flush
+	void update(uint32_t firstInstance, uint32_t nbInstances, const void* data);
+	// Ajout ou retrait en fin de buffer, dans la limite de la capacite
+	void resize(uint32_t nbInstances);
+	// Recopie les instances modifiees dans la copie de la frame courante
+	void flush(Vulkan* vk);
+
+	void computeBuckets(std::vector<glm::mat4> models, glm::vec4 meshBoundingSphere, uint32_t bucketSize);
 
 	VkBuffer getInstanceBuffer() { return m_instanceBuffer; }
+	uint32_t getStride() { return m_stride; }
+	uint32_t getNbInstances() { return m_nbInstances; }
+	uint32_t getCapacity() { return m_capacity; }
+	// Ecart entre les copies de deux frames, 0 pour des instances statiques
+	VkDeviceSize getFrameStride() { return m_frameStride; }
+	std::vector<InstanceBucket> getBuckets() { return m_buckets; }
 private:
-	VkBuffer m_instanceBuffer;
-	VkDeviceMemory m_instanceBufferMemory;
-};
+	VkBuffer m_instanceBuffer = VK_NULL_HANDLE;
+	Allocation m_instanceBufferMemory;
+	uint32_t m_stride = 0;
+	uint32_t m_nbInstances = 0;
+	uint32_t m_capacity = 0;
 
+	VkDeviceSize m_frameStride = 0;
+	std::vector<char> m_data; // instances dynamiques cote CPU
+	std::array<std::pair<uint32_t, uint32_t>, MAX_FRAMES_IN_FLIGHT> m_dirtyRanges; // [debut, fin) a recopier pour chaque frame
+
+	std::vector<InstanceBucket> m_buckets;
+};
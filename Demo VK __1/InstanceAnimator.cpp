@@ -0,0 +1,166 @@
+#include "InstanceAnimator.h"
+
+const std::string ANIMATION_SHADER_PATH = "Shaders/compAnimateInstances.spv";
+const uint32_t ANIMATION_GROUP_SIZE = 64;
+
+bool InstanceAnimator::isAvailable(Vulkan* vk)
+{
+	return vk->hasShader(ANIMATION_SHADER_PATH);
+}
+
+void InstanceAnimator::initialize(Vulkan* vk, std::vector<AnimatedInstance> parameters, Instance* output)
+{
+	m_output = output;
+	m_nbInstances = static_cast<uint32_t>(parameters.size());
+
+	// Les parametres ne changent pas : copies une fois en memoire du GPU
+	VkDeviceSize parameterBufferSize = std::max<VkDeviceSize>(parameters.size() * sizeof(AnimatedInstance), 1);
+	StagingSlice staging = vk->getStagingRing()->allocate(vk, parameterBufferSize);
+	memcpy(staging.data, parameters.data(), parameters.size() * sizeof(AnimatedInstance));
+	vk->createBuffer(parameterBufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		m_parameterBuffer, m_parameterBufferMemory);
+	vk->copyBuffer(staging.buffer, m_parameterBuffer, parameterBufferSize, 0, staging.offset);
+
+	// Instances ecrites par le compute shader avant le premier draw
+	std::vector<CompactInstance> instances(parameters.size(), CompactInstance());
+	m_output->load(vk, sizeof(CompactInstance), m_nbInstances, instances.data());
+
+	std::array<VkDescriptorSetLayoutBinding, 3> bindings = {};
+	for (uint32_t i(0); i < bindings.size(); ++i)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(vk->getDevice(), &layoutInfo, nullptr, &m_descriptorSetLayout) != VK_SUCCESS)
+		throw std::runtime_error("Erreur : descriptor set layout de l'animation");
+
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(uint32_t);
+	m_pipeline.initializeCompute(vk, &m_descriptorSetLayout, ANIMATION_SHADER_PATH, { pushConstantRange });
+
+	m_uboAnimation.load(vk, UniformBufferObjectAnimation(), VK_SHADER_STAGE_COMPUTE_BIT);
+	m_uniformFrameSize = static_cast<uint32_t>(vk->getUniformArena()->getFrameSize());
+
+	createDescriptorSet(vk);
+}
+
+void InstanceAnimator::update(Vulkan* vk, float time)
+{
+	if (m_parameterBuffer == VK_NULL_HANDLE)
+		return;
+
+	// Seul l'UBO de la frame change : les command buffers pre-enregistres restent valides
+	UniformBufferObjectAnimation data;
+	data.time = glm::vec4(time, 0.0f, 0.0f, 0.0f);
+	m_uboAnimation.update(vk, data);
+}
+
+void InstanceAnimator::record(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+	if (m_nbInstances == 0)
+		return;
+
+	// Les draws et le culling de la frame precedente lisent encore les instances
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline.GetComputePipeline());
+	uint32_t dynamicOffset = m_uboAnimation.getOffset() + m_uniformFrameSize * frame;
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline.GetPipelineLayout(), 0, 1, &m_descriptorSet, 1, &dynamicOffset);
+	vkCmdPushConstants(commandBuffer, m_pipeline.GetPipelineLayout(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &m_nbInstances);
+	vkCmdDispatch(commandBuffer, (m_nbInstances + ANIMATION_GROUP_SIZE - 1) / ANIMATION_GROUP_SIZE, 1, 1);
+
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	barrier.buffer = m_output->getInstanceBuffer();
+	barrier.offset = 0;
+	barrier.size = VK_WHOLE_SIZE;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 0, nullptr, 1, &barrier, 0, nullptr);
+}
+
+void InstanceAnimator::cleanup(Vulkan* vk)
+{
+	if (m_parameterBuffer == VK_NULL_HANDLE)
+		return;
+
+	VkDevice device = vk->getDevice();
+	vkDestroyDescriptorPool(device, m_descriptorPool, nullptr);
+	vkDestroyPipeline(device, m_pipeline.GetComputePipeline(), nullptr);
+	vkDestroyPipelineLayout(device, m_pipeline.GetPipelineLayout(), nullptr);
+	vkDestroyDescriptorSetLayout(device, m_descriptorSetLayout, nullptr);
+	m_uboAnimation.cleanup(device);
+
+	vkDestroyBuffer(device, m_parameterBuffer, nullptr);
+	m_parameterBufferMemory.free();
+	m_parameterBuffer = VK_NULL_HANDLE;
+
+	m_output = nullptr;
+	m_nbInstances = 0;
+}
+
+void InstanceAnimator::createDescriptorSet(Vulkan* vk)
+{
+	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	poolSizes[0].descriptorCount = 1;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[1].descriptorCount = 2;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = 1;
+
+	if (vkCreateDescriptorPool(vk->getDevice(), &poolInfo, nullptr, &m_descriptorPool) != VK_SUCCESS)
+		throw std::runtime_error("Erreur : descriptor pool de l'animation");
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = m_descriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &m_descriptorSetLayout;
+
+	if (vkAllocateDescriptorSets(vk->getDevice(), &allocInfo, &m_descriptorSet) != VK_SUCCESS)
+		throw std::runtime_error("Erreur : allocation du descriptor set de l'animation");
+
+	std::array<VkDescriptorBufferInfo, 3> bufferInfos = {};
+	bufferInfos[0].buffer = m_uboAnimation.getUniformBuffer();
+	bufferInfos[0].offset = 0;
+	bufferInfos[0].range = m_uboAnimation.getSize();
+	bufferInfos[1].buffer = m_parameterBuffer;
+	bufferInfos[1].offset = 0;
+	bufferInfos[1].range = VK_WHOLE_SIZE;
+	bufferInfos[2].buffer = m_output->getInstanceBuffer();
+	bufferInfos[2].offset = 0;
+	bufferInfos[2].range = VK_WHOLE_SIZE;
+
+	std::array<VkWriteDescriptorSet, 3> descriptorWrites = {};
+	for (uint32_t binding(0); binding < descriptorWrites.size(); ++binding)
+	{
+		descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[binding].dstSet = m_descriptorSet;
+		descriptorWrites[binding].dstBinding = binding;
+		descriptorWrites[binding].dstArrayElement = 0;
+		descriptorWrites[binding].descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrites[binding].descriptorCount = 1;
+		descriptorWrites[binding].pBufferInfo = &bufferInfos[binding];
+	}
+
+	vkUpdateDescriptorSets(vk->getDevice(), static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Vulkan.h"
+#include "Pipeline.h"
+#include "Instance.h"
+#include "UniformBufferObject.h"
+
+// Parametres d'animation d'une instance, lus par le compute shader (std430)
+struct AnimatedInstance
+{
+	glm::vec4 positionScale; // position de repos, w : echelle
+	glm::vec4 rotationAxisSpeed; // axe de rotation, w : vitesse en radians par seconde
+	glm::vec4 oscillation; // deplacement maximal, w : frequence en hertz
+	uint32_t albedo; // comme CompactInstance
+	uint32_t roughnessMetallic;
+	float phase; // decalage en secondes
+	float padding = 0.0f;
+};
+
+// Animation des instances sur le GPU : un compute shader reecrit a chaque frame les CompactInstance
+// a partir des parametres, sans aucun envoi depuis le CPU
+class InstanceAnimator
+{
+public:
+	// Sans le compute shader, pas d'instances animees
+	static bool isAvailable(Vulkan* vk);
+
+	// Charge output au format CompactInstance, a dessiner avec INSTANCE_LAYOUT_COMPACT
+	void initialize(Vulkan* vk, std::vector<AnimatedInstance> parameters, Instance* output);
+	void update(Vulkan* vk, float time);
+	// Hors de la passe de rendu, avant le culling GPU et les draws
+	void record(VkCommandBuffer commandBuffer, uint32_t frame);
+	void cleanup(Vulkan* vk);
+
+private:
+	void createDescriptorSet(Vulkan* vk);
+
+private:
+	Instance* m_output = nullptr;
+	uint32_t m_nbInstances = 0;
+	VkBuffer m_parameterBuffer = VK_NULL_HANDLE;
+	Allocation m_parameterBufferMemory;
+
+	Pipeline m_pipeline;
+	VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+	VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+	VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
+	UniformBufferObject<UniformBufferObjectAnimation> m_uboAnimation;
+	uint32_t m_uniformFrameSize = 0;
+};
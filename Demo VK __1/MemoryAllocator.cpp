@@ -0,0 +1,272 @@
+#include "MemoryAllocator.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+
+const VkDeviceSize MEMORY_BLOCK_SIZE = 64 * 1024 * 1024;
+const VkDeviceSize MEMORY_MIN_ALLOCATION_SIZE = 256;
+// Au-dela, la ressource (grandes textures, cubemaps HDR) a sa propre VkDeviceMemory
+const VkDeviceSize MEMORY_DEDICATED_THRESHOLD = MEMORY_BLOCK_SIZE / 4;
+
+Allocation& Allocation::operator=(Allocation&& other) noexcept
+{
+	if (this == &other)
+		return *this;
+
+	free();
+
+	memory = other.memory;
+	offset = other.offset;
+	size = other.size;
+	mapped = other.mapped;
+	allocator = other.allocator;
+	blockID = other.blockID;
+
+	other.memory = VK_NULL_HANDLE;
+	other.offset = other.size = 0;
+	other.mapped = nullptr;
+	other.allocator = nullptr;
+	other.blockID = -1;
+
+	return *this;
+}
+
+void Allocation::free()
+{
+	if (allocator)
+		allocator->free(*this);
+}
+
+void MemoryAllocator::initialize(VkPhysicalDevice physicalDevice, VkDevice device)
+{
+	m_device = device;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &m_memoryProperties);
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	m_bufferImageGranularity = properties.limits.bufferImageGranularity;
+}
+
+void MemoryAllocator::cleanup()
+{
+#ifndef NDEBUG
+	printStatistics();
+#endif
+
+	for (int i(0); i < m_blocks.size(); ++i)
+	{
+		if (m_blocks[i].mapped)
+			vkUnmapMemory(m_device, m_blocks[i].memory);
+		vkFreeMemory(m_device, m_blocks[i].memory, nullptr);
+	}
+	m_blocks.clear();
+}
+
+Allocation MemoryAllocator::allocate(VkMemoryRequirements memRequirements, VkMemoryPropertyFlags properties, bool linear)
+{
+	uint32_t memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+
+	Allocation allocation;
+	allocation.allocator = this;
+	allocation.size = memRequirements.size;
+
+	m_statistics.nbAllocations++;
+	m_statistics.requestedBytes += memRequirements.size;
+
+	if (memRequirements.size > MEMORY_DEDICATED_THRESHOLD)
+	{
+		char* mapped = nullptr;
+		allocation.memory = allocateDeviceMemory(memRequirements.size, memoryTypeIndex, &mapped);
+		allocation.mapped = mapped;
+
+		m_statistics.nbDedicatedAllocations++;
+		m_statistics.reservedBytes += memRequirements.size;
+		m_statistics.usedBytes += memRequirements.size;
+
+		return allocation;
+	}
+
+	// Un bloc buddy est aligne sur sa taille : il suffit d'arrondir a la puissance de 2 superieure
+	VkDeviceSize size = std::max(memRequirements.size, std::max(memRequirements.alignment, MEMORY_MIN_ALLOCATION_SIZE));
+	uint32_t order = 0;
+	while ((MEMORY_MIN_ALLOCATION_SIZE << order) < size)
+		order++;
+
+	// Les ressources lineaires et optimales sont separees si la granularite depasse la taille minimale
+	bool separate = m_bufferImageGranularity > MEMORY_MIN_ALLOCATION_SIZE;
+
+	VkDeviceSize offset = 0;
+	int blockID = -1;
+	for (int i(0); i < m_blocks.size(); ++i)
+	{
+		if (m_blocks[i].memoryTypeIndex != memoryTypeIndex || (separate && m_blocks[i].linear != linear))
+			continue;
+		if (allocateInBlock(m_blocks[i], order, offset))
+		{
+			blockID = i;
+			break;
+		}
+	}
+	if (blockID == -1)
+	{
+		blockID = createBlock(memoryTypeIndex, linear);
+		if (!allocateInBlock(m_blocks[blockID], order, offset))
+			throw std::runtime_error("Erreur : allocation dans un nouveau bloc memoire");
+	}
+
+	Block& block = m_blocks[blockID];
+	allocation.memory = block.memory;
+	allocation.offset = offset;
+	allocation.mapped = block.mapped ? block.mapped + offset : nullptr;
+	allocation.blockID = blockID;
+
+	m_statistics.usedBytes += MEMORY_MIN_ALLOCATION_SIZE << order;
+
+	return allocation;
+}
+
+void MemoryAllocator::free(Allocation& allocation)
+{
+	if (allocation.memory == VK_NULL_HANDLE)
+		return;
+
+	m_statistics.nbAllocations--;
+	m_statistics.requestedBytes -= allocation.size;
+
+	if (allocation.blockID == -1)
+	{
+		if (allocation.mapped)
+			vkUnmapMemory(m_device, allocation.memory);
+		vkFreeMemory(m_device, allocation.memory, nullptr);
+
+		m_statistics.nbDeviceMemories--;
+		m_statistics.nbDedicatedAllocations--;
+		m_statistics.reservedBytes -= allocation.size;
+		m_statistics.usedBytes -= allocation.size;
+	}
+	else
+	{
+		Block& block = m_blocks[allocation.blockID];
+		auto it = block.allocated.find(allocation.offset);
+		if (it == block.allocated.end())
+			throw std::runtime_error("Erreur : liberation d'une allocation inconnue");
+
+		uint32_t order = it->second;
+		block.allocated.erase(it);
+		block.used -= MEMORY_MIN_ALLOCATION_SIZE << order;
+		m_statistics.usedBytes -= MEMORY_MIN_ALLOCATION_SIZE << order;
+
+		// Fusion avec le buddy tant qu'il est libre
+		VkDeviceSize offset = allocation.offset;
+		while (order + 1 < block.freeLists.size())
+		{
+			VkDeviceSize buddy = offset ^ (MEMORY_MIN_ALLOCATION_SIZE << order);
+			auto buddyIt = block.freeLists[order].find(buddy);
+			if (buddyIt == block.freeLists[order].end())
+				break;
+
+			block.freeLists[order].erase(buddyIt);
+			offset = std::min(offset, buddy);
+			order++;
+		}
+		block.freeLists[order].insert(offset);
+	}
+
+	// Sans allocateur, l'affectation ne repasse pas par free
+	allocation.allocator = nullptr;
+	allocation = Allocation();
+}
+
+void MemoryAllocator::printStatistics()
+{
+	std::cout << "[Memoire] " << m_statistics.nbAllocations << " allocations dans " << m_statistics.nbDeviceMemories << " VkDeviceMemory ("
+		<< m_statistics.nbDedicatedAllocations << " dediees), " << m_statistics.nbVkAllocateMemoryCalls << " appels a vkAllocateMemory" << std::endl;
+	std::cout << "[Memoire] Reserve : " << m_statistics.reservedBytes / (1024 * 1024) << " Mo, utilise : " << m_statistics.usedBytes / 1024
+		<< " Ko, demande : " << m_statistics.requestedBytes / 1024 << " Ko" << std::endl;
+}
+
+uint32_t MemoryAllocator::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
+{
+	for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; i++)
+	{
+		if ((typeFilter & (1 << i)) && (m_memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+			return i;
+	}
+
+	throw std::runtime_error("Erreur : type de memoire");
+}
+
+VkDeviceMemory MemoryAllocator::allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, char** mapped)
+{
+	VkMemoryAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+	allocInfo.allocationSize = size;
+	allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+	VkDeviceMemory memory;
+	if (vkAllocateMemory(m_device, &allocInfo, nullptr, &memory) != VK_SUCCESS)
+		throw std::runtime_error("Erreur : allocation de memoire");
+
+	m_statistics.nbVkAllocateMemoryCalls++;
+	m_statistics.nbDeviceMemories++;
+
+	// La memoire visible par l'hote reste mappee : une VkDeviceMemory ne peut etre mappee qu'une fois
+	*mapped = nullptr;
+	if (m_memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		void* data;
+		if (vkMapMemory(m_device, memory, 0, size, 0, &data) != VK_SUCCESS)
+			throw std::runtime_error("Erreur : map de la memoire");
+		*mapped = static_cast<char*>(data);
+	}
+
+	return memory;
+}
+
+int MemoryAllocator::createBlock(uint32_t memoryTypeIndex, bool linear)
+{
+	Block block;
+	block.memoryTypeIndex = memoryTypeIndex;
+	block.linear = linear;
+	block.memory = allocateDeviceMemory(MEMORY_BLOCK_SIZE, memoryTypeIndex, &block.mapped);
+
+	uint32_t nbOrders = 1;
+	while ((MEMORY_MIN_ALLOCATION_SIZE << (nbOrders - 1)) < MEMORY_BLOCK_SIZE)
+		nbOrders++;
+	block.freeLists.resize(nbOrders);
+	block.freeLists[nbOrders - 1].insert(0);
+
+	m_blocks.push_back(block);
+	m_statistics.reservedBytes += MEMORY_BLOCK_SIZE;
+
+#ifndef NDEBUG
+	std::cout << "[Memoire] Nouveau bloc de " << MEMORY_BLOCK_SIZE / (1024 * 1024) << " Mo (type " << memoryTypeIndex << ", " << (linear ? "lineaire" : "optimal") << ")" << std::endl;
+#endif
+
+	return (int)m_blocks.size() - 1;
+}
+
+bool MemoryAllocator::allocateInBlock(Block& block, uint32_t order, VkDeviceSize& offset)
+{
+	uint32_t freeOrder = order;
+	while (freeOrder < block.freeLists.size() && block.freeLists[freeOrder].empty())
+		freeOrder++;
+	if (freeOrder == block.freeLists.size())
+		return false;
+
+	offset = *block.freeLists[freeOrder].begin();
+	block.freeLists[freeOrder].erase(block.freeLists[freeOrder].begin());
+
+	// Decoupe : la moitie haute reste libre a chaque niveau
+	while (freeOrder > order)
+	{
+		freeOrder--;
+		block.freeLists[freeOrder].insert(offset + (MEMORY_MIN_ALLOCATION_SIZE << freeOrder));
+	}
+
+	block.allocated[offset] = order;
+	block.used += MEMORY_MIN_ALLOCATION_SIZE << order;
+
+	return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+class MemoryAllocator;
+
+// Morceau de VkDeviceMemory attribue a une ressource. Un seul proprietaire : copier l'allocation permettrait
+// de la liberer deux fois, un deplacement vide la source
+struct Allocation
+{
+	Allocation() = default;
+	Allocation(const Allocation&) = delete;
+	Allocation& operator=(const Allocation&) = delete;
+	Allocation(Allocation&& other) noexcept { *this = std::move(other); }
+	// Une allocation encore valide remplacee par une autre est liberee
+	Allocation& operator=(Allocation&& other) noexcept;
+
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0; // a passer a vkBind*Memory
+	VkDeviceSize size = 0;
+	void* mapped = nullptr; // memoire mappee en permanence si visible par l'hote, deja decalee de offset
+
+	MemoryAllocator* allocator = nullptr;
+	int blockID = -1; // -1 : allocation dediee
+
+	void free();
+};
+
+struct MemoryAllocatorStatistics
+{
+	uint32_t nbDeviceMemories = 0; // blocs + allocations dediees
+	uint32_t nbDedicatedAllocations = 0;
+	uint32_t nbAllocations = 0;
+	uint32_t nbVkAllocateMemoryCalls = 0;
+	VkDeviceSize reservedBytes = 0;
+	VkDeviceSize usedBytes = 0; // apres arrondi a la puissance de 2
+	VkDeviceSize requestedBytes = 0;
+};
+
+// Allocateur buddy : un bloc de VkDeviceMemory par type de memoire est decoupe en puissances de 2.
+// Les buffers et les images optimales ne partagent pas de bloc quand bufferImageGranularity l'exige
+class MemoryAllocator
+{
+public:
+	void initialize(VkPhysicalDevice physicalDevice, VkDevice device);
+	void cleanup();
+
+	Allocation allocate(VkMemoryRequirements memRequirements, VkMemoryPropertyFlags properties, bool linear);
+	void free(Allocation& allocation);
+
+	MemoryAllocatorStatistics getStatistics() { return m_statistics; }
+	void printStatistics();
+
+private:
+	struct Block
+	{
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		char* mapped = nullptr;
+		uint32_t memoryTypeIndex = 0;
+		bool linear = true;
+		std::vector<std::set<VkDeviceSize>> freeLists; // offsets libres par ordre
+		std::unordered_map<VkDeviceSize, uint32_t> allocated; // offset -> ordre
+		VkDeviceSize used = 0;
+	};
+
+	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+	VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memoryTypeIndex, char** mapped);
+	int createBlock(uint32_t memoryTypeIndex, bool linear);
+	bool allocateInBlock(Block& block, uint32_t order, VkDeviceSize& offset);
+
+private:
+	VkDevice m_device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties m_memoryProperties;
+	VkDeviceSize m_bufferImageGranularity = 1;
+
+	std::vector<Block> m_blocks;
+
+	MemoryAllocatorStatistics m_statistics;
+};
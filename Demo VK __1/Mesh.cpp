@@ -1,4 +1,5 @@
 #include "Mesh.h"
+#include "MeshRegistry.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
@@ -6,7 +7,92 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-void MeshPBR::loadObj(Vulkan * vk, std::string path, glm::vec3 forceNormal)
+#include <sys/stat.h>
+
+const uint32_t MESH_CACHE_MAGIC = 0x4843534D; // "MSCH"
+const uint32_t MESH_CACHE_VERSION = 4;
+
+const int MAX_LODS = 5;
+const size_t MIN_LOD_INDICES = 3 * 32;
+const float LOD_MAX_PIXEL_ERROR = 1.0f;
+
+struct MeshCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t optimized;
+	uint32_t nbVertices;
+	uint32_t nbIndices;
+	uint32_t nbLods;
+	int64_t sourceSize;
+	int64_t sourceTime;
+	VertexCacheStatistics cacheStatisticsBefore; // avant optimisation, pour les statistiques des chargements suivants
+	VertexCacheStatistics cacheStatisticsAfter;
+};
+
+void MeshPBR::loadObj(Vulkan * vk, std::string path, bool optimize, MeshRegistry* registry)
+{
+	std::string geometryKey = MeshRegistry::geometryKey(path, optimize);
+	std::shared_ptr<MeshGeometry> geometry = registry ? registry->findGeometry(geometryKey) : nullptr;
+	if (!geometry)
+	{
+		geometry = createGeometry(vk, path, optimize);
+		if (registry)
+			registry->addGeometry(geometryKey, geometry);
+	}
+
+	std::shared_ptr<MeshVertexBuffer> vertexBuffer = registry ? registry->findVertexBuffer(geometryKey) : nullptr;
+	if (!vertexBuffer)
+	{
+		vertexBuffer = createVertexBuffer(vk, *geometry);
+		if (registry)
+			registry->addVertexBuffer(geometryKey, vertexBuffer);
+	}
+
+	m_geometry = geometry;
+	m_vertexBuffer = vertexBuffer;
+}
+
+std::shared_ptr<MeshGeometry> MeshPBR::createGeometry(Vulkan* vk, std::string path, bool optimize)
+{
+	// Les buffers sont detruits avec le dernier MeshPBR qui utilise la geometrie
+	GeometryArena* arena = vk->getGeometryArena();
+	std::shared_ptr<MeshGeometry> geometry(new MeshGeometry(), [arena](MeshGeometry* sharedGeometry)
+	{
+		arena->freeIndices(sharedGeometry->indexRange);
+		delete sharedGeometry;
+	});
+
+	// Un cache par jeu d'options : le meme OBJ charge avec et sans optimisation ne reecrit pas le cache de l'autre
+	std::string cachePath = path + (optimize ? ".optimized.meshcache" : ".meshcache");
+	if (!loadCache(*geometry, cachePath, path, optimize))
+	{
+		readObj(*geometry, path);
+		if (optimize)
+		{
+			MeshPBR::optimize(*geometry);
+#ifndef NDEBUG
+			std::cout << "[Optimisation mesh] " << path << " : ACMR " << geometry->cacheStatisticsBefore.acmr << " -> " << geometry->cacheStatisticsAfter.acmr <<
+				", ATVR " << geometry->cacheStatisticsBefore.atvr << " -> " << geometry->cacheStatisticsAfter.atvr << std::endl;
+#endif // !NDEBUG
+		}
+		buildLods(*geometry, optimize);
+#ifndef NDEBUG
+		std::cout << "[LOD mesh] " << path << " :";
+		for (int i(0); i < geometry->lods.size(); ++i)
+			std::cout << " " << geometry->lods[i].nbIndices / 3 << " triangles (erreur " << geometry->lods[i].error << ")";
+		std::cout << std::endl;
+#endif // !NDEBUG
+		saveCache(*geometry, cachePath, path, optimize);
+	}
+
+	computeBounds(*geometry);
+	createIndexBuffer(vk, *geometry);
+
+	return geometry;
+}
+
+void MeshPBR::readObj(MeshGeometry& geometry, std::string path)
 {
 	tinyobj::attrib_t attrib;
 	std::vector<tinyobj::shape_t> shapes;
@@ -24,6 +110,8 @@ void MeshPBR::loadObj(Vulkan * vk, std::string path, glm::vec3 forceNormal)
 #endif // !NDEBUG
 
 
+	std::vector<Vertex>& vertices = geometry.vertices;
+	std::vector<uint32_t>& indices = geometry.indices;
 	std::unordered_map<Vertex, uint32_t> uniqueVertices = {};
 
 	for (const auto& shape : shapes)
@@ -46,7 +134,8 @@ void MeshPBR::loadObj(Vulkan * vk, std::string path, glm::vec3 forceNormal)
 				1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
 			};
 			
-			if (forceNormal == glm::vec3(-1.0f))
+			// Certains fichiers n'ont pas de normales : elles sont alors forcees au chargement
+			if (index.normal_index >= 0)
 			{
 				vertex.normal =
 				{
@@ -56,22 +145,22 @@ void MeshPBR::loadObj(Vulkan * vk, std::string path, glm::vec3 forceNormal)
 				};
 			}
 			else
-				vertex.normal = forceNormal;
+				vertex.normal = glm::vec3(0.0f);
 
 			if (uniqueVertices.count(vertex) == 0)
 			{
-				uniqueVertices[vertex] = static_cast<uint32_t>(m_vertices.size());
-				m_vertices.push_back(vertex);
+				uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
+				vertices.push_back(vertex);
 			}
 
-			m_indices.push_back(uniqueVertices[vertex]);
+			indices.push_back(uniqueVertices[vertex]);
 
 			numVertex++;
 		}
 	}
 	
 	std::array<Vertex, 3> tempTriangle;
-	for (int i(0); i <= m_indices.size(); ++i)
+	for (int i(0); i <= indices.size(); ++i)
 	{
 		if (i != 0 && i % 3 == 0)
 		{
@@ -89,17 +178,180 @@ void MeshPBR::loadObj(Vulkan * vk, std::string path, glm::vec3 forceNormal)
 			tangent = glm::normalize(tangent);
 
 			for (int j(i - 1); j > i - 4; --j)
-				m_vertices[m_indices[j]].tangent = tangent;
+				vertices[indices[j]].tangent = tangent;
 		}
 
-		if (i == m_indices.size())
+		if (i == indices.size())
 			break;
 		
-		tempTriangle[i % 3] = m_vertices[m_indices[i]];
+		tempTriangle[i % 3] = vertices[indices[i]];
 	}
+}
+
+void MeshPBR::optimize(MeshGeometry& geometry)
+{
+	geometry.cacheStatisticsBefore = MeshOptimizer::analyzeVertexCache(geometry.indices, geometry.vertices.size());
 
-	createVertexBuffer(vk);
-	createIndexBuffer(vk);
+	MeshOptimizer::optimizeVertexCache(geometry.indices, geometry.vertices.size());
+	MeshOptimizer::optimizeOverdraw(geometry.indices, geometry.vertices);
+	MeshOptimizer::optimizeVertexFetch(geometry.indices, geometry.vertices);
+
+	geometry.cacheStatisticsAfter = MeshOptimizer::analyzeVertexCache(geometry.indices, geometry.vertices.size());
+}
+
+void MeshPBR::buildLods(MeshGeometry& geometry, bool optimize)
+{
+	geometry.lods.clear();
+	geometry.lods.push_back({ 0, static_cast<uint32_t>(geometry.indices.size()), 0.0f });
+
+	// Chaque LOD est simplifie a partir du precedent et partage le vertex buffer
+	std::vector<uint32_t> lodIndices = geometry.indices;
+	float error = 0.0f;
+	for (int i(1); i < MAX_LODS; ++i)
+	{
+		size_t previousSize = lodIndices.size();
+		size_t target = previousSize / 6 * 3;
+		if (target < MIN_LOD_INDICES)
+			break;
+
+		error += MeshOptimizer::simplify(lodIndices, geometry.vertices, target);
+		if (lodIndices.size() > previousSize * 9 / 10)
+			break;
+
+		if (optimize)
+			MeshOptimizer::optimizeVertexCache(lodIndices, geometry.vertices.size());
+
+		geometry.lods.push_back({ static_cast<uint32_t>(geometry.indices.size()), static_cast<uint32_t>(lodIndices.size()), error });
+		geometry.indices.insert(geometry.indices.end(), lodIndices.begin(), lodIndices.end());
+	}
+}
+
+void MeshPBR::computeBounds(MeshGeometry& geometry)
+{
+	const std::vector<Vertex>& vertices = geometry.vertices;
+	if (vertices.empty())
+		return;
+
+	glm::vec3 minPos = vertices[0].pos;
+	glm::vec3 maxPos = vertices[0].pos;
+	for (int i(1); i < vertices.size(); ++i)
+	{
+		minPos = glm::min(minPos, vertices[i].pos);
+		maxPos = glm::max(maxPos, vertices[i].pos);
+	}
+
+	glm::vec3 center = (minPos + maxPos) * 0.5f;
+	float radius = 0.0f;
+	for (int i(0); i < vertices.size(); ++i)
+		radius = std::max(radius, glm::length(vertices[i].pos - center));
+
+	geometry.boundingSphere = glm::vec4(center, radius);
+}
+
+uint32_t MeshPBR::selectLod(float screenRadius)
+{
+	// LOD le plus grossier dont l'erreur projetee reste sous le pixel
+	uint32_t lod = 0;
+	for (uint32_t i(1); i < m_geometry->lods.size(); ++i)
+	{
+		if (m_geometry->lods[i].error * screenRadius <= LOD_MAX_PIXEL_ERROR)
+			lod = i;
+	}
+
+	return lod;
+}
+
+std::vector<float> MeshPBR::getLodMaxScreenRadii()
+{
+	// Meme critere que selectLod : erreur * rayon <= LOD_MAX_PIXEL_ERROR
+	std::vector<float> maxScreenRadii(m_geometry->lods.size());
+	for (uint32_t i(0); i < m_geometry->lods.size(); ++i)
+		maxScreenRadii[i] = m_geometry->lods[i].error > 0.0f ? LOD_MAX_PIXEL_ERROR / m_geometry->lods[i].error : std::numeric_limits<float>::max();
+
+	return maxScreenRadii;
+}
+
+bool MeshPBR::loadCache(MeshGeometry& geometry, std::string cachePath, std::string sourcePath, bool optimized)
+{
+	struct stat sourceStat;
+	if (stat(sourcePath.c_str(), &sourceStat) != 0)
+		return false;
+
+	std::ifstream file(cachePath, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+		return false;
+	uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+	file.seekg(0);
+
+	MeshCacheHeader header;
+	if (fileSize < sizeof(header) || !file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return false;
+
+	// Cache invalide si le format, les options ou le fichier source ont change
+	if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION || header.optimized != (optimized ? 1u : 0u) ||
+		header.sourceSize != static_cast<int64_t>(sourceStat.st_size) || header.sourceTime != static_cast<int64_t>(sourceStat.st_mtime))
+		return false;
+
+	// Tailles verifiees avant toute allocation : un fichier tronque ou corrompu ne doit pas reserver des Go
+	uint64_t payloadSize = sizeof(Vertex) * static_cast<uint64_t>(header.nbVertices) + sizeof(uint32_t) * static_cast<uint64_t>(header.nbIndices) +
+		sizeof(MeshLod) * static_cast<uint64_t>(header.nbLods);
+	if (header.nbLods == 0 || payloadSize != fileSize - sizeof(header))
+		return false;
+
+	geometry.vertices.resize(header.nbVertices);
+	geometry.indices.resize(header.nbIndices);
+	geometry.lods.resize(header.nbLods);
+	file.read(reinterpret_cast<char*>(geometry.vertices.data()), sizeof(Vertex) * geometry.vertices.size());
+	file.read(reinterpret_cast<char*>(geometry.indices.data()), sizeof(uint32_t) * geometry.indices.size());
+	file.read(reinterpret_cast<char*>(geometry.lods.data()), sizeof(MeshLod) * geometry.lods.size());
+
+	// Les draws lisent l'arena partagee : un LOD ou un indice hors du mesh deborderait sur les autres
+	bool valid = static_cast<bool>(file);
+	for (int i(0); valid && i < geometry.lods.size(); ++i)
+		valid = static_cast<uint64_t>(geometry.lods[i].firstIndex) + geometry.lods[i].nbIndices <= geometry.indices.size();
+	for (size_t i(0); valid && i < geometry.indices.size(); ++i)
+		valid = geometry.indices[i] < geometry.vertices.size();
+
+	if (!valid)
+	{
+		geometry.vertices.clear();
+		geometry.indices.clear();
+		geometry.lods.clear();
+		return false;
+	}
+
+	geometry.cacheStatisticsBefore = header.cacheStatisticsBefore;
+	geometry.cacheStatisticsAfter = header.cacheStatisticsAfter;
+
+	return true;
+}
+
+void MeshPBR::saveCache(const MeshGeometry& geometry, std::string cachePath, std::string sourcePath, bool optimized)
+{
+	struct stat sourceStat;
+	if (stat(sourcePath.c_str(), &sourceStat) != 0)
+		return;
+
+	std::ofstream file(cachePath, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return;
+
+	MeshCacheHeader header;
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.optimized = optimized ? 1 : 0;
+	header.nbVertices = static_cast<uint32_t>(geometry.vertices.size());
+	header.nbIndices = static_cast<uint32_t>(geometry.indices.size());
+	header.nbLods = static_cast<uint32_t>(geometry.lods.size());
+	header.sourceSize = static_cast<int64_t>(sourceStat.st_size);
+	header.sourceTime = static_cast<int64_t>(sourceStat.st_mtime);
+	header.cacheStatisticsBefore = geometry.cacheStatisticsBefore;
+	header.cacheStatisticsAfter = geometry.cacheStatisticsAfter;
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(geometry.vertices.data()), sizeof(Vertex) * geometry.vertices.size());
+	file.write(reinterpret_cast<const char*>(geometry.indices.data()), sizeof(uint32_t) * geometry.indices.size());
+	file.write(reinterpret_cast<const char*>(geometry.lods.data()), sizeof(MeshLod) * geometry.lods.size());
 }
 
 int MeshPBR::createTexture(Vulkan* vk, uint32_t height, uint32_t width, int mipLevels, int nLayers)
@@ -168,18 +420,6 @@ void MeshPBR::loadCubemapFromFile(Vulkan* vk, std::vector<std::string> path)
 		if (!pixels)
 			throw std::runtime_error("Erreur : chargement de l'image " + path[i] + " !");
 
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		vk->createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-		uint8_t* data;
-		vkMapMemory(vk->getDevice(), stagingBufferMemory, 0, imageSize, 0, (void**)& data);
-			memcpy(data, pixels, static_cast<size_t>(imageSize));
-		vkUnmapMemory(vk->getDevice(), stagingBufferMemory);
-
-		stbi_image_free(pixels);
-
 		if (i == 0)
 		{
 			vk->createImage(texWidth, texHeight, m_mipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
@@ -188,13 +428,17 @@ void MeshPBR::loadCubemapFromFile(Vulkan* vk, std::vector<std::string> path)
 			vk->transitionImageLayout(m_images[m_images.size() - 1].image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, m_mipLevels, path.size());
 		}
 
-		vk->copyBufferToImage(stagingBuffer, m_images[m_images.size() - 1].image, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), i);
+		// Tranche prise apres la transition : hors lot, sa soumission rendrait la tranche avant la copie
+		StagingSlice staging = vk->getStagingRing()->allocate(vk, imageSize);
+		memcpy(staging.data, pixels, static_cast<size_t>(imageSize));
+
+		stbi_image_free(pixels);
+
+		vk->copyBufferToImage(staging.buffer, m_images[m_images.size() - 1].image, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), i, staging.offset);
 		//vk->transitionImageLayout(m_textureImage[m_textureImage.size() - 1], VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, m_mipLevels);
 
 		vk->generateMipmaps(m_images[m_images.size() - 1].image, VK_FORMAT_R8G8B8A8_UNORM, texWidth, texHeight, m_mipLevels, i);
 
-		vkDestroyBuffer(vk->getDevice(), stagingBuffer, nullptr);
-		vkFreeMemory(vk->getDevice(), stagingBufferMemory, nullptr);
 	}
 
 	m_images[m_images.size() - 1].imageView = vk->createImageView(m_images[m_images.size() - 1].image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, m_mipLevels, VK_IMAGE_VIEW_TYPE_CUBE);
@@ -258,18 +502,6 @@ void MeshPBR::loadHDRTexture(Vulkan* vk, std::vector<std::string> path)
 		if (!pixels)
 			throw std::runtime_error("Erreur : chargement de l'image " + path[i] + " !");
 
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		vk->createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-		uint8_t* data;
-		vkMapMemory(vk->getDevice(), stagingBufferMemory, 0, imageSize, 0, (void**)& data);
-		memcpy(data, pixels, static_cast<size_t>(imageSize));
-		vkUnmapMemory(vk->getDevice(), stagingBufferMemory);
-
-		stbi_image_free(pixels);
-
 		m_images.push_back(Image());
 
 		vk->createImage(texWidth, texHeight, m_mipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_TILING_OPTIMAL,
@@ -277,13 +509,17 @@ void MeshPBR::loadHDRTexture(Vulkan* vk, std::vector<std::string> path)
 			m_images[m_images.size() - 1].image, m_images[m_images.size() - 1].imageMemory);
 
 		vk->transitionImageLayout(m_images[m_images.size() - 1].image, VK_FORMAT_R32G32B32A32_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, m_mipLevels, 1);
-		vk->copyBufferToImage(stagingBuffer, m_images[m_images.size() - 1].image, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 0);
+
+		StagingSlice staging = vk->getStagingRing()->allocate(vk, imageSize);
+		memcpy(staging.data, pixels, static_cast<size_t>(imageSize));
+
+		stbi_image_free(pixels);
+
+		vk->copyBufferToImage(staging.buffer, m_images[m_images.size() - 1].image, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 0, staging.offset);
 		//vk->transitionImageLayout(m_textureImage[m_textureImage.size() - 1], VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, m_mipLevels);
 
 		vk->generateMipmaps(m_images[m_images.size() - 1].image, VK_FORMAT_R32G32B32A32_SFLOAT, texWidth, texHeight, m_mipLevels, 0);
 
-		vkDestroyBuffer(vk->getDevice(), stagingBuffer, nullptr);
-		vkFreeMemory(vk->getDevice(), stagingBufferMemory, nullptr);
 
 		createTextureImageView(vk, VK_FORMAT_R32G32B32A32_SFLOAT);
 	}
@@ -310,7 +546,7 @@ void MeshPBR::clearImages(VkDevice device)
 	{
 		vkDestroyImageView(device, m_images[i].imageView, nullptr);
 		vkDestroyImage(device, m_images[i].image, nullptr);
-		vkFreeMemory(device, m_images[i].imageMemory, nullptr);
+		m_images[i].imageMemory.free();
 	}
 
 	m_images.clear();
@@ -318,65 +554,54 @@ void MeshPBR::clearImages(VkDevice device)
 
 void MeshPBR::cleanup(VkDevice device)
 {
-	m_vertices.clear();
-	m_indices.clear();
-
-	vkDestroyBuffer(device, m_vertexBuffer, nullptr);
-	vkFreeMemory(device, m_vertexBufferMemory, nullptr);
-	
-	vkDestroyBuffer(device, m_indexBuffer, nullptr);
-	vkFreeMemory(device, m_indexBufferMemory, nullptr);
+	// Les buffers partages sont liberes avec la derniere reference
+	m_geometry.reset();
+	m_vertexBuffer.reset();
 
 	for (int i(0); i < m_images.size(); ++i)
 	{
 		vkDestroyImageView(device, m_images[i].imageView, nullptr);
 		vkDestroyImage(device, m_images[i].image, nullptr);
-		vkFreeMemory(device, m_images[i].imageMemory, nullptr);
+		m_images[i].imageMemory.free();
 	}
 
 	m_isDestroyed = true;
 }
 
-void MeshPBR::createVertexBuffer(Vulkan * vk)
+std::shared_ptr<MeshVertexBuffer> MeshPBR::createVertexBuffer(Vulkan * vk, const MeshGeometry& geometry)
 {
-	VkDeviceSize bufferSize = sizeof(m_vertices[0]) * m_vertices.size();
-
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	vk->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-	void* data;
-	vkMapMemory(vk->getDevice(), stagingBufferMemory, 0, bufferSize, 0, &data);
-		memcpy(data, m_vertices.data(), (size_t)bufferSize);
-	vkUnmapMemory(vk->getDevice(), stagingBufferMemory);
-
-	vk->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_vertexBuffer, m_vertexBufferMemory);
+	GeometryArena* arena = vk->getGeometryArena();
+	std::shared_ptr<MeshVertexBuffer> vertexBuffer(new MeshVertexBuffer(), [arena](MeshVertexBuffer* sharedVertexBuffer)
+	{
+		arena->freeVertices(sharedVertexBuffer->vertexRange);
+		delete sharedVertexBuffer;
+	});
 
-	vk->copyBuffer(stagingBuffer, m_vertexBuffer, bufferSize);
+	const std::vector<Vertex>& vertices = geometry.vertices;
+	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+	vertexBuffer->vertexRange = arena->uploadVertices(vk, vertices.data(), bufferSize, sizeof(Vertex));
+	vertexBuffer->vertexOffset = static_cast<int32_t>(vertexBuffer->vertexRange.offset / sizeof(Vertex));
 
-	vkDestroyBuffer(vk->getDevice(), stagingBuffer, nullptr);
-	vkFreeMemory(vk->getDevice(), stagingBufferMemory, nullptr);
+	return vertexBuffer;
 }
 
-void MeshPBR::createIndexBuffer(Vulkan * vk)
+void MeshPBR::createIndexBuffer(Vulkan * vk, MeshGeometry& geometry)
 {
-	VkDeviceSize bufferSize = sizeof(m_indices[0]) * m_indices.size();
-
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	vk->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-	void* data;
-	vkMapMemory(vk->getDevice(), stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, m_indices.data(), (size_t)bufferSize);
-	vkUnmapMemory(vk->getDevice(), stagingBufferMemory);
-
-	vk->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_indexBuffer, m_indexBufferMemory);
-
-	vk->copyBuffer(stagingBuffer, m_indexBuffer, bufferSize);
+	// Les indices 16 bits suffisent tant que tous les sommets sont adressables
+	std::vector<uint16_t> indices16;
+	void* indexData = geometry.indices.data();
+	VkDeviceSize bufferSize = sizeof(geometry.indices[0]) * geometry.indices.size();
+	geometry.indexType = VK_INDEX_TYPE_UINT32;
+	if (geometry.vertices.size() <= static_cast<size_t>(std::numeric_limits<uint16_t>::max()) + 1)
+	{
+		indices16.assign(geometry.indices.begin(), geometry.indices.end());
+		indexData = indices16.data();
+		bufferSize = sizeof(indices16[0]) * indices16.size();
+		geometry.indexType = VK_INDEX_TYPE_UINT16;
+	}
 
-	vkDestroyBuffer(vk->getDevice(), stagingBuffer, nullptr);
-	vkFreeMemory(vk->getDevice(), stagingBufferMemory, nullptr);
+	geometry.indexRange = vk->getGeometryArena()->uploadIndices(vk, indexData, bufferSize);
+	geometry.firstIndex = static_cast<uint32_t>(geometry.indexRange.offset / (geometry.indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t)));
 }
 
 void MeshPBR::createTextureImage(Vulkan * vk, std::string path)
@@ -389,18 +614,6 @@ void MeshPBR::createTextureImage(Vulkan * vk, std::string path)
 	if (!pixels)
 		throw std::runtime_error("Erreur : chargement de l'image " + path + " !");
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	vk->createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-	uint8_t* data;
-	vkMapMemory(vk->getDevice(), stagingBufferMemory, 0, imageSize, 0, (void**)&data);
-		memcpy(data, pixels, static_cast<size_t>(imageSize));
-	vkUnmapMemory(vk->getDevice(), stagingBufferMemory);
-
-	stbi_image_free(pixels);
-
 	m_images.push_back(Image());
 
 	vk->createImage(texWidth, texHeight, m_mipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
@@ -408,13 +621,16 @@ void MeshPBR::createTextureImage(Vulkan * vk, std::string path)
 		m_images[m_images.size() - 1].image, m_images[m_images.size() - 1].imageMemory);
 
 	vk->transitionImageLayout(m_images[m_images.size() - 1].image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, m_mipLevels, 1);
-	vk->copyBufferToImage(stagingBuffer, m_images[m_images.size() - 1].image, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 0);
+
+	StagingSlice staging = vk->getStagingRing()->allocate(vk, imageSize);
+	memcpy(staging.data, pixels, static_cast<size_t>(imageSize));
+
+	stbi_image_free(pixels);
+
+	vk->copyBufferToImage(staging.buffer, m_images[m_images.size() - 1].image, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 0, staging.offset);
 	//vk->transitionImageLayout(m_textureImage[m_textureImage.size() - 1], VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, m_mipLevels);
 
 	vk->generateMipmaps(m_images[m_images.size() - 1].image, VK_FORMAT_R8G8B8A8_UNORM, texWidth, texHeight, m_mipLevels, 0);
-
-	vkDestroyBuffer(vk->getDevice(), stagingBuffer, nullptr);
-	vkFreeMemory(vk->getDevice(), stagingBufferMemory, nullptr);
 }
 
 void MeshPBR::createTextureImageView(Vulkan * vk, VkFormat format)
@@ -1,14 +1,47 @@
 #pragma once
 
 #include <unordered_map>
+#include <memory>
 
 #include "Vulkan.h"
 #include "Pipeline.h"
+#include "MeshOptimizer.h"
+
+struct MeshLod
+{
+	uint32_t firstIndex;
+	uint32_t nbIndices;
+	float error; // erreur geometrique relative au rayon du mesh
+};
+
+// Donnees partagees entre tous les MeshPBR charges depuis le meme fichier
+struct MeshGeometry
+{
+	std::vector<Vertex> vertices; // normales du fichier
+	std::vector<uint32_t> indices; // tous les LODs a la suite
+	std::vector<MeshLod> lods;
+	glm::vec4 boundingSphere = glm::vec4(0.0f); // centre et rayon dans le repere du mesh
+	VertexCacheStatistics cacheStatisticsBefore;
+	VertexCacheStatistics cacheStatisticsAfter;
+
+	GeometryRange indexRange; // dans l'arena de geometrie
+	uint32_t firstIndex = 0;
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+};
+
+// Sommets d'une variante de normale forcee de la geometrie
+struct MeshVertexBuffer
+{
+	GeometryRange vertexRange;
+	int32_t vertexOffset = 0;
+};
+
+class MeshRegistry;
 
 struct Image
 {
 	VkImage image;
-	VkDeviceMemory  imageMemory;
+	Allocation imageMemory;
 	VkImageView imageView;
 };
 
@@ -28,7 +61,7 @@ protected:
 class MeshPBR : public MeshBase
 {
 public:
-	void loadObj(Vulkan * vk, std::string path, glm::vec3 forceNormal = glm::vec3(-1.0f));
+	void loadObj(Vulkan * vk, std::string path, bool optimize = false, MeshRegistry* registry = nullptr);
 
 	int createTexture(Vulkan* vk, uint32_t height, uint32_t width, int mipLevels, int nLayers);
 	void loadTextureFromFile(Vulkan * vk, std::vector<std::string> path);
@@ -46,8 +79,16 @@ public:
 	void clearImages(VkDevice device);
 	void cleanup(VkDevice device);
 private:
-	void createVertexBuffer(Vulkan * vk);
-	void createIndexBuffer(Vulkan * vk);
+	static std::shared_ptr<MeshGeometry> createGeometry(Vulkan* vk, std::string path, bool optimize);
+	static void readObj(MeshGeometry& geometry, std::string path);
+	static void optimize(MeshGeometry& geometry);
+	static void buildLods(MeshGeometry& geometry, bool optimize);
+	static void computeBounds(MeshGeometry& geometry);
+	static bool loadCache(MeshGeometry& geometry, std::string cachePath, std::string sourcePath, bool optimized);
+	static void saveCache(const MeshGeometry& geometry, std::string cachePath, std::string sourcePath, bool optimized);
+
+	static std::shared_ptr<MeshVertexBuffer> createVertexBuffer(Vulkan * vk, const MeshGeometry& geometry);
+	static void createIndexBuffer(Vulkan * vk, MeshGeometry& geometry);
 
 	void createTextureImage(Vulkan * vk, std::string path);
 	void createTextureImageView(Vulkan * vk, VkFormat format);
@@ -64,20 +105,24 @@ public:
 	}
 	VkImageView getImageView(int index) { return m_images[index].imageView; }
 	VkSampler getSampler() { return m_textureSampler; }
-	VkBuffer getVertexBuffer() { return m_vertexBuffer; }
-	VkBuffer getIndexBuffer() { return m_indexBuffer; }
-	uint32_t getNumIndices() { return static_cast<uint32_t>(m_indices.size()); }
+	int32_t getVertexOffset() { return m_vertexBuffer->vertexOffset; }
+	uint32_t getFirstIndex() { return m_geometry->firstIndex; }
+	uint32_t getNumIndices() { return m_geometry->lods[0].nbIndices; }
+	std::vector<MeshLod> getLods() { return m_geometry->lods; }
+	uint32_t selectLod(float screenRadius);
+	// Rayon a l'ecran au-dessous duquel chaque LOD est acceptable, pour choisir le LOD sur le GPU
+	std::vector<float> getLodMaxScreenRadii();
+	glm::vec4 getBoundingSphere() { return m_geometry->boundingSphere; }
+	VkIndexType getIndexType() { return m_geometry->indexType; }
 	glm::mat4x4 getModelMatrix() { return m_modelMatrix; }
+	VertexCacheStatistics getCacheStatisticsBeforeOptimization() { return m_geometry->cacheStatisticsBefore; }
+	VertexCacheStatistics getCacheStatisticsAfterOptimization() { return m_geometry->cacheStatisticsAfter; }
 
 	void setImageView(int index, VkImageView imageView) { m_images[index].imageView = imageView; }
 
 private:
-	std::vector<Vertex> m_vertices;
-	std::vector<uint32_t> m_indices;
-	VkBuffer m_vertexBuffer;
-	VkDeviceMemory m_vertexBufferMemory;
-	VkBuffer m_indexBuffer;
-	VkDeviceMemory m_indexBufferMemory;
+	std::shared_ptr<MeshGeometry> m_geometry;
+	std::shared_ptr<MeshVertexBuffer> m_vertexBuffer;
 
 	uint32_t m_mipLevels;
 	std::vector<Image> m_images;
@@ -0,0 +1,553 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+const int FORSYTH_CACHE_SIZE = 32;
+
+static float forsythVertexScore(int cachePosition, uint32_t remainingValence)
+{
+	if (remainingValence == 0)
+		return -1.0f;
+
+	float score = 0.0f;
+	if (cachePosition >= 0)
+	{
+		// Les sommets du dernier triangle ont un score fixe pour ne pas favoriser les strips
+		if (cachePosition < 3)
+			score = 0.75f;
+		else
+			score = std::pow(1.0f - (cachePosition - 3) / static_cast<float>(FORSYTH_CACHE_SIZE - 3), 1.5f);
+	}
+
+	return score + 2.0f * std::pow(static_cast<float>(remainingValence), -0.5f);
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<uint32_t>& indices, size_t nbVertices)
+{
+	size_t nbTriangles = indices.size() / 3;
+	if (nbTriangles == 0)
+		return;
+
+	// Liste des triangles adjacents a chaque sommet
+	std::vector<uint32_t> valence(nbVertices, 0);
+	for (uint32_t index : indices)
+		valence[index]++;
+
+	std::vector<uint32_t> adjacencyOffsets(nbVertices + 1, 0);
+	for (size_t i(0); i < nbVertices; ++i)
+		adjacencyOffsets[i + 1] = adjacencyOffsets[i] + valence[i];
+
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> remaining(nbVertices, 0);
+	for (size_t t(0); t < nbTriangles; ++t)
+	{
+		for (int k(0); k < 3; ++k)
+		{
+			uint32_t v = indices[3 * t + k];
+			adjacency[adjacencyOffsets[v] + remaining[v]++] = static_cast<uint32_t>(t);
+		}
+	}
+
+	std::vector<int> cachePosition(nbVertices, -1);
+	std::vector<float> vertexScore(nbVertices);
+	for (size_t v(0); v < nbVertices; ++v)
+		vertexScore[v] = forsythVertexScore(-1, remaining[v]);
+
+	std::vector<float> triangleScore(nbTriangles);
+	int bestTriangle = 0;
+	for (size_t t(0); t < nbTriangles; ++t)
+	{
+		triangleScore[t] = vertexScore[indices[3 * t]] + vertexScore[indices[3 * t + 1]] + vertexScore[indices[3 * t + 2]];
+		if (triangleScore[t] > triangleScore[bestTriangle])
+			bestTriangle = static_cast<int>(t);
+	}
+
+	std::vector<bool> emitted(nbTriangles, false);
+	std::vector<uint32_t> cache;
+	std::vector<uint32_t> newCache;
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	size_t inputCursor = 0;
+
+	while (bestTriangle >= 0)
+	{
+		const uint32_t* triangle = &indices[3 * bestTriangle];
+		result.insert(result.end(), triangle, triangle + 3);
+		emitted[bestTriangle] = true;
+
+		newCache.assign(triangle, triangle + 3);
+		for (int k(0); k < 3; ++k)
+		{
+			// Retire le triangle de la liste d'adjacence du sommet
+			uint32_t v = triangle[k];
+			uint32_t* begin = &adjacency[adjacencyOffsets[v]];
+			uint32_t* end = begin + remaining[v];
+			uint32_t* found = std::find(begin, end, static_cast<uint32_t>(bestTriangle));
+			std::swap(*found, *(end - 1));
+			remaining[v]--;
+		}
+		for (uint32_t v : cache)
+		{
+			if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+				newCache.push_back(v);
+		}
+
+		for (size_t i(0); i < newCache.size(); ++i)
+		{
+			uint32_t v = newCache[i];
+			cachePosition[v] = i < static_cast<size_t>(FORSYTH_CACHE_SIZE) ? static_cast<int>(i) : -1;
+			vertexScore[v] = forsythVertexScore(cachePosition[v], remaining[v]);
+		}
+
+		bestTriangle = -1;
+		float bestScore = -1.0f;
+		for (uint32_t v : newCache)
+		{
+			for (uint32_t a(0); a < remaining[v]; ++a)
+			{
+				uint32_t t = adjacency[adjacencyOffsets[v] + a];
+				triangleScore[t] = vertexScore[indices[3 * t]] + vertexScore[indices[3 * t + 1]] + vertexScore[indices[3 * t + 2]];
+				if (cachePosition[v] >= 0 && triangleScore[t] > bestScore)
+				{
+					bestScore = triangleScore[t];
+					bestTriangle = static_cast<int>(t);
+				}
+			}
+		}
+
+		if (newCache.size() > static_cast<size_t>(FORSYTH_CACHE_SIZE))
+			newCache.resize(FORSYTH_CACHE_SIZE);
+		cache.swap(newCache);
+
+		// Impasse : on reprend le premier triangle restant dans l'ordre d'origine
+		if (bestTriangle < 0)
+		{
+			while (inputCursor < nbTriangles && emitted[inputCursor])
+				inputCursor++;
+			if (inputCursor < nbTriangles)
+				bestTriangle = static_cast<int>(inputCursor);
+		}
+	}
+
+	indices.swap(result);
+}
+
+void MeshOptimizer::optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, float threshold)
+{
+	size_t nbTriangles = indices.size() / 3;
+	if (nbTriangles == 0)
+		return;
+
+	const uint32_t cacheSize = 16;
+
+	// Frontieres dures : triangles dont les 3 sommets sont absents du cache
+	std::vector<size_t> hardBoundaries;
+	{
+		std::vector<uint32_t> timestamps(vertices.size(), 0);
+		uint32_t time = cacheSize + 1;
+		for (size_t t(0); t < nbTriangles; ++t)
+		{
+			int misses = 0;
+			for (int k(0); k < 3; ++k)
+			{
+				uint32_t v = indices[3 * t + k];
+				if (time - timestamps[v] > cacheSize)
+				{
+					timestamps[v] = time++;
+					misses++;
+				}
+			}
+			if (t == 0 || misses == 3)
+				hardBoundaries.push_back(t);
+		}
+	}
+
+	// Frontieres souples : coupe un cluster des que son ACMR reste proche de celui du cluster complet
+	std::vector<size_t> clusterStarts;
+	std::vector<uint32_t> timestamps(vertices.size(), 0);
+	uint32_t time = cacheSize + 1;
+	for (size_t c(0); c < hardBoundaries.size(); ++c)
+	{
+		size_t start = hardBoundaries[c];
+		size_t end = c + 1 < hardBoundaries.size() ? hardBoundaries[c + 1] : nbTriangles;
+
+		time += cacheSize + 1;
+		uint32_t misses = 0;
+		for (size_t i(3 * start); i < 3 * end; ++i)
+		{
+			if (time - timestamps[indices[i]] > cacheSize)
+			{
+				timestamps[indices[i]] = time++;
+				misses++;
+			}
+		}
+		float clusterThreshold = threshold * misses / static_cast<float>(end - start);
+
+		time += cacheSize + 1;
+		misses = 0;
+		size_t softStart = start;
+		clusterStarts.push_back(start);
+		for (size_t t(start); t < end; ++t)
+		{
+			for (int k(0); k < 3; ++k)
+			{
+				uint32_t v = indices[3 * t + k];
+				if (time - timestamps[v] > cacheSize)
+				{
+					timestamps[v] = time++;
+					misses++;
+				}
+			}
+
+			if (t + 1 < end && misses / static_cast<float>(t + 1 - softStart) <= clusterThreshold)
+			{
+				clusterStarts.push_back(t + 1);
+				softStart = t + 1;
+				misses = 0;
+				time += cacheSize + 1;
+			}
+		}
+	}
+
+	glm::vec3 meshCentroid(0.0f);
+	for (uint32_t index : indices)
+		meshCentroid += vertices[index].pos;
+	meshCentroid /= static_cast<float>(indices.size());
+
+	// Les clusters orientes vers l'exterieur sont dessines en premier
+	std::vector<float> clusterSortKey(clusterStarts.size());
+	for (size_t c(0); c < clusterStarts.size(); ++c)
+	{
+		size_t end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : nbTriangles;
+
+		glm::vec3 centroid(0.0f);
+		glm::vec3 normal(0.0f);
+		for (size_t t(clusterStarts[c]); t < end; ++t)
+		{
+			const glm::vec3& p0 = vertices[indices[3 * t]].pos;
+			const glm::vec3& p1 = vertices[indices[3 * t + 1]].pos;
+			const glm::vec3& p2 = vertices[indices[3 * t + 2]].pos;
+
+			centroid += (p0 + p1 + p2) / 3.0f;
+			normal += glm::cross(p1 - p0, p2 - p0);
+		}
+		centroid /= static_cast<float>(end - clusterStarts[c]);
+
+		float length = glm::length(normal);
+		clusterSortKey[c] = length > 0.0f ? glm::dot(centroid - meshCentroid, normal / length) : 0.0f;
+	}
+
+	std::vector<size_t> clusterOrder(clusterStarts.size());
+	std::iota(clusterOrder.begin(), clusterOrder.end(), 0);
+	std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](size_t a, size_t b) { return clusterSortKey[a] > clusterSortKey[b]; });
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	for (size_t c : clusterOrder)
+	{
+		size_t end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : nbTriangles;
+		result.insert(result.end(), indices.begin() + 3 * clusterStarts[c], indices.begin() + 3 * end);
+	}
+
+	indices.swap(result);
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<uint32_t>& indices, std::vector<Vertex>& vertices)
+{
+	const uint32_t unused = std::numeric_limits<uint32_t>::max();
+
+	std::vector<uint32_t> remap(vertices.size(), unused);
+	std::vector<Vertex> result;
+	result.reserve(vertices.size());
+
+	for (uint32_t& index : indices)
+	{
+		if (remap[index] == unused)
+		{
+			remap[index] = static_cast<uint32_t>(result.size());
+			result.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+
+	vertices.swap(result);
+}
+
+VertexCacheStatistics MeshOptimizer::analyzeVertexCache(const std::vector<uint32_t>& indices, size_t nbVertices, uint32_t cacheSize)
+{
+	VertexCacheStatistics statistics;
+	if (indices.empty())
+		return statistics;
+
+	// Simulation d'un cache FIFO
+	std::vector<uint32_t> timestamps(nbVertices, 0);
+	std::vector<bool> used(nbVertices, false);
+	uint32_t time = cacheSize + 1;
+	uint32_t misses = 0;
+	uint32_t nbUsedVertices = 0;
+
+	for (uint32_t index : indices)
+	{
+		if (time - timestamps[index] > cacheSize)
+		{
+			timestamps[index] = time++;
+			misses++;
+		}
+		if (!used[index])
+		{
+			used[index] = true;
+			nbUsedVertices++;
+		}
+	}
+
+	statistics.acmr = misses / static_cast<float>(indices.size() / 3);
+	statistics.atvr = misses / static_cast<float>(nbUsedVertices);
+
+	return statistics;
+}
+
+struct Quadric
+{
+	float a00 = 0.0f, a01 = 0.0f, a02 = 0.0f, a03 = 0.0f;
+	float a11 = 0.0f, a12 = 0.0f, a13 = 0.0f;
+	float a22 = 0.0f, a23 = 0.0f;
+	float a33 = 0.0f;
+	float weight = 0.0f;
+
+	void addPlane(glm::vec3 normal, float distance, float weight)
+	{
+		a00 += weight * normal.x * normal.x; a01 += weight * normal.x * normal.y; a02 += weight * normal.x * normal.z; a03 += weight * normal.x * distance;
+		a11 += weight * normal.y * normal.y; a12 += weight * normal.y * normal.z; a13 += weight * normal.y * distance;
+		a22 += weight * normal.z * normal.z; a23 += weight * normal.z * distance;
+		a33 += weight * distance * distance;
+		this->weight += weight;
+	}
+
+	void add(const Quadric& other)
+	{
+		a00 += other.a00; a01 += other.a01; a02 += other.a02; a03 += other.a03;
+		a11 += other.a11; a12 += other.a12; a13 += other.a13;
+		a22 += other.a22; a23 += other.a23;
+		a33 += other.a33;
+		weight += other.weight;
+	}
+
+	float error(glm::vec3 p) const
+	{
+		float e = a00 * p.x * p.x + 2.0f * a01 * p.x * p.y + 2.0f * a02 * p.x * p.z + 2.0f * a03 * p.x +
+			a11 * p.y * p.y + 2.0f * a12 * p.y * p.z + 2.0f * a13 * p.y +
+			a22 * p.z * p.z + 2.0f * a23 * p.z + a33;
+
+		// Distance au carre moyenne aux plans accumules
+		return e > 0.0f && weight > 0.0f ? e / weight : 0.0f;
+	}
+};
+
+struct Collapse
+{
+	uint32_t from;
+	uint32_t to;
+	float cost;
+};
+
+float MeshOptimizer::simplify(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, size_t targetIndexCount)
+{
+	size_t nbVertices = vertices.size();
+	if (indices.size() <= targetIndexCount || nbVertices == 0)
+		return 0.0f;
+
+	// Positions ramenees dans la sphere unite pour que l'erreur soit relative au rayon
+	glm::vec3 minPos = vertices[0].pos;
+	glm::vec3 maxPos = vertices[0].pos;
+	for (const Vertex& vertex : vertices)
+	{
+		minPos = glm::min(minPos, vertex.pos);
+		maxPos = glm::max(maxPos, vertex.pos);
+	}
+	glm::vec3 center = (minPos + maxPos) * 0.5f;
+	float radius = 0.0f;
+	for (const Vertex& vertex : vertices)
+		radius = std::max(radius, glm::length(vertex.pos - center));
+	if (radius <= 0.0f)
+		return 0.0f;
+
+	std::vector<glm::vec3> positions(nbVertices);
+	for (size_t v(0); v < nbVertices; ++v)
+		positions[v] = (vertices[v].pos - center) / radius;
+
+	// Les sommets dupliques (coutures d'UV ou de normales) sont verrouilles pour ne pas ouvrir le maillage
+	std::vector<bool> locked(nbVertices, false);
+	{
+		std::vector<uint32_t> order(nbVertices);
+		std::iota(order.begin(), order.end(), 0);
+		auto lessPosition = [&](uint32_t a, uint32_t b)
+		{
+			const glm::vec3& pa = vertices[a].pos;
+			const glm::vec3& pb = vertices[b].pos;
+			if (pa.x != pb.x) return pa.x < pb.x;
+			if (pa.y != pb.y) return pa.y < pb.y;
+			return pa.z < pb.z;
+		};
+		std::sort(order.begin(), order.end(), lessPosition);
+		for (size_t i(1); i < nbVertices; ++i)
+		{
+			if (vertices[order[i - 1]].pos == vertices[order[i]].pos)
+				locked[order[i - 1]] = locked[order[i]] = true;
+		}
+	}
+
+	std::vector<Quadric> quadrics(nbVertices);
+	for (size_t i(0); i < indices.size(); i += 3)
+	{
+		const glm::vec3& p0 = positions[indices[i]];
+		const glm::vec3& p1 = positions[indices[i + 1]];
+		const glm::vec3& p2 = positions[indices[i + 2]];
+
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float area = glm::length(normal);
+		if (area <= 0.0f)
+			continue;
+		normal /= area;
+
+		for (int k(0); k < 3; ++k)
+			quadrics[indices[i + k]].addPlane(normal, -glm::dot(normal, p0), area);
+	}
+
+	std::vector<uint32_t> adjacencyOffsets(nbVertices + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<uint32_t> remap(nbVertices);
+	std::vector<bool> touched(nbVertices);
+	std::vector<Collapse> collapses;
+	float maxError = 0.0f;
+
+	while (indices.size() > targetIndexCount)
+	{
+		size_t nbTriangles = indices.size() / 3;
+
+		// Triangles adjacents a chaque sommet
+		std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+		for (uint32_t index : indices)
+			adjacencyOffsets[index + 1]++;
+		for (size_t v(0); v < nbVertices; ++v)
+			adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+		adjacency.resize(indices.size());
+		{
+			std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+			for (size_t t(0); t < nbTriangles; ++t)
+				for (int k(0); k < 3; ++k)
+					adjacency[fill[indices[3 * t + k]]++] = static_cast<uint32_t>(t);
+		}
+
+		// Les sommets de bord (arete utilisee par un seul triangle) sont verrouilles
+		for (size_t t(0); t < nbTriangles; ++t)
+		{
+			for (int k(0); k < 3; ++k)
+			{
+				uint32_t a = indices[3 * t + k];
+				uint32_t b = indices[3 * t + (k + 1) % 3];
+
+				bool hasOpposite = false;
+				for (uint32_t i(adjacencyOffsets[b]); i < adjacencyOffsets[b + 1] && !hasOpposite; ++i)
+				{
+					const uint32_t* triangle = &indices[3 * adjacency[i]];
+					for (int e(0); e < 3; ++e)
+						hasOpposite |= triangle[e] == b && triangle[(e + 1) % 3] == a;
+				}
+				if (!hasOpposite)
+					locked[a] = locked[b] = true;
+			}
+		}
+
+		collapses.clear();
+		for (size_t t(0); t < nbTriangles; ++t)
+		{
+			for (int k(0); k < 3; ++k)
+			{
+				uint32_t a = indices[3 * t + k];
+				uint32_t b = indices[3 * t + (k + 1) % 3];
+
+				Quadric quadric = quadrics[a];
+				quadric.add(quadrics[b]);
+				if (!locked[a])
+					collapses.push_back({ a, b, quadric.error(positions[b]) });
+				if (!locked[b])
+					collapses.push_back({ b, a, quadric.error(positions[a]) });
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+		std::iota(remap.begin(), remap.end(), 0);
+		std::fill(touched.begin(), touched.end(), false);
+		size_t trianglesToRemove = (indices.size() - targetIndexCount + 2) / 3;
+		size_t removedTriangles = 0;
+
+		for (const Collapse& collapse : collapses)
+		{
+			if (removedTriangles >= trianglesToRemove)
+				break;
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+
+			// Refuse la fusion si un triangle restant se retourne
+			bool flipped = false;
+			size_t sharedTriangles = 0;
+			for (uint32_t i(adjacencyOffsets[collapse.from]); i < adjacencyOffsets[collapse.from + 1] && !flipped; ++i)
+			{
+				const uint32_t* triangle = &indices[3 * adjacency[i]];
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+				{
+					sharedTriangles++;
+					continue;
+				}
+
+				glm::vec3 p[3];
+				glm::vec3 q[3];
+				for (int k(0); k < 3; ++k)
+				{
+					p[k] = positions[triangle[k]];
+					q[k] = triangle[k] == collapse.from ? positions[collapse.to] : p[k];
+				}
+				glm::vec3 normalBefore = glm::cross(p[1] - p[0], p[2] - p[0]);
+				glm::vec3 normalAfter = glm::cross(q[1] - q[0], q[2] - q[0]);
+				flipped = glm::dot(normalBefore, normalAfter) <= 0.0f;
+			}
+			if (flipped || sharedTriangles == 0)
+				continue;
+
+			remap[collapse.from] = collapse.to;
+			quadrics[collapse.to].add(quadrics[collapse.from]);
+			maxError = std::max(maxError, collapse.cost);
+			removedTriangles += sharedTriangles;
+
+			// Le voisinage modifie n'est plus fiable jusqu'a la prochaine passe
+			for (uint32_t i(adjacencyOffsets[collapse.from]); i < adjacencyOffsets[collapse.from + 1]; ++i)
+			{
+				const uint32_t* triangle = &indices[3 * adjacency[i]];
+				touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+			}
+		}
+
+		if (removedTriangles == 0)
+			break;
+
+		size_t write = 0;
+		for (size_t i(0); i < indices.size(); i += 3)
+		{
+			uint32_t a = remap[indices[i]];
+			uint32_t b = remap[indices[i + 1]];
+			uint32_t c = remap[indices[i + 2]];
+			if (a == b || b == c || c == a)
+				continue;
+
+			indices[write++] = a;
+			indices[write++] = b;
+			indices[write++] = c;
+		}
+		indices.resize(write);
+	}
+
+	return std::sqrt(maxError);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+
+#include "Pipeline.h"
+
+struct VertexCacheStatistics
+{
+	float acmr = 0.0f; // cache misses par triangle
+	float atvr = 0.0f; // cache misses par sommet utilise
+};
+
+class MeshOptimizer
+{
+public:
+	// Reordonne les triangles pour la localite dans le cache post-transform (Forsyth)
+	static void optimizeVertexCache(std::vector<uint32_t>& indices, size_t nbVertices);
+	// Decoupe en clusters puis les trie pour limiter l'overdraw, independamment du point de vue
+	static void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, float threshold = 1.05f);
+	// Reordonne les sommets dans l'ordre de premiere utilisation
+	static void optimizeVertexFetch(std::vector<uint32_t>& indices, std::vector<Vertex>& vertices);
+	// Fusionne des aretes selon les quadriques d'erreur jusqu'a atteindre le nombre d'indices vise, sans creer de sommet
+	// Retourne l'erreur geometrique introduite, relative au rayon du mesh
+	static float simplify(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices, size_t targetIndexCount);
+
+	static VertexCacheStatistics analyzeVertexCache(const std::vector<uint32_t>& indices, size_t nbVertices, uint32_t cacheSize = 16);
+};
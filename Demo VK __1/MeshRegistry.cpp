@@ -0,0 +1,52 @@
+#include "MeshRegistry.h"
+
+std::string MeshRegistry::geometryKey(std::string path, bool optimize)
+{
+	return path + (optimize ? "|optimized" : "");
+}
+
+std::shared_ptr<MeshGeometry> MeshRegistry::findGeometry(std::string key)
+{
+	auto it = m_geometries.find(key);
+	if (it == m_geometries.end())
+		return nullptr;
+
+	std::shared_ptr<MeshGeometry> geometry = it->second.lock();
+	if (!geometry)
+		m_geometries.erase(it);
+#ifndef NDEBUG
+	else
+		std::cout << "[Registre mesh] Geometrie partagee : " << key << std::endl;
+#endif // !NDEBUG
+
+	return geometry;
+}
+
+void MeshRegistry::addGeometry(std::string key, std::shared_ptr<MeshGeometry> geometry)
+{
+	m_geometries[key] = geometry;
+}
+
+std::shared_ptr<MeshVertexBuffer> MeshRegistry::findVertexBuffer(std::string key)
+{
+	auto it = m_vertexBuffers.find(key);
+	if (it == m_vertexBuffers.end())
+		return nullptr;
+
+	std::shared_ptr<MeshVertexBuffer> vertexBuffer = it->second.lock();
+	if (!vertexBuffer)
+		m_vertexBuffers.erase(it);
+
+	return vertexBuffer;
+}
+
+void MeshRegistry::addVertexBuffer(std::string key, std::shared_ptr<MeshVertexBuffer> vertexBuffer)
+{
+	m_vertexBuffers[key] = vertexBuffer;
+}
+
+void MeshRegistry::clear()
+{
+	m_geometries.clear();
+	m_vertexBuffers.clear();
+}
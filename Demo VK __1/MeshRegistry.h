@@ -0,0 +1,26 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "Mesh.h"
+
+// Partage les buffers des meshes charges plusieurs fois depuis le meme fichier.
+// Les entrees ne gardent pas les ressources en vie : elles sont detruites avec le dernier MeshPBR qui les utilise
+class MeshRegistry
+{
+public:
+	static std::string geometryKey(std::string path, bool optimize);
+
+	std::shared_ptr<MeshGeometry> findGeometry(std::string key);
+	void addGeometry(std::string key, std::shared_ptr<MeshGeometry> geometry);
+	std::shared_ptr<MeshVertexBuffer> findVertexBuffer(std::string key);
+	void addVertexBuffer(std::string key, std::shared_ptr<MeshVertexBuffer> vertexBuffer);
+
+	void clear();
+
+private:
+	std::map<std::string, std::weak_ptr<MeshGeometry>> m_geometries;
+	std::map<std::string, std::weak_ptr<MeshVertexBuffer>> m_vertexBuffers;
+};
@@ -1,25 +1,25 @@
 #include "Pipeline.h"
 
+#include <chrono>
+
 void Pipeline::initialize(Vulkan* vk, VkDescriptorSetLayout* descriptorSetLayout, VkRenderPass renderPass, 
 	std::string vertPath, std::string fragPath, bool alphaBlending, VkSampleCountFlagBits msaaSamples, std::vector<VkVertexInputBindingDescription> vertexInputDescription,
-	std::vector<VkVertexInputAttributeDescription> attributeInputDescription, VkExtent2D extent)
+	std::vector<VkVertexInputAttributeDescription> attributeInputDescription)
 {
-	auto vertShaderCode = readFile(vertPath);
-	auto fragShaderCode = readFile(fragPath);
-
-	VkShaderModule vertShaderModule = createShaderModule(vertShaderCode, vk->getDevice());
-	VkShaderModule fragShaderModule = createShaderModule(fragShaderCode, vk->getDevice());
+	// Rendus au cache en sortie, y compris sur exception : sinon invalidate ne pourrait plus les recharger
+	ShaderModuleCache::Reference vertShaderModule(vk->getShaderModuleCache(), vk->getDevice(), vertPath);
+	ShaderModuleCache::Reference fragShaderModule(vk->getShaderModuleCache(), vk->getDevice(), fragPath);
 
 	VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
 	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertShaderStageInfo.module = vertShaderModule;
+	vertShaderStageInfo.module = vertShaderModule.get();
 	vertShaderStageInfo.pName = "main";
 
 	VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
 	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragShaderStageInfo.module = fragShaderModule;
+	fragShaderStageInfo.module = fragShaderModule.get();
 	fragShaderStageInfo.pName = "main";
 
 	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
@@ -37,24 +37,17 @@ void Pipeline::initialize(Vulkan* vk, VkDescriptorSetLayout* descriptorSetLayout
 	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
 	inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-	VkViewport viewport = {};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)extent.width;
-	viewport.height = (float)extent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	VkRect2D scissor = {};
-	scissor.offset = { 0, 0 };
-	scissor.extent = extent;
-
+	// Un meme pipeline sert pour toutes les tailles de cible
 	VkPipelineViewportStateCreateInfo viewportState = {};
 	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
 	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
+
+	std::array<VkDynamicState, 2> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState = {};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+	dynamicState.pDynamicStates = dynamicStates.data();
 
 	VkPipelineRasterizationStateCreateInfo rasterizer = {};
 	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -121,6 +114,7 @@ void Pipeline::initialize(Vulkan* vk, VkDescriptorSetLayout* descriptorSetLayout
 	pipelineInfo.pRasterizationState = &rasterizer;
 	pipelineInfo.pMultisampleState = &multisampling;
 	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
 	pipelineInfo.layout = m_pipelineLayout;
 	pipelineInfo.renderPass = renderPass;
 	pipelineInfo.subpass = 0;
@@ -135,41 +129,49 @@ void Pipeline::initialize(Vulkan* vk, VkDescriptorSetLayout* descriptorSetLayout
 	depthStencil.stencilTestEnable = VK_FALSE;
 	pipelineInfo.pDepthStencilState = &depthStencil;
 
-	if (vkCreateGraphicsPipelines(vk->getDevice(), VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_graphicsPipeline) != VK_SUCCESS)
+	auto startTime = std::chrono::high_resolution_clock::now();
+	if (vkCreateGraphicsPipelines(vk->getDevice(), vk->getPipelineCache()->getPipelineCache(), 1, &pipelineInfo, nullptr, &m_graphicsPipeline) != VK_SUCCESS)
+	{
+		// SPIR-V refuse au rechargement : rien ne doit rester derriere l'ancien pipeline conserve
+		vkDestroyPipelineLayout(vk->getDevice(), m_pipelineLayout, nullptr);
+		m_pipelineLayout = VK_NULL_HANDLE;
 		throw std::runtime_error("Erreur : graphic pipeline");
-
-	vkDestroyShaderModule(vk->getDevice(), fragShaderModule, nullptr);
-	vkDestroyShaderModule(vk->getDevice(), vertShaderModule, nullptr);
+	}
+	vk->getPipelineCache()->addPipelineCreation(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count());
 }
 
-std::vector<char> Pipeline::readFile(const std::string & filename)
+void Pipeline::initializeCompute(Vulkan* vk, VkDescriptorSetLayout* descriptorSetLayout, std::string compPath, std::vector<VkPushConstantRange> pushConstantRanges)
 {
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-	if (!file.is_open())
-		throw std::runtime_error("Erreur lors de l'ouverture du fichier : " + filename);
+	ShaderModuleCache::Reference compShaderModule(vk->getShaderModuleCache(), vk->getDevice(), compPath);
 
-	size_t fileSize = (size_t)file.tellg();
-	std::vector<char> buffer(fileSize);
+	VkPipelineShaderStageCreateInfo compShaderStageInfo = {};
+	compShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	compShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	compShaderStageInfo.module = compShaderModule.get();
+	compShaderStageInfo.pName = "main";
 
-	file.seekg(0);
-	file.read(buffer.data(), fileSize);
-
-	file.close();
-
-	return buffer;
-}
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = descriptorSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = static_cast<uint32_t>(pushConstantRanges.size());
+	pipelineLayoutInfo.pPushConstantRanges = pushConstantRanges.data();
 
-VkShaderModule Pipeline::createShaderModule(const std::vector<char>& code, VkDevice device)
-{
-	VkShaderModuleCreateInfo createInfo = {};
-	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = code.size();
-	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+	if (vkCreatePipelineLayout(vk->getDevice(), &pipelineLayoutInfo, nullptr, &m_pipelineLayout) != VK_SUCCESS)
+		throw std::runtime_error("Erreur : pipeline layout");
 
-	VkShaderModule shaderModule;
-	if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
-		throw std::runtime_error("Erreur : shader module");
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = compShaderStageInfo;
+	pipelineInfo.layout = m_pipelineLayout;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-	return shaderModule;
+	auto startTime = std::chrono::high_resolution_clock::now();
+	if (vkCreateComputePipelines(vk->getDevice(), vk->getPipelineCache()->getPipelineCache(), 1, &pipelineInfo, nullptr, &m_computePipeline) != VK_SUCCESS)
+	{
+		vkDestroyPipelineLayout(vk->getDevice(), m_pipelineLayout, nullptr);
+		m_pipelineLayout = VK_NULL_HANDLE;
+		throw std::runtime_error("Erreur : compute pipeline");
+	}
+	vk->getPipelineCache()->addPipelineCreation(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count());
 }
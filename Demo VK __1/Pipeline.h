@@ -10,6 +10,7 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/hash.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include "Vulkan.h"
 
@@ -73,6 +74,66 @@ struct ModelInstance
 	}
 };
 
+// Format d'instance compact : 56 octets au lieu de 88, 5 attributs au lieu de 7
+struct CompactInstance
+{
+	std::array<glm::vec4, 3> transform; // lignes de la transformation affine 3x4
+	uint32_t albedo; // RGBA8 unorm
+	uint32_t roughnessMetallic; // 2 x unorm16
+
+	static CompactInstance pack(glm::mat4 model, glm::vec3 albedo, float roughness, float metallic)
+	{
+		CompactInstance instance;
+		for (int i(0); i < 3; ++i)
+			instance.transform[i] = glm::vec4(model[0][i], model[1][i], model[2][i], model[3][i]);
+		instance.albedo = glm::packUnorm4x8(glm::vec4(albedo, 1.0f));
+		instance.roughnessMetallic = glm::packUnorm2x16(glm::vec2(roughness, metallic));
+
+		return instance;
+	}
+
+	static VkVertexInputBindingDescription getBindingDescription(uint32_t binding)
+	{
+		VkVertexInputBindingDescription bindingDescription = {};
+		bindingDescription.binding = binding;
+		bindingDescription.stride = sizeof(CompactInstance);
+		bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+		return bindingDescription;
+	}
+
+	static std::vector<VkVertexInputAttributeDescription> getAttributeDescriptions(uint32_t binding, uint32_t startLocation)
+	{
+		std::vector<VkVertexInputAttributeDescription> attributeDescriptions(5);
+
+		for (uint32_t i(0); i < 3; ++i)
+		{
+			attributeDescriptions[i].binding = binding;
+			attributeDescriptions[i].location = startLocation + i;
+			attributeDescriptions[i].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+			attributeDescriptions[i].offset = offsetof(CompactInstance, transform) + i * sizeof(glm::vec4);
+		}
+
+		attributeDescriptions[3].binding = binding;
+		attributeDescriptions[3].location = startLocation + 3;
+		attributeDescriptions[3].format = VK_FORMAT_R8G8B8A8_UNORM;
+		attributeDescriptions[3].offset = offsetof(CompactInstance, albedo);
+
+		attributeDescriptions[4].binding = binding;
+		attributeDescriptions[4].location = startLocation + 4;
+		attributeDescriptions[4].format = VK_FORMAT_R16G16_UNORM;
+		attributeDescriptions[4].offset = offsetof(CompactInstance, roughnessMetallic);
+
+		return attributeDescriptions;
+	}
+};
+
+enum InstanceLayout
+{
+	INSTANCE_LAYOUT_MODEL = 0, // ModelInstance
+	INSTANCE_LAYOUT_COMPACT = 1 // CompactInstance
+};
+
 struct Vertex
 {
 	glm::vec3 pos;
@@ -186,19 +247,23 @@ namespace std
 class Pipeline
 {
 public:
+	Pipeline() {}
+	// Pipeline deja cree, par exemple par la bibliotheque de pipelines
+	Pipeline(VkPipelineLayout pipelineLayout, VkPipeline graphicsPipeline) : m_pipelineLayout(pipelineLayout), m_graphicsPipeline(graphicsPipeline) {}
+
+	// Viewport et scissor dynamiques : a fixer a l'enregistrement
 	void initialize(Vulkan* vk, VkDescriptorSetLayout* descriptorSetLayout, VkRenderPass renderPass, std::string vertPath, 
 		std::string fragPath, bool alphaBlending, VkSampleCountFlagBits msaaSamples, std::vector<VkVertexInputBindingDescription> vertexInputDescription,
-		std::vector<VkVertexInputAttributeDescription> attributeInputDescription, VkExtent2D extent);
-
-private:
-	static std::vector<char> readFile(const std::string& filename);
-	VkShaderModule createShaderModule(const std::vector<char>& code, VkDevice device);
+		std::vector<VkVertexInputAttributeDescription> attributeInputDescription);
+	void initializeCompute(Vulkan* vk, VkDescriptorSetLayout* descriptorSetLayout, std::string compPath, std::vector<VkPushConstantRange> pushConstantRanges);
 
 public:
 	VkPipeline GetGraphicsPipeline() { return m_graphicsPipeline; }
+	VkPipeline GetComputePipeline() { return m_computePipeline; }
 	VkPipelineLayout GetPipelineLayout() { return m_pipelineLayout; }
 
 private:
-	VkPipelineLayout m_pipelineLayout;
-	VkPipeline m_graphicsPipeline;
+	VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+	VkPipeline m_graphicsPipeline = VK_NULL_HANDLE;
+	VkPipeline m_computePipeline = VK_NULL_HANDLE;
 };
\ No newline at end of file
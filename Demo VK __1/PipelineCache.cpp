@@ -0,0 +1,213 @@
+#include "PipelineCache.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+const uint32_t PIPELINE_CACHE_MAGIC = 0x48435050; // "PPCH"
+const uint32_t PIPELINE_CACHE_VERSION = 1;
+const std::string PIPELINE_CACHE_DIRECTORY = "Demo VK";
+
+struct PipelineCacheFileHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+	uint64_t dataSize;
+};
+
+// Vide si la variable n'existe pas
+static std::string getEnvironmentVariable(const char* name)
+{
+#ifdef _WIN32
+	char* value = nullptr;
+	size_t length = 0;
+	if (_dupenv_s(&value, &length, name) != 0 || value == nullptr)
+		return std::string();
+	std::string result(value);
+	free(value);
+	return result;
+#else
+	const char* value = std::getenv(name);
+	return value != nullptr ? std::string(value) : std::string();
+#endif
+}
+
+static void createDirectory(const std::string& path)
+{
+#ifdef _WIN32
+	_mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+std::string PipelineCache::getUserCachePath(std::string fileName)
+{
+	// Le dossier de l'application peut etre en lecture seule ou partage entre utilisateurs
+#ifdef _WIN32
+	std::string directory = getEnvironmentVariable("LOCALAPPDATA");
+#else
+	std::string directory = getEnvironmentVariable("XDG_CACHE_HOME");
+	std::string home = getEnvironmentVariable("HOME");
+	if (directory.empty() && !home.empty())
+	{
+		directory = home + "/.cache";
+		createDirectory(directory);
+	}
+#endif
+	if (directory.empty())
+		return fileName;
+
+	directory += "/" + PIPELINE_CACHE_DIRECTORY;
+	createDirectory(directory);
+
+	return directory + "/" + fileName;
+}
+
+void PipelineCache::initialize(VkPhysicalDevice physicalDevice, VkDevice device, std::string path)
+{
+	m_path = path;
+	vkGetPhysicalDeviceProperties(physicalDevice, &m_properties);
+
+	std::vector<char> data = load();
+	m_warm = !data.empty();
+
+	VkPipelineCacheCreateInfo createInfo = {};
+	createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	createInfo.initialDataSize = data.size();
+	createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+	if (vkCreatePipelineCache(device, &createInfo, nullptr, &m_pipelineCache) != VK_SUCCESS)
+	{
+		// Donnees refusees par le pilote : on repart d'un cache vide
+		createInfo.initialDataSize = 0;
+		createInfo.pInitialData = nullptr;
+		m_warm = false;
+		if (vkCreatePipelineCache(device, &createInfo, nullptr, &m_pipelineCache) != VK_SUCCESS)
+			throw std::runtime_error("Erreur : creation du pipeline cache");
+	}
+}
+
+void PipelineCache::cleanup(VkDevice device)
+{
+	if (m_pipelineCache == VK_NULL_HANDLE)
+		return;
+
+#ifndef NDEBUG
+	if (m_statistics.nbPipelines > 0)
+		std::cout << "[Pipelines] " << m_statistics.nbPipelines << " pipelines crees en " << m_statistics.creationTime << " ms (cache "
+			<< (m_warm ? "chaud" : "froid") << ")" << std::endl;
+#endif
+	save(device);
+
+	vkDestroyPipelineCache(device, m_pipelineCache, nullptr);
+	m_pipelineCache = VK_NULL_HANDLE;
+}
+
+void PipelineCache::addPipelineCreation(double creationTime)
+{
+	std::lock_guard<std::mutex> lock(m_statisticsMutex);
+	m_statistics.nbPipelines++;
+	m_statistics.creationTime += creationTime;
+}
+
+std::vector<char> PipelineCache::load()
+{
+	std::vector<char> data;
+	std::ifstream file(m_path, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+		return data;
+
+	std::streamoff fileSize = file.tellg();
+	file.seekg(0, std::ios::beg);
+	if (fileSize < static_cast<std::streamoff>(sizeof(PipelineCacheFileHeader)))
+		return data;
+
+	PipelineCacheFileHeader header;
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return data;
+
+	// Fichier tronque ou corrompu : pas d'allocation au-dela de ce que contient le fichier
+	if (header.dataSize > static_cast<uint64_t>(fileSize) - sizeof(header))
+		return data;
+
+	// Un autre GPU ou un autre pilote : les pipelines seront recompiles
+	if (header.magic != PIPELINE_CACHE_MAGIC || header.version != PIPELINE_CACHE_VERSION || header.vendorID != m_properties.vendorID ||
+		header.deviceID != m_properties.deviceID || header.driverVersion != m_properties.driverVersion ||
+		memcmp(header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		return data;
+
+	data.resize(static_cast<size_t>(header.dataSize));
+	if (!file.read(data.data(), data.size()))
+	{
+		data.clear();
+		return data;
+	}
+
+	// En-tete de Vulkan (VkPipelineCacheHeaderVersionOne) : taille, version, vendor, device, UUID
+	uint32_t vulkanHeader[4];
+	if (data.size() < sizeof(vulkanHeader) + VK_UUID_SIZE)
+	{
+		data.clear();
+		return data;
+	}
+	memcpy(vulkanHeader, data.data(), sizeof(vulkanHeader));
+	if (vulkanHeader[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || vulkanHeader[2] != m_properties.vendorID || vulkanHeader[3] != m_properties.deviceID ||
+		memcmp(data.data() + sizeof(vulkanHeader), m_properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+		data.clear();
+
+	return data;
+}
+
+void PipelineCache::save(VkDevice device)
+{
+	size_t dataSize = 0;
+	if (vkGetPipelineCacheData(device, m_pipelineCache, &dataSize, nullptr) != VK_SUCCESS || dataSize == 0)
+		return;
+	std::vector<char> data(dataSize);
+	if (vkGetPipelineCacheData(device, m_pipelineCache, &dataSize, data.data()) != VK_SUCCESS)
+		return;
+
+	// Ecrit a cote puis renomme : une fermeture interrompue ne laisse pas de fichier a moitie ecrit
+	std::string temporaryPath = m_path + ".tmp";
+	std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return;
+
+	PipelineCacheFileHeader header = {};
+	header.magic = PIPELINE_CACHE_MAGIC;
+	header.version = PIPELINE_CACHE_VERSION;
+	header.vendorID = m_properties.vendorID;
+	header.deviceID = m_properties.deviceID;
+	header.driverVersion = m_properties.driverVersion;
+	memcpy(header.pipelineCacheUUID, m_properties.pipelineCacheUUID, VK_UUID_SIZE);
+	header.dataSize = dataSize;
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(data.data(), dataSize);
+	file.close();
+	if (file.fail())
+	{
+		std::remove(temporaryPath.c_str());
+		return;
+	}
+
+	// rename ne remplace pas un fichier existant sous Windows
+	if (std::rename(temporaryPath.c_str(), m_path.c_str()) != 0)
+	{
+		std::remove(m_path.c_str());
+		if (std::rename(temporaryPath.c_str(), m_path.c_str()) != 0)
+			std::remove(temporaryPath.c_str());
+	}
+}
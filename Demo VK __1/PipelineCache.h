@@ -0,0 +1,45 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <vector>
+#include <mutex>
+
+// VkPipelineCache partage par tous les pipelines, relu du disque au demarrage et reecrit a la fermeture.
+// Les donnees ne sont reprises que pour le meme GPU (UUID) et la meme version du pilote, et si le fichier est complet
+class PipelineCache
+{
+public:
+	struct Statistics
+	{
+		uint32_t nbPipelines = 0;
+		double creationTime = 0.0; // ms
+	};
+
+	// %LOCALAPPDATA%/Demo VK, $XDG_CACHE_HOME/Demo VK ou ~/.cache/Demo VK, cree si besoin. Dossier courant a defaut
+	static std::string getUserCachePath(std::string fileName);
+
+	void initialize(VkPhysicalDevice physicalDevice, VkDevice device, std::string path);
+	void cleanup(VkDevice device);
+
+	VkPipelineCache getPipelineCache() { return m_pipelineCache; }
+	// Temps de vkCreate*Pipelines, pour comparer cache froid et cache chaud
+	void addPipelineCreation(double creationTime);
+	Statistics getStatistics() { return m_statistics; }
+	bool isWarm() { return m_warm; }
+
+private:
+	std::vector<char> load();
+	void save(VkDevice device);
+
+private:
+	VkPipelineCache m_pipelineCache = VK_NULL_HANDLE;
+	std::string m_path;
+	VkPhysicalDeviceProperties m_properties;
+	bool m_warm = false; // donnees relues depuis le disque
+
+	std::mutex m_statisticsMutex;
+	Statistics m_statistics;
+};
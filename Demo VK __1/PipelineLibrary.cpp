@@ -0,0 +1,264 @@
+#include "PipelineLibrary.h"
+
+#include <chrono>
+#include <memory>
+
+#include "Pipeline.h"
+
+void PipelineLibrary::initialize(int nbThreads)
+{
+	m_compileThreadPool.initialize(nbThreads);
+}
+
+void PipelineLibrary::cleanup(VkDevice device)
+{
+	waitPreparedPipelines();
+
+#ifndef NDEBUG
+	if (m_statistics.nbMisses > 0)
+	{
+		std::cout << "[Pipelines] " << m_statistics.nbHits + m_statistics.nbMisses << " demandes, " << m_statistics.nbMisses << " pipelines crees en "
+			<< m_statistics.creationTime << " ms, " << m_statistics.nbHits << " reutilises (~" << m_statistics.creationTime / m_statistics.nbMisses * m_statistics.nbHits
+			<< " ms evitees)" << std::endl;
+		std::cout << "[Pipelines] " << m_statistics.nbPrepared << " compiles sur " << m_compileThreadPool.getNbThreads() << " threads, " << m_statistics.waitTime
+			<< " ms d'attente" << std::endl;
+	}
+	if (m_statistics.nbReloaded > 0)
+		std::cout << "[Pipelines] " << m_statistics.nbReloaded << " recrees apres modification des shaders" << std::endl;
+#endif
+	m_compileThreadPool.cleanup();
+	m_preparedPipelines.clear();
+	m_unclaimedPipelines.clear();
+
+	for (auto it = m_pipelines.begin(); it != m_pipelines.end(); ++it)
+	{
+		vkDestroyPipeline(device, it->second.second, nullptr);
+		vkDestroyPipelineLayout(device, it->second.first, nullptr);
+	}
+	m_pipelines.clear();
+	m_descriptions.clear();
+	for (auto it = m_descriptorSetLayouts.begin(); it != m_descriptorSetLayouts.end(); ++it)
+		vkDestroyDescriptorSetLayout(device, it->second, nullptr);
+	m_descriptorSetLayouts.clear();
+}
+
+VkDescriptorSetLayout PipelineLibrary::getDescriptorSetLayout(VkDevice device, std::vector<VkDescriptorSetLayoutBinding> bindings)
+{
+	std::vector<uint64_t> key;
+	for (int i(0); i < bindings.size(); ++i)
+	{
+		key.push_back(bindings[i].binding);
+		key.push_back(bindings[i].descriptorType);
+		key.push_back(bindings[i].descriptorCount);
+		key.push_back(bindings[i].stageFlags);
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto cached = m_descriptorSetLayouts.find(key);
+	if (cached != m_descriptorSetLayouts.end())
+		return cached->second;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	VkDescriptorSetLayout descriptorSetLayout;
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
+		throw std::runtime_error("Erreur : descriptor set layout");
+
+	m_descriptorSetLayouts[key] = descriptorSetLayout;
+
+	return descriptorSetLayout;
+}
+
+Pipeline PipelineLibrary::getGraphicsPipeline(Vulkan* vk, VkDescriptorSetLayout descriptorSetLayout, VkRenderPass renderPass, std::vector<uint64_t> renderPassCompatibility,
+	std::string vertPath, std::string fragPath, bool alphaBlending, VkSampleCountFlagBits msaaSamples, std::vector<VkVertexInputBindingDescription> vertexInputDescription,
+	std::vector<VkVertexInputAttributeDescription> attributeInputDescription)
+{
+	std::vector<uint64_t> key = getPipelineKey(descriptorSetLayout, renderPassCompatibility, vertPath, fragPath, alphaBlending, msaaSamples, vertexInputDescription,
+		attributeInputDescription);
+
+	std::shared_future<PipelineHandles> prepared;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto cached = m_pipelines.find(key);
+		if (cached != m_pipelines.end())
+		{
+			// Premiere demande d'un pipeline declare deja compile : pas une reutilisation
+			if (m_unclaimedPipelines.erase(key) == 0)
+				m_statistics.nbHits++;
+			return Pipeline(cached->second.first, cached->second.second);
+		}
+
+		auto preparedPipeline = m_preparedPipelines.find(key);
+		if (preparedPipeline != m_preparedPipelines.end())
+			prepared = preparedPipeline->second;
+	}
+
+	if (prepared.valid())
+	{
+		// Declare mais peut-etre pas encore lance
+		compilePreparedPipelines();
+
+		auto startTime = std::chrono::high_resolution_clock::now();
+		PipelineHandles handles = prepared.get(); // relance l'exception de la compilation
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_unclaimedPipelines.erase(key);
+		m_statistics.waitTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+		return Pipeline(handles.first, handles.second);
+	}
+
+	PipelineHandles handles = createGraphicsPipeline(vk, key, renderPass, { descriptorSetLayout, renderPassCompatibility, vertPath, fragPath, alphaBlending, msaaSamples,
+		vertexInputDescription, attributeInputDescription });
+
+	return Pipeline(handles.first, handles.second);
+}
+
+void PipelineLibrary::prepareGraphicsPipeline(Vulkan* vk, VkDescriptorSetLayout descriptorSetLayout, VkRenderPass renderPass, std::vector<uint64_t> renderPassCompatibility,
+	std::string vertPath, std::string fragPath, bool alphaBlending, VkSampleCountFlagBits msaaSamples, std::vector<VkVertexInputBindingDescription> vertexInputDescription,
+	std::vector<VkVertexInputAttributeDescription> attributeInputDescription)
+{
+	std::vector<uint64_t> key = getPipelineKey(descriptorSetLayout, renderPassCompatibility, vertPath, fragPath, alphaBlending, msaaSamples, vertexInputDescription,
+		attributeInputDescription);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_pipelines.find(key) != m_pipelines.end() || m_preparedPipelines.find(key) != m_preparedPipelines.end())
+		return;
+
+	std::shared_ptr<std::promise<PipelineHandles>> promise = std::make_shared<std::promise<PipelineHandles>>();
+	m_preparedPipelines[key] = promise->get_future().share();
+	m_unclaimedPipelines.insert(key);
+	m_queuedCompilations.push_back([=]()
+	{
+		try
+		{
+			promise->set_value(createGraphicsPipeline(vk, key, renderPass, { descriptorSetLayout, renderPassCompatibility, vertPath, fragPath, alphaBlending, msaaSamples,
+				vertexInputDescription, attributeInputDescription }));
+		}
+		catch (...)
+		{
+			promise->set_exception(std::current_exception());
+		}
+	});
+}
+
+void PipelineLibrary::compilePreparedPipelines()
+{
+	// Lance sans attendre les lots precedents : chaque lot garde ses compilations, un pipeline demande n'attend que sa propre future
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::shared_ptr<std::vector<std::function<void()>>> compilations = std::make_shared<std::vector<std::function<void()>>>();
+	compilations->swap(m_queuedCompilations);
+	m_statistics.nbPrepared += static_cast<uint32_t>(compilations->size());
+	m_compileThreadPool.runAsync(compilations->size(), [compilations](size_t i, int threadID) { (*compilations)[i](); });
+}
+
+void PipelineLibrary::waitPreparedPipelines()
+{
+	compilePreparedPipelines();
+	m_compileThreadPool.wait();
+}
+
+std::map<VkPipeline, Pipeline> PipelineLibrary::reloadShaders(Vulkan* vk, std::vector<std::string> shaderPaths, VkRenderPass renderPass,
+	std::vector<uint64_t> renderPassCompatibility)
+{
+	waitPreparedPipelines();
+
+	std::set<std::string> changedShaders(shaderPaths.begin(), shaderPaths.end());
+	std::map<VkPipeline, Pipeline> reloadedPipelines;
+	std::vector<std::vector<uint64_t>> reloadedKeys;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto it = m_descriptions.begin(); it != m_descriptions.end(); ++it)
+	{
+		GraphicsPipelineDescription& description = it->second;
+		if (description.renderPassCompatibility != renderPassCompatibility ||
+			(changedShaders.count(description.vertPath) == 0 && changedShaders.count(description.fragPath) == 0))
+			continue;
+
+		Pipeline pipeline;
+		try
+		{
+			pipeline.initialize(vk, &description.descriptorSetLayout, renderPass, description.vertPath, description.fragPath, description.alphaBlending,
+				description.msaaSamples, description.vertexInputDescription, description.attributeInputDescription);
+		}
+		catch (const std::exception& e)
+		{
+			// SPIR-V refuse par le pilote : l'ancien pipeline reste utilise
+			std::cout << "[Pipelines] " << e.what() << std::endl;
+			continue;
+		}
+
+		reloadedPipelines[m_pipelines[it->first].second] = pipeline;
+		reloadedKeys.push_back(it->first);
+	}
+
+	if (reloadedKeys.empty())
+		return reloadedPipelines;
+
+	for (int i(0); i < reloadedKeys.size(); ++i)
+	{
+		PipelineHandles& handles = m_pipelines[reloadedKeys[i]];
+		Pipeline& pipeline = reloadedPipelines[handles.second];
+
+		// Les frames en vol peuvent encore utiliser l'ancien pipeline
+		VkDevice device = vk->getDevice();
+		PipelineHandles oldHandles = handles;
+		vk->deferDestroy([device, oldHandles]()
+		{
+			vkDestroyPipeline(device, oldHandles.second, nullptr);
+			vkDestroyPipelineLayout(device, oldHandles.first, nullptr);
+		});
+		handles = { pipeline.GetPipelineLayout(), pipeline.GetGraphicsPipeline() };
+	}
+	m_statistics.nbReloaded += static_cast<uint32_t>(reloadedKeys.size());
+
+	return reloadedPipelines;
+}
+
+std::vector<uint64_t> PipelineLibrary::getPipelineKey(VkDescriptorSetLayout descriptorSetLayout, std::vector<uint64_t> renderPassCompatibility, std::string vertPath,
+	std::string fragPath, bool alphaBlending, VkSampleCountFlagBits msaaSamples, const std::vector<VkVertexInputBindingDescription>& vertexInputDescription,
+	const std::vector<VkVertexInputAttributeDescription>& attributeInputDescription)
+{
+	// Etat complet du pipeline : shaders, entrees de sommets, passe, MSAA, blending et layout
+	std::vector<uint64_t> key = { std::hash<std::string>()(vertPath), std::hash<std::string>()(fragPath), alphaBlending ? 1u : 0u,
+		static_cast<uint64_t>(msaaSamples), (uint64_t)descriptorSetLayout };
+	key.insert(key.end(), renderPassCompatibility.begin(), renderPassCompatibility.end());
+	key.push_back(vertexInputDescription.size());
+	for (int i(0); i < vertexInputDescription.size(); ++i)
+	{
+		key.push_back(vertexInputDescription[i].binding);
+		key.push_back(vertexInputDescription[i].stride);
+		key.push_back(vertexInputDescription[i].inputRate);
+	}
+	key.push_back(attributeInputDescription.size());
+	for (int i(0); i < attributeInputDescription.size(); ++i)
+	{
+		key.push_back(attributeInputDescription[i].location);
+		key.push_back(attributeInputDescription[i].binding);
+		key.push_back(attributeInputDescription[i].format);
+		key.push_back(attributeInputDescription[i].offset);
+	}
+
+	return key;
+}
+
+PipelineLibrary::PipelineHandles PipelineLibrary::createGraphicsPipeline(Vulkan* vk, std::vector<uint64_t> key, VkRenderPass renderPass,
+	GraphicsPipelineDescription description)
+{
+	auto startTime = std::chrono::high_resolution_clock::now();
+	Pipeline pipeline;
+	pipeline.initialize(vk, &description.descriptorSetLayout, renderPass, description.vertPath, description.fragPath, description.alphaBlending, description.msaaSamples,
+		description.vertexInputDescription, description.attributeInputDescription);
+	PipelineHandles handles = { pipeline.GetPipelineLayout(), pipeline.GetGraphicsPipeline() };
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_statistics.nbMisses++;
+	m_statistics.creationTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	m_pipelines[key] = handles;
+	m_descriptions[key] = description;
+	m_preparedPipelines.erase(key);
+
+	return handles;
+}
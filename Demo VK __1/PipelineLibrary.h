@@ -0,0 +1,93 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <mutex>
+#include <future>
+#include <functional>
+
+#include "ThreadPool.h"
+
+class Vulkan;
+class Pipeline;
+
+// Pipelines graphiques et descriptor set layouts partages par toutes les passes : une demande identique
+// renvoie le meme VkPipeline. Viewport et scissor sont dynamiques, la taille de la cible ne compte donc pas.
+// Les pipelines declares a l'avance sont compiles en parallele, getGraphicsPipeline n'attend que celui qu'il demande
+class PipelineLibrary
+{
+public:
+	struct Statistics
+	{
+		uint32_t nbHits = 0;
+		uint32_t nbMisses = 0;
+		uint32_t nbPrepared = 0; // compiles sur les threads de la bibliotheque
+		double creationTime = 0.0; // ms, somme des pipelines effectivement crees
+		double waitTime = 0.0; // ms, attente des pipelines declares par le thread qui les demande
+		uint32_t nbReloaded = 0; // recrees apres la modification d'un shader
+	};
+
+	void initialize(int nbThreads);
+	void cleanup(VkDevice device);
+
+	VkDescriptorSetLayout getDescriptorSetLayout(VkDevice device, std::vector<VkDescriptorSetLayoutBinding> bindings);
+	// renderPassCompatibility : ce qui rend deux render pass compatibles (formats et echantillons des attachments)
+	Pipeline getGraphicsPipeline(Vulkan* vk, VkDescriptorSetLayout descriptorSetLayout, VkRenderPass renderPass, std::vector<uint64_t> renderPassCompatibility,
+		std::string vertPath, std::string fragPath, bool alphaBlending, VkSampleCountFlagBits msaaSamples, std::vector<VkVertexInputBindingDescription> vertexInputDescription,
+		std::vector<VkVertexInputAttributeDescription> attributeInputDescription);
+	// Memes parametres que getGraphicsPipeline, compile au prochain compilePreparedPipelines.
+	// renderPass doit rester valide jusqu'a la fin de la compilation (waitPreparedPipelines)
+	void prepareGraphicsPipeline(Vulkan* vk, VkDescriptorSetLayout descriptorSetLayout, VkRenderPass renderPass, std::vector<uint64_t> renderPassCompatibility,
+		std::string vertPath, std::string fragPath, bool alphaBlending, VkSampleCountFlagBits msaaSamples, std::vector<VkVertexInputBindingDescription> vertexInputDescription,
+		std::vector<VkVertexInputAttributeDescription> attributeInputDescription);
+	// Lance la compilation des pipelines declares sans attendre
+	void compilePreparedPipelines();
+	void waitPreparedPipelines();
+
+	// Recree les pipelines compatibles avec renderPass qui utilisent l'un des .spv. Renvoie le remplacant de chaque ancien
+	// VkPipeline ; les anciens ne doivent plus etre enregistres et sont detruits une fois les frames en vol terminees
+	std::map<VkPipeline, Pipeline> reloadShaders(Vulkan* vk, std::vector<std::string> shaderPaths, VkRenderPass renderPass, std::vector<uint64_t> renderPassCompatibility);
+
+	Statistics getStatistics() { return m_statistics; }
+
+private:
+	typedef std::pair<VkPipelineLayout, VkPipeline> PipelineHandles;
+
+	// Parametres de creation, gardes pour recreer le pipeline quand un de ses shaders change
+	struct GraphicsPipelineDescription
+	{
+		VkDescriptorSetLayout descriptorSetLayout;
+		std::vector<uint64_t> renderPassCompatibility;
+		std::string vertPath;
+		std::string fragPath;
+		bool alphaBlending;
+		VkSampleCountFlagBits msaaSamples;
+		std::vector<VkVertexInputBindingDescription> vertexInputDescription;
+		std::vector<VkVertexInputAttributeDescription> attributeInputDescription;
+	};
+
+	static std::vector<uint64_t> getPipelineKey(VkDescriptorSetLayout descriptorSetLayout, std::vector<uint64_t> renderPassCompatibility, std::string vertPath,
+		std::string fragPath, bool alphaBlending, VkSampleCountFlagBits msaaSamples, const std::vector<VkVertexInputBindingDescription>& vertexInputDescription,
+		const std::vector<VkVertexInputAttributeDescription>& attributeInputDescription);
+	// Cree le pipeline et l'ajoute a la bibliotheque, depuis n'importe quel thread
+	PipelineHandles createGraphicsPipeline(Vulkan* vk, std::vector<uint64_t> key, VkRenderPass renderPass, GraphicsPipelineDescription description);
+
+private:
+	std::mutex m_mutex; // bibliotheque, pipelines declares et statistiques
+	std::map<std::vector<uint64_t>, VkDescriptorSetLayout> m_descriptorSetLayouts;
+	std::map<std::vector<uint64_t>, PipelineHandles> m_pipelines;
+	std::map<std::vector<uint64_t>, GraphicsPipelineDescription> m_descriptions;
+	std::map<std::vector<uint64_t>, std::shared_future<PipelineHandles>> m_preparedPipelines; // pas encore dans m_pipelines
+	std::set<std::vector<uint64_t>> m_unclaimedPipelines; // declares, jamais demandes
+
+	ThreadPool m_compileThreadPool;
+	std::vector<std::function<void()>> m_queuedCompilations; // declares, pas encore lances
+
+	Statistics m_statistics;
+};
@@ -0,0 +1,63 @@
+#include "RangeAllocator.h"
+
+#include <iterator>
+
+void RangeAllocator::initialize(VkDeviceSize capacity)
+{
+	m_capacity = capacity;
+	m_used = 0;
+	m_freeBlocks.clear();
+	m_freeBlocks[0] = capacity;
+}
+
+bool RangeAllocator::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+{
+	// Premier bloc libre assez grand une fois l'offset aligne
+	for (auto it = m_freeBlocks.begin(); it != m_freeBlocks.end(); ++it)
+	{
+		VkDeviceSize blockOffset = it->first;
+		VkDeviceSize blockEnd = it->first + it->second;
+		VkDeviceSize alignedOffset = (blockOffset + alignment - 1) / alignment * alignment;
+		if (alignedOffset + size > blockEnd)
+			continue;
+
+		m_freeBlocks.erase(it);
+		if (alignedOffset > blockOffset)
+			m_freeBlocks[blockOffset] = alignedOffset - blockOffset;
+		if (alignedOffset + size < blockEnd)
+			m_freeBlocks[alignedOffset + size] = blockEnd - alignedOffset - size;
+
+		m_used += size;
+		offset = alignedOffset;
+		return true;
+	}
+
+	return false;
+}
+
+void RangeAllocator::free(VkDeviceSize offset, VkDeviceSize size)
+{
+	if (size == 0)
+		return;
+
+	m_used -= size;
+
+	// Fusion avec les blocs libres voisins
+	auto next = m_freeBlocks.lower_bound(offset);
+	if (next != m_freeBlocks.end() && offset + size == next->first)
+	{
+		size += next->second;
+		next = m_freeBlocks.erase(next);
+	}
+	if (next != m_freeBlocks.begin())
+	{
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset)
+		{
+			previous->second += size;
+			return;
+		}
+	}
+
+	m_freeBlocks[offset] = size;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <map>
+
+// Sous-allocation first-fit de plages dans un buffer, avec fusion des plages libres voisines.
+// Tant que rien n'est libere, les plages se suivent comme avec un simple pointeur qui avance
+class RangeAllocator
+{
+public:
+	void initialize(VkDeviceSize capacity);
+
+	bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+	void free(VkDeviceSize offset, VkDeviceSize size);
+
+	VkDeviceSize getCapacity() { return m_capacity; }
+	VkDeviceSize getUsed() { return m_used; }
+
+private:
+	VkDeviceSize m_capacity = 0;
+	VkDeviceSize m_used = 0;
+	std::map<VkDeviceSize, VkDeviceSize> m_freeBlocks; // offset -> taille
+};
@@ -27,111 +27,267 @@ void RenderPass::initialize(Vulkan* vk, bool createFrameBuffer, VkExtent2D exten
 	if (createFrameBuffer)
 	{
 		m_frameBuffers.resize(nbFramebuffer);
-		m_commandBuffer.resize(nbFramebuffer);
+		m_commandBuffer.resize(MAX_FRAMES_IN_FLIGHT * nbFramebuffer);
 		for(int i(0); i < nbFramebuffer; ++i)
 			m_frameBuffers[i] = vk->createFrameBuffer(extent, m_renderPass, m_msaaSamples, m_colorImageView);
 	}
 	else
 		vk->createSwapchainFramebuffers(m_renderPass, m_msaaSamples, m_colorImageView);
 
-	m_textDescriptorSetLayout = createDescriptorSetLayout(vk->getDevice(), std::vector<UboBase*>(), 1);
-	m_textPipeline.initialize(vk, &m_textDescriptorSetLayout, m_renderPass, "Shaders/TextVert.spv", 
-		"Shaders/TextFrag.spv", true, m_msaaSamples, { TextVertex::getBindingDescription() }, TextVertex::getAttributeDescriptions(), vk->getSwapChainExtend());
+	// Compile en parallele, attendu par addText seulement
+	m_textDescriptorSetLayout = createDescriptorSetLayout(vk, std::vector<UboBase*>(), 1);
+	vk->getPipelineLibrary()->prepareGraphicsPipeline(vk, m_textDescriptorSetLayout, m_renderPass, getRenderPassCompatibility(), "Shaders/TextVert.spv",
+		"Shaders/TextFrag.spv", true, m_msaaSamples, { TextVertex::getBindingDescription() }, TextVertex::getAttributeDescriptions());
+	vk->getPipelineLibrary()->compilePreparedPipelines();
 
 	m_useSwapChain = !createFrameBuffer;
 	VkSemaphoreCreateInfo semaphoreInfo = {};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 	if (vkCreateSemaphore(vk->getDevice(), &semaphoreInfo, nullptr, &m_renderCompleteSemaphore) != VK_SUCCESS)
-		throw std::runtime_error("Erreur : cration de la smaphores");
+		throw std::runtime_error("Erreur : création de la sémaphores");
 
 	vk->setRenderFinishedLastRenderPassSemaphore(m_renderCompleteSemaphore);
 
 	m_commandPool = vk->createCommandPool();
 }
 
-int RenderPass::addMesh(Vulkan * vk, std::vector<MeshRender> meshes, std::string vertPath, std::string fragPath, int nbTexture, int frameBufferID)
+int RenderPass::addMesh(Vulkan * vk, std::vector<MeshRender> meshes, std::string vertPath, std::string fragPath, int nbTexture, int frameBufferID,
+	RenderLayer layer)
 {
-	/* Ici tous les meshes sont rendus avec les mmes shaders */
+	/* Ici tous les meshes sont rendus avec les mêmes shaders */
 	for (int i(0); i < meshes.size(); ++i)
 	{
 		m_meshes.push_back(meshes[i]);
 	}
+
+	// Un buffer d'instances genere par groupe de meshes identiques, rendus par la variante instanciee du vertex shader
+	int instancedPipelineID = -1;
+	std::vector<std::vector<int>> instancingGroups = findInstancingGroups(vk, meshes, vertPath, nbTexture);
+	if (!instancingGroups.empty())
+	{
+		std::vector<bool> merged(meshes.size(), false);
+		std::vector<MeshRender> instancedMeshes;
+		for (int g(0); g < instancingGroups.size(); ++g)
+		{
+			const std::vector<int>& group = instancingGroups[g];
+			std::vector<ModelInstance> perInstance(group.size());
+			std::vector<glm::mat4> models(group.size());
+			for (int j(0); j < group.size(); ++j)
+			{
+				models[j] = meshes[group[j]].mesh->getModelMatrix();
+				perInstance[j].model = models[j];
+				merged[group[j]] = true;
+
+				// La couleur de l'UBO remplace passe dans l'albedo de l'instance
+				for (int u(0); u < meshes[group[j]].ubos.size(); ++u)
+					if (UniformBufferObject<UniformBufferObjectModel>* uboModel = dynamic_cast<UniformBufferObject<UniformBufferObjectModel>*>(meshes[group[j]].ubos[u]))
+						perInstance[j].albedo = glm::vec3(uboModel->getData().color);
+			}
+
+			m_generatedInstances.push_back(std::unique_ptr<Instance>(new Instance()));
+			Instance* instance = m_generatedInstances.back().get();
+			instance->load(vk, sizeof(ModelInstance), static_cast<uint32_t>(perInstance.size()), perInstance.data());
+			// Un seul paquet : le groupe est culle et choisit son LOD d'un bloc
+			instance->computeBuckets(models, meshes[group[0]].mesh->getBoundingSphere(), static_cast<uint32_t>(models.size()));
+
+			instancedMeshes.push_back({ meshes[group[0]].mesh, meshes[group[0]].ubos, instance });
+		}
+
+		instancedPipelineID = addMeshInstanced(vk, instancedMeshes, getInstancedShaderPath(vertPath), fragPath, nbTexture);
+		m_meshesPipeline[instancedPipelineID].frameBufferID = frameBufferID;
+		m_meshesPipeline[instancedPipelineID].layer = layer;
+
+		std::vector<MeshRender> remainingMeshes;
+		for (int i(0); i < meshes.size(); ++i)
+			if (!merged[i])
+				remainingMeshes.push_back(meshes[i]);
+#ifndef NDEBUG
+		std::cout << "[Instanciation] " << meshes.size() - remainingMeshes.size() << " meshes rendus par " << instancingGroups.size()
+			<< " draws instancies (" << vertPath << ")" << std::endl;
+#endif
+		meshes = remainingMeshes;
+		if (meshes.empty())
+			return instancedPipelineID;
+	}
+
 	MeshPipeline meshesPipeline;
+	std::vector<DrawSource> drawSources;
 
-	// Tous les meshes doivent avoir la mme dfinition d'ubo
-	VkDescriptorSetLayout descriptorSetLayout = createDescriptorSetLayout(vk->getDevice(), meshes[0].ubos, nbTexture);
+	// Tous les meshes doivent avoir la même définition d'ubo
+	VkDescriptorSetLayout descriptorSetLayout = createDescriptorSetLayout(vk, meshes[0].ubos, nbTexture);
 
-	Pipeline pipeline;
-	pipeline.initialize(vk, &descriptorSetLayout, m_renderPass, vertPath, fragPath, false, m_msaaSamples, { Vertex::getBindingDescription(0) }, Vertex::getAttributeDescriptions(0), m_extent);
+	std::vector<VkVertexInputBindingDescription> bindingDescription;
+	std::vector<VkVertexInputAttributeDescription> attributeDescription;
+	getVertexInput(false, INSTANCE_LAYOUT_MODEL, bindingDescription, attributeDescription);
+	Pipeline pipeline = vk->getPipelineLibrary()->getGraphicsPipeline(vk, descriptorSetLayout, m_renderPass, getRenderPassCompatibility(), vertPath, fragPath, false,
+		m_msaaSamples, bindingDescription, attributeDescription);
 	meshesPipeline.pipeline = pipeline.GetGraphicsPipeline();
 	meshesPipeline.pipelineLayout = pipeline.GetPipelineLayout();
 	
 	for (int i(0); i < meshes.size(); ++i)
 	{
-		meshesPipeline.vertexBuffer.push_back(meshes[i].mesh->getVertexBuffer());
-		meshesPipeline.indexBuffer.push_back(meshes[i].mesh->getIndexBuffer());
+		meshesPipeline.vertexOffset.push_back(meshes[i].mesh->getVertexOffset());
 		meshesPipeline.nbIndices.push_back(meshes[i].mesh->getNumIndices());
+		meshesPipeline.firstIndex.push_back(meshes[i].mesh->getFirstIndex());
+		meshesPipeline.indexType.push_back(meshes[i].mesh->getIndexType());
+		meshesPipeline.firstInstance.push_back(0);
+		meshesPipeline.nbInstances.push_back(1);
+		drawSources.push_back({ meshes[i].mesh });
+
+		if (meshes[i].mesh->getLods().size() > 1)
+			m_lodDraws.push_back({ (int)m_meshesPipeline.size(), i, meshes[i].mesh });
 
 #ifndef NDEBUG
 		if (meshes[i].mesh->getImageView().size() != nbTexture)
-			std::cout << "Attention : le nombre de texture utiliss n'est pas gale au nombre de textures du mesh" << std::endl;
+			std::cout << "Attention : le nombre de texture utilisés n'est pas égale au nombre de textures du mesh" << std::endl;
 #endif // DEBUG
 
 		VkDescriptorSet descriptorSet = createDescriptorSet(vk->getDevice(), descriptorSetLayout,
 			meshes[i].mesh->getImageView(), meshes[i].mesh->getSampler(), meshes[i].ubos, nbTexture);
 		meshesPipeline.descriptorSet.push_back(descriptorSet);
+		meshesPipeline.uboOffsets.push_back(getUboOffsets(meshes[i].ubos));
 	}
 
+	meshesPipeline.uboFrameStride = static_cast<uint32_t>(vk->getUniformArena()->getFrameSize());
 	meshesPipeline.frameBufferID = frameBufferID;
+	meshesPipeline.layer = layer;
 	
 	m_meshesPipeline.push_back(meshesPipeline);
+	m_drawSources.push_back(drawSources);
+	m_cullingDirty = true;
 
 	return (int)m_meshesPipeline.size() - 1;
 }
 
-int RenderPass::addMeshInstanced(Vulkan* vk, std::vector<MeshRender> meshes, std::string vertPath, std::string fragPath, int nbTexture)
+int RenderPass::addMeshInstanced(Vulkan* vk, std::vector<MeshRender> meshes, std::string vertPath, std::string fragPath, int nbTexture,
+	InstanceLayout instanceLayout)
 {
 	MeshPipeline meshesPipelineInstanced;
+	std::vector<DrawSource> drawSources;
 
-	VkDescriptorSetLayout descriptorSetLayout = createDescriptorSetLayout(vk->getDevice(), meshes[0].ubos, nbTexture);
+	VkDescriptorSetLayout descriptorSetLayout = createDescriptorSetLayout(vk, meshes[0].ubos, nbTexture);
 
-	Pipeline pipeline;
-	std::vector<VkVertexInputAttributeDescription> attributeDescription = Vertex::getAttributeDescriptions(0);
-	std::vector<VkVertexInputAttributeDescription> instanceAttributeDescription = ModelInstance::getAttributeDescriptions(1, 4);
-	for (int i(0); i < instanceAttributeDescription.size(); ++i)
-	{
-		attributeDescription.push_back(instanceAttributeDescription[i]);
-	}
-	pipeline.initialize(vk, &descriptorSetLayout, m_renderPass, vertPath, fragPath, false, m_msaaSamples, { Vertex::getBindingDescription(0), ModelInstance::getBindingDescription(1) }, 
-		attributeDescription, m_extent);
+	std::vector<VkVertexInputBindingDescription> bindingDescription;
+	std::vector<VkVertexInputAttributeDescription> attributeDescription;
+	getVertexInput(true, instanceLayout, bindingDescription, attributeDescription);
+	Pipeline pipeline = vk->getPipelineLibrary()->getGraphicsPipeline(vk, descriptorSetLayout, m_renderPass, getRenderPassCompatibility(), vertPath, fragPath, false,
+		m_msaaSamples, bindingDescription, attributeDescription);
 	meshesPipelineInstanced.pipeline = pipeline.GetGraphicsPipeline();
 	meshesPipelineInstanced.pipelineLayout = pipeline.GetPipelineLayout();
 
 	for (int i(0); i < meshes.size(); ++i)
 	{
-		meshesPipelineInstanced.vertexBuffer.push_back(meshes[i].mesh->getVertexBuffer());
-		meshesPipelineInstanced.indexBuffer.push_back(meshes[i].mesh->getIndexBuffer());
-		meshesPipelineInstanced.nbIndices.push_back(meshes[i].mesh->getNumIndices());
-		meshesPipelineInstanced.instanceBuffer.push_back(meshes[i].instance->getInstanceBuffer());
-
 #ifndef NDEBUG
 		if (meshes[i].mesh->getImageView().size() != nbTexture)
-			std::cout << "Attention : le nombre de texture utiliss n'est pas gale au nombre de textures du mesh" << std::endl;
+			std::cout << "Attention : le nombre de texture utilisés n'est pas égale au nombre de textures du mesh" << std::endl;
 #endif // DEBUG
 
 		VkDescriptorSet descriptorSet = createDescriptorSet(vk->getDevice(), descriptorSetLayout,
 			meshes[i].mesh->getImageView(), meshes[i].mesh->getSampler(), meshes[i].ubos, nbTexture);
-		meshesPipelineInstanced.descriptorSet.push_back(descriptorSet);
+
+		// Un draw par paquet d'instances pour que chaque paquet choisisse son LOD
+		std::vector<InstanceBucket> buckets = meshes[i].instance->getBuckets();
+		if (buckets.empty())
+			buckets.push_back({ 0, meshes[i].instance->getNbInstances(), glm::vec3(0.0f), 0.0f, 0.0f });
+		for (int b(0); b < buckets.size(); ++b)
+		{
+			meshesPipelineInstanced.vertexOffset.push_back(meshes[i].mesh->getVertexOffset());
+			meshesPipelineInstanced.nbIndices.push_back(meshes[i].mesh->getNumIndices());
+			meshesPipelineInstanced.firstIndex.push_back(meshes[i].mesh->getFirstIndex());
+			meshesPipelineInstanced.indexType.push_back(meshes[i].mesh->getIndexType());
+			meshesPipelineInstanced.instanceBuffer.push_back(meshes[i].instance->getInstanceBuffer());
+			meshesPipelineInstanced.instanceFrameStride.push_back(meshes[i].instance->getFrameStride());
+			meshesPipelineInstanced.firstInstance.push_back(buckets[b].firstInstance);
+			meshesPipelineInstanced.nbInstances.push_back(buckets[b].nbInstances);
+			meshesPipelineInstanced.descriptorSet.push_back(descriptorSet);
+			meshesPipelineInstanced.uboOffsets.push_back(getUboOffsets(meshes[i].ubos));
+			drawSources.push_back({ meshes[i].mesh, meshes[i].instance, meshes[i].instance->getBuckets().empty() ? -1 : b });
+
+			if (meshes[i].mesh->getLods().size() > 1 && !meshes[i].instance->getBuckets().empty())
+				m_lodDraws.push_back({ (int)m_meshesPipeline.size(), (int)meshesPipelineInstanced.nbIndices.size() - 1, meshes[i].mesh, meshes[i].instance, b });
+		}
 	}
 
+	meshesPipelineInstanced.uboFrameStride = static_cast<uint32_t>(vk->getUniformArena()->getFrameSize());
 	m_meshesPipeline.push_back(meshesPipelineInstanced);
+	m_drawSources.push_back(drawSources);
+	m_cullingDirty = true;
 
 	return (int)m_meshesPipeline.size() - 1;
 }
 
+int RenderPass::addMeshIndirect(Vulkan* vk, std::vector<MeshRender> meshes, std::string vertPath, std::string fragPath, int nbTexture)
+{
+	MeshPipeline meshesPipelineIndirect;
+	std::vector<DrawSource> drawSources;
+
+	VkDescriptorSetLayout descriptorSetLayout = createDescriptorSetLayout(vk, meshes[0].ubos, nbTexture);
+
+	std::vector<VkVertexInputBindingDescription> bindingDescription;
+	std::vector<VkVertexInputAttributeDescription> attributeDescription;
+	getVertexInput(true, INSTANCE_LAYOUT_MODEL, bindingDescription, attributeDescription);
+	Pipeline pipeline = vk->getPipelineLibrary()->getGraphicsPipeline(vk, descriptorSetLayout, m_renderPass, getRenderPassCompatibility(), vertPath, fragPath, false,
+		m_msaaSamples, bindingDescription, attributeDescription);
+	meshesPipelineIndirect.pipeline = pipeline.GetGraphicsPipeline();
+	meshesPipelineIndirect.pipelineLayout = pipeline.GetPipelineLayout();
+
+	for (int i(0); i < meshes.size(); ++i)
+	{
+		VkDescriptorSet descriptorSet = createDescriptorSet(vk->getDevice(), descriptorSetLayout,
+			meshes[i].mesh->getImageView(), meshes[i].mesh->getSampler(), meshes[i].ubos, nbTexture);
+
+		// Les champs directs ne servent qu'au tri, le GPU ecrit les vrais draws
+		meshesPipelineIndirect.vertexOffset.push_back(meshes[i].mesh->getVertexOffset());
+		meshesPipelineIndirect.nbIndices.push_back(meshes[i].mesh->getNumIndices());
+		meshesPipelineIndirect.firstIndex.push_back(meshes[i].mesh->getFirstIndex());
+		meshesPipelineIndirect.indexType.push_back(meshes[i].mesh->getIndexType());
+		meshesPipelineIndirect.instanceBuffer.push_back(VK_NULL_HANDLE);
+		meshesPipelineIndirect.instanceFrameStride.push_back(0); // sortie du culling, ecrite a chaque frame sur le GPU
+		meshesPipelineIndirect.firstInstance.push_back(0);
+		meshesPipelineIndirect.nbInstances.push_back(meshes[i].instance->getNbInstances());
+		meshesPipelineIndirect.descriptorSet.push_back(descriptorSet);
+		meshesPipelineIndirect.uboOffsets.push_back(getUboOffsets(meshes[i].ubos));
+		meshesPipelineIndirect.firstIndirectDraw.push_back(m_gpuCulling.addBatch(meshes[i].mesh, meshes[i].instance));
+		meshesPipelineIndirect.nbIndirectDraws.push_back(static_cast<uint32_t>(meshes[i].mesh->getLods().size()));
+		drawSources.push_back({ meshes[i].mesh, meshes[i].instance });
+	}
+
+	meshesPipelineIndirect.uboFrameStride = static_cast<uint32_t>(vk->getUniformArena()->getFrameSize());
+	m_indirectPipelineIDs.push_back((int)m_meshesPipeline.size());
+	m_meshesPipeline.push_back(meshesPipelineIndirect);
+	m_drawSources.push_back(drawSources);
+	m_cullingDirty = true;
+
+	// Les buffers du culling sont recrees pour le nouveau lot : tous les draws indirects sont mis a jour
+	m_gpuCulling.build(vk);
+	for (int i(0); i < m_indirectPipelineIDs.size(); ++i)
+	{
+		MeshPipeline& meshPipeline = m_meshesPipeline[m_indirectPipelineIDs[i]];
+		meshPipeline.indirectBuffer = m_gpuCulling.getDrawBuffer();
+		for (int j(0); j < meshPipeline.instanceBuffer.size(); ++j)
+			meshPipeline.instanceBuffer[j] = m_gpuCulling.getInstanceBuffer();
+	}
+
+	return (int)m_meshesPipeline.size() - 1;
+}
+
+void RenderPass::preparePipeline(Vulkan* vk, std::vector<UboBase*> ubos, std::string vertPath, std::string fragPath, int nbTexture, bool instanced,
+	InstanceLayout instanceLayout)
+{
+	VkDescriptorSetLayout descriptorSetLayout = createDescriptorSetLayout(vk, ubos, nbTexture);
+
+	std::vector<VkVertexInputBindingDescription> bindingDescription;
+	std::vector<VkVertexInputAttributeDescription> attributeDescription;
+	getVertexInput(instanced, instanceLayout, bindingDescription, attributeDescription);
+	vk->getPipelineLibrary()->prepareGraphicsPipeline(vk, descriptorSetLayout, m_renderPass, getRenderPassCompatibility(), vertPath, fragPath, false,
+		m_msaaSamples, bindingDescription, attributeDescription);
+}
+
 int RenderPass::addText(Vulkan * vk, Text * text)
 {
 	m_text = text;
+	m_textPipeline = vk->getPipelineLibrary()->getGraphicsPipeline(vk, m_textDescriptorSetLayout, m_renderPass, getRenderPassCompatibility(), "Shaders/TextVert.spv",
+		"Shaders/TextFrag.spv", true, m_msaaSamples, { TextVertex::getBindingDescription() }, TextVertex::getAttributeDescriptions());
 
 	int nbText = text->GetNbTexts();
 	for (int i = 0; i < nbText; ++i)
@@ -140,19 +296,25 @@ int RenderPass::addText(Vulkan * vk, Text * text)
 		MeshPipeline meshPipeline;
 		meshPipeline.pipeline = m_textPipeline.GetGraphicsPipeline();
 		meshPipeline.pipelineLayout = m_textPipeline.GetPipelineLayout();
+		meshPipeline.layer = RENDER_LAYER_OVERLAY;
 
 		for(int j = 0; j < text->GetNbCharacters(i); ++j)
 		{
-			meshPipeline.vertexBuffer.push_back(text->GetVertexBuffer(i, j));
-			meshPipeline.indexBuffer.push_back(text->GetIndexBuffer());
+			meshPipeline.vertexOffset.push_back(text->GetVertexOffset(i, j));
 			meshPipeline.nbIndices.push_back(6);
+			meshPipeline.firstIndex.push_back(text->GetFirstIndex());
+			meshPipeline.indexType.push_back(text->GetIndexType());
+			meshPipeline.firstInstance.push_back(0);
+			meshPipeline.nbInstances.push_back(1);
 
 			VkDescriptorSet descriptorSet = createDescriptorSet(vk->getDevice(), m_textDescriptorSetLayout,
 				std::vector<VkImageView>(1, text->GetImageView(i, j)), text->GetSampler(), std::vector<UboBase*>(), 1);
 			meshPipeline.descriptorSet.push_back(descriptorSet);
+			meshPipeline.uboOffsets.push_back(std::vector<uint32_t>());
 		}
 
 		m_meshesPipeline.push_back(meshPipeline);
+		m_drawSources.push_back(std::vector<DrawSource>());
 	}
 
 	return 0;
@@ -188,10 +350,239 @@ int RenderPass::addDirLight(Vulkan* vk, glm::vec3 direction, glm::vec3 color)
 
 void RenderPass::recordDraw(Vulkan * vk)
 {
-	if(m_useSwapChain) vk->fillCommandBuffer(m_renderPass, m_meshesPipeline);
+	sortDraws();
+	recordSortedDraw(vk);
+}
+
+void RenderPass::recordSortedDraw(Vulkan * vk)
+{
+	std::function<void(VkCommandBuffer, uint32_t)> prePass;
+	if (hasPrePass())
+		prePass = [this](VkCommandBuffer commandBuffer, uint32_t frame) { recordPrePass(commandBuffer, frame); };
+
+	if(m_useSwapChain) vk->fillCommandBuffer(m_renderPass, m_meshesPipeline, m_renderQueue.getItems(), prePass);
 	else fillCommandBuffer(vk);
 }
 
+void RenderPass::recordPrePass(VkCommandBuffer commandBuffer, uint32_t frame)
+{
+	for (int i(0); i < m_instanceAnimators.size(); ++i)
+		m_instanceAnimators[i]->record(commandBuffer, frame);
+	if (m_gpuCulling.hasBatches())
+		m_gpuCulling.record(commandBuffer, frame);
+}
+
+bool RenderPass::sortDraws()
+{
+	std::vector<DrawItem> previousOrder = m_renderQueue.getItems();
+	m_renderQueue.clear();
+
+	// Identifiants compacts pour les cles : un par pipeline et par descriptor set distincts
+	std::map<VkPipeline, uint32_t> pipelineIDs;
+	std::map<VkDescriptorSet, uint32_t> materialIDs;
+	uint32_t sequence = 0;
+	for (int i(0); i < m_meshesPipeline.size(); ++i)
+	{
+		const MeshPipeline& meshPipeline = m_meshesPipeline[i];
+		uint32_t pipelineID = pipelineIDs.insert({ meshPipeline.pipeline, (uint32_t)pipelineIDs.size() }).first->second;
+
+		for (int j(0); j < meshPipeline.nbIndices.size(); ++j)
+		{
+			uint64_t sortKey;
+			// Hors du frustum ou sans instance : le draw n'est pas enregistre
+			if (j < m_drawSources[i].size() && m_drawSources[i][j].cullingID >= 0 && m_drawSources[i][j].cullingID < m_visibleDraws.size() &&
+				!m_visibleDraws[m_drawSources[i][j].cullingID])
+				continue;
+			if (meshPipeline.nbInstances[j] == 0)
+				continue;
+
+			if (meshPipeline.layer == RENDER_LAYER_OVERLAY)
+				sortKey = RenderQueue::makeSortKey(meshPipeline.layer, 0, 0, sequence++);
+			else
+			{
+				uint32_t materialID = materialIDs.insert({ meshPipeline.descriptorSet[j], (uint32_t)materialIDs.size() }).first->second;
+
+				float depth = 0.0f;
+				if (j < m_drawSources[i].size())
+				{
+					glm::vec3 center;
+					float radius, instanceRadius;
+					getBoundingSphere(m_drawSources[i][j].mesh, m_drawSources[i][j].instance, m_drawSources[i][j].bucketID, center, radius, instanceRadius);
+					depth = std::max(glm::length(center - m_cameraPosition) - radius, 0.0f);
+				}
+				sortKey = RenderQueue::makeDepthSortKey(meshPipeline.layer, pipelineID, materialID, depth);
+			}
+
+			m_renderQueue.push(sortKey, i, j);
+		}
+	}
+	m_renderQueue.sort();
+
+	const std::vector<DrawItem>& order = m_renderQueue.getItems();
+	if (order.size() != previousOrder.size())
+		return true;
+	for (int i(0); i < order.size(); ++i)
+		if (order[i].meshPipelineID != previousOrder[i].meshPipelineID || order[i].drawID != previousOrder[i].drawID)
+			return true;
+	return false;
+}
+
+bool RenderPass::updateInstances(Vulkan* vk)
+{
+	std::set<Instance*> flushedInstances;
+	bool changed = false;
+	for (int i(0); i < m_meshesPipeline.size(); ++i)
+	{
+		for (int j(0); j < m_drawSources[i].size(); ++j)
+		{
+			Instance* instance = m_drawSources[i][j].instance;
+			if (!instance)
+				continue;
+
+			if (flushedInstances.insert(instance).second)
+				instance->flush(vk);
+
+			// Un paquet ne dessine que ses instances encore presentes
+			uint32_t nbInstances = instance->getNbInstances();
+			if (m_drawSources[i][j].bucketID >= 0)
+			{
+				InstanceBucket bucket = instance->getBuckets()[m_drawSources[i][j].bucketID];
+				nbInstances = nbInstances > bucket.firstInstance ? std::min(bucket.nbInstances, nbInstances - bucket.firstInstance) : 0;
+			}
+
+			if (m_meshesPipeline[i].nbInstances[j] != nbInstances)
+			{
+				m_meshesPipeline[i].nbInstances[j] = nbInstances;
+				changed = true;
+			}
+		}
+	}
+
+	return changed;
+}
+
+void RenderPass::buildCulling()
+{
+	m_frustumCuller.clear();
+	for (int i(0); i < m_meshesPipeline.size(); ++i)
+	{
+		// Le skybox suit la camera et les draws indirects sont deja culles par le GPU
+		if (m_meshesPipeline[i].layer != RENDER_LAYER_OPAQUE || m_meshesPipeline[i].indirectBuffer != VK_NULL_HANDLE)
+			continue;
+
+		for (int j(0); j < m_drawSources[i].size(); ++j)
+		{
+			// Instances sans paquet : pas de sphere englobante connue
+			if (m_drawSources[i][j].instance && m_drawSources[i][j].bucketID < 0)
+				continue;
+
+			glm::vec3 center;
+			float radius, instanceRadius;
+			getBoundingSphere(m_drawSources[i][j].mesh, m_drawSources[i][j].instance, m_drawSources[i][j].bucketID, center, radius, instanceRadius);
+			m_drawSources[i][j].cullingID = m_frustumCuller.add(center, radius);
+		}
+	}
+	m_frustumCuller.build();
+	m_visibleDraws.clear();
+
+	m_cullingDirty = false;
+}
+
+void RenderPass::getBoundingSphere(MeshPBR* mesh, Instance* instance, int bucketID, glm::vec3& center, float& radius, float& instanceRadius)
+{
+	if (instance && bucketID >= 0)
+	{
+		InstanceBucket bucket = instance->getBuckets()[bucketID];
+		center = bucket.center;
+		radius = bucket.radius;
+		instanceRadius = bucket.instanceRadius;
+	}
+	else
+	{
+		glm::mat4 model = mesh->getModelMatrix();
+		glm::vec4 boundingSphere = mesh->getBoundingSphere();
+		float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+
+		center = glm::vec3(model * glm::vec4(glm::vec3(boundingSphere), 1.0f));
+		instanceRadius = radius = boundingSphere.w * scale;
+	}
+}
+
+void RenderPass::updateDraws(Vulkan* vk, glm::vec3 cameraPosition, glm::mat4 view, glm::mat4 projection)
+{
+	// Culling avant le choix des LODs et le tri : seuls les draws visibles sont enregistres
+	if (m_cullingDirty)
+		buildCulling();
+	m_frustumCuller.cull(FrustumCuller::extractPlanes(projection * view), m_visibleDraws);
+
+	// Seul l'UBO de la frame change : les command buffers pre-enregistres restent valides
+	if (m_gpuCulling.hasBatches())
+		m_gpuCulling.update(vk, view, projection, (float)m_extent.height);
+
+	bool changed = updateInstances(vk);
+
+	// Taille en pixels d'un objet de rayon 1 a distance 1
+	float pixelScale = std::abs(projection[1][1]) * 0.5f * m_extent.height;
+
+	for (int i(0); i < m_lodDraws.size(); ++i)
+	{
+		LodDraw& lodDraw = m_lodDraws[i];
+
+		glm::vec3 center;
+		float radius;
+		float instanceRadius;
+		getBoundingSphere(lodDraw.mesh, lodDraw.instance, lodDraw.bucketID, center, radius, instanceRadius);
+
+		// Distance a l'instance la plus proche possible du paquet
+		float distance = glm::length(center - cameraPosition) - (radius - instanceRadius);
+		uint32_t lod = 0;
+		if (distance > instanceRadius)
+			lod = lodDraw.mesh->selectLod(instanceRadius * pixelScale / distance);
+
+		MeshLod meshLod = lodDraw.mesh->getLods()[lod];
+		uint32_t firstIndex = lodDraw.mesh->getFirstIndex() + meshLod.firstIndex;
+		MeshPipeline& meshPipeline = m_meshesPipeline[lodDraw.pipelineID];
+		if (meshPipeline.firstIndex[lodDraw.drawID] != firstIndex)
+		{
+			meshPipeline.firstIndex[lodDraw.drawID] = firstIndex;
+			meshPipeline.nbIndices[lodDraw.drawID] = meshLod.nbIndices;
+			changed = true;
+		}
+	}
+
+	// Les opaques sont retries du plus proche au plus lointain a chaque deplacement de la camera.
+	// Un draw qui entre ou sort du frustum change aussi l'ordre
+	m_cameraPosition = cameraPosition;
+	if (sortDraws())
+		changed = true;
+
+	// Les command buffers sont pre-enregistres : on ne les reconstruit que si un LOD, un nombre d'instances ou l'ordre a change
+	if (changed)
+		recordSortedDraw(vk);
+}
+
+void RenderPass::reloadShaders(Vulkan* vk, std::vector<std::string> shaderPaths)
+{
+	std::map<VkPipeline, Pipeline> reloadedPipelines = vk->getPipelineLibrary()->reloadShaders(vk, shaderPaths, m_renderPass, getRenderPassCompatibility());
+	if (reloadedPipelines.empty())
+		return;
+
+	for (int i(0); i < m_meshesPipeline.size(); ++i)
+	{
+		auto reloaded = reloadedPipelines.find(m_meshesPipeline[i].pipeline);
+		if (reloaded == reloadedPipelines.end())
+			continue;
+		m_meshesPipeline[i].pipeline = reloaded->second.GetGraphicsPipeline();
+		m_meshesPipeline[i].pipelineLayout = reloaded->second.GetPipelineLayout();
+	}
+
+	auto reloadedText = reloadedPipelines.find(m_textPipeline.GetGraphicsPipeline());
+	if (reloadedText != reloadedPipelines.end())
+		m_textPipeline = reloadedText->second;
+
+	recordSortedDraw(vk);
+}
+
 /*void RenderPass::updateUniformBuffer(Vulkan * vk, int meshID)
 {
 	m_camera.update(vk->GetWindow());
@@ -231,24 +622,29 @@ void RenderPass::drawCall(Vulkan * vk)
 {
 	if (m_text && m_text->NeedUpdate() != -1)
 	{
-		m_meshesPipeline[m_textID[m_text->NeedUpdate()]].free(vk->getDevice(), m_descriptorPool);
+		m_meshesPipeline[m_textID[m_text->NeedUpdate()]].free();
 		//m_meshesPipeline.erase(m_meshesPipeline.begin() + m_textID[m_text->NeedUpdate()]);
 
 		//m_textID[m_text->NeedUpdate()] = m_meshesPipeline.size();
 		MeshPipeline meshPipeline;
 		meshPipeline.pipeline = m_textPipeline.GetGraphicsPipeline();
 		meshPipeline.pipelineLayout = m_textPipeline.GetPipelineLayout();
+		meshPipeline.layer = RENDER_LAYER_OVERLAY;
 
 		for (int j = 0; j < m_text->GetNbCharacters(m_text->NeedUpdate()); ++j)
 		{
-			meshPipeline.vertexBuffer.push_back(m_text->GetVertexBuffer(m_text->NeedUpdate(), j));
-			meshPipeline.indexBuffer.push_back(m_text->GetIndexBuffer());
+			meshPipeline.vertexOffset.push_back(m_text->GetVertexOffset(m_text->NeedUpdate(), j));
 			meshPipeline.nbIndices.push_back(6);
+			meshPipeline.firstIndex.push_back(m_text->GetFirstIndex());
+			meshPipeline.indexType.push_back(m_text->GetIndexType());
+			meshPipeline.firstInstance.push_back(0);
+			meshPipeline.nbInstances.push_back(1);
 
 			VkDescriptorSet descriptorSet = createDescriptorSet(vk->getDevice(), m_textDescriptorSetLayout,
 				std::vector<VkImageView>(1, m_text->GetImageView(m_text->NeedUpdate(), j)), m_text->GetSampler(),
 				std::vector<UboBase*>(), 1);
 			meshPipeline.descriptorSet.push_back(descriptorSet);
+			meshPipeline.uboOffsets.push_back(std::vector<uint32_t>());
 		}
 
 		m_meshesPipeline[m_textID[m_text->NeedUpdate()]] = meshPipeline;
@@ -268,19 +664,47 @@ void RenderPass::cleanup(Vulkan * vk)
 {
 	vkDestroyImageView(vk->getDevice(), m_colorImageView, nullptr);
 	vkDestroyImage(vk->getDevice(), m_colorImage, nullptr);
-	vkFreeMemory(vk->getDevice(), m_colorImageMemory, nullptr);
+	m_colorImageMemory.free();
 
 	for (int i(0); i < m_meshesPipeline.size(); ++i)
-		m_meshesPipeline[i].free(vk->getDevice(), m_descriptorPool, true); // ne dtruit pas les ressources
+		m_meshesPipeline[i].free(); // ne détruit pas les ressources
 
 	for (int i(0); i < m_frameBuffers.size(); ++i)
 		m_frameBuffers[i].free(vk->getDevice());
 
 	m_meshes.clear();
+	m_lodDraws.clear();
+	m_drawSources.clear();
+	m_renderQueue.clear();
+	m_gpuCulling.cleanup(vk);
+	m_instanceAnimators.clear(); // appartiennent a l'appelant
+	m_indirectPipelineIDs.clear();
+	for (int i(0); i < m_generatedInstances.size(); ++i)
+		m_generatedInstances[i]->cleanup(vk->getDevice());
+	m_generatedInstances.clear();
+#ifndef NDEBUG
+	FrustumCuller::Statistics cullingStatistics = m_frustumCuller.getStatistics();
+	if (cullingStatistics.nbCulls > 0)
+		std::cout << "[Culling] " << m_frustumCuller.getNbObjects() << " objets, " << cullingStatistics.nbVisibleObjects / cullingStatistics.nbCulls << " visibles et "
+			<< cullingStatistics.nbTestedSpheres / cullingStatistics.nbCulls << " spheres testees en " << cullingStatistics.cullTime / cullingStatistics.nbCulls
+			<< " ms en moyenne" << std::endl;
+#endif
+	m_frustumCuller = FrustumCuller();
+	m_visibleDraws.clear();
+	m_cullingDirty = false;
 
 	m_meshesPipeline.clear();
 
+#ifndef NDEBUG
+	std::cout << "[Descripteurs] " << m_descriptorSetCache.size() << " descriptor sets pour " << m_nbDescriptorSetRequests << " draws, "
+		<< m_descriptorSetLayoutCache.size() << " layouts" << std::endl;
+#endif
 	vkDestroyDescriptorPool(vk->getDevice(), m_descriptorPool, nullptr);
+	m_descriptorSetCache.clear();
+	m_nbDescriptorSetRequests = 0;
+	m_descriptorSetLayoutCache.clear(); // layouts de la bibliotheque de pipelines
+	// Un pipeline declare mais jamais demande peut encore etre en compilation avec cette passe
+	vk->getPipelineLibrary()->waitPreparedPipelines();
 	vkDestroyRenderPass(vk->getDevice(), m_renderPass, nullptr);
 
 	m_isDestroyed = true;
@@ -370,15 +794,47 @@ void RenderPass::createColorResources(Vulkan* vk, VkExtent2D extent)
 	vk->transitionImageLayout(m_colorImage, colorFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, 1, 1);
 }
 
-VkDescriptorSetLayout RenderPass::createDescriptorSetLayout(VkDevice device, std::vector<UboBase*> uniformBuffers, int nbTexture)
+void RenderPass::getVertexInput(bool instanced, InstanceLayout instanceLayout, std::vector<VkVertexInputBindingDescription>& bindingDescription,
+	std::vector<VkVertexInputAttributeDescription>& attributeDescription)
+{
+	bindingDescription = { Vertex::getBindingDescription(0) };
+	attributeDescription = Vertex::getAttributeDescriptions(0);
+	if (!instanced)
+		return;
+
+	bindingDescription.push_back(instanceLayout == INSTANCE_LAYOUT_COMPACT ? CompactInstance::getBindingDescription(1) : ModelInstance::getBindingDescription(1));
+	std::vector<VkVertexInputAttributeDescription> instanceAttributeDescription = instanceLayout == INSTANCE_LAYOUT_COMPACT ?
+		CompactInstance::getAttributeDescriptions(1, 4) : ModelInstance::getAttributeDescriptions(1, 4);
+	for (int i(0); i < instanceAttributeDescription.size(); ++i)
+	{
+		attributeDescription.push_back(instanceAttributeDescription[i]);
+	}
+}
+
+std::vector<uint64_t> RenderPass::getRenderPassCompatibility()
+{
+	// Toutes les passes ont la meme structure (couleur, profondeur, resolve) : seuls formats et echantillons changent
+	return { static_cast<uint64_t>(m_format), static_cast<uint64_t>(m_depthFormat), static_cast<uint64_t>(m_msaaSamples) };
+}
+
+VkDescriptorSetLayout RenderPass::createDescriptorSetLayout(Vulkan* vk, std::vector<UboBase*> uniformBuffers, int nbTexture)
 {
+	// Meme suite d'ubos (par etage de shader) et meme nombre de textures : meme layout
+	std::vector<uint64_t> key;
+	for (int u(0); u < uniformBuffers.size(); ++u)
+		key.push_back(uniformBuffers[u]->getAccessibility());
+	key.push_back(nbTexture);
+	auto cached = m_descriptorSetLayoutCache.find(key);
+	if (cached != m_descriptorSetLayoutCache.end())
+		return cached->second;
+
 	int i = 0;
 	std::vector<VkDescriptorSetLayoutBinding> bindings;
 	for (; i < uniformBuffers.size(); ++i)
 	{
 		VkDescriptorSetLayoutBinding uboLayoutBinding = {};
 		uboLayoutBinding.binding = i;
-		uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		uboLayoutBinding.descriptorCount = 1;
 		uboLayoutBinding.stageFlags = uniformBuffers[i]->getAccessibility();
 		uboLayoutBinding.pImmutableSamplers = nullptr;
@@ -398,14 +854,9 @@ VkDescriptorSetLayout RenderPass::createDescriptorSetLayout(VkDevice device, std
 		bindings.push_back(samplerLayoutBinding);
 	}
 
-	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-	layoutInfo.pBindings = bindings.data();
-
-	VkDescriptorSetLayout descriptorSetLayout;
-	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
-		throw std::runtime_error("Erreur : descriptor set layout");
+	// Partage avec les autres passes : meme layout, memes pipelines
+	VkDescriptorSetLayout descriptorSetLayout = vk->getPipelineLibrary()->getDescriptorSetLayout(vk->getDevice(), bindings);
+	m_descriptorSetLayoutCache[key] = descriptorSetLayout;
 
 	return descriptorSetLayout;
 }
@@ -413,7 +864,7 @@ VkDescriptorSetLayout RenderPass::createDescriptorSetLayout(VkDevice device, std
 void RenderPass::createDescriptorPool(VkDevice device)
 {
 	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
-	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 	poolSizes[0].descriptorCount = 1024;
 	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 	poolSizes[1].descriptorCount = 1024;
@@ -426,12 +877,93 @@ void RenderPass::createDescriptorPool(VkDevice device)
 	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
 
 	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &m_descriptorPool) != VK_SUCCESS)
-		throw std::runtime_error("Erreur : cration du descriptor pool");
+		throw std::runtime_error("Erreur : création du descriptor pool");
+}
+
+std::vector<std::vector<int>> RenderPass::findInstancingGroups(Vulkan* vk, std::vector<MeshRender>& meshes, std::string vertPath, int nbTexture)
+{
+	std::vector<std::vector<int>> groups;
+	if (!m_automaticInstancing || meshes.size() < 2)
+		return groups;
+	if (!vk->hasShader(getInstancedShaderPath(vertPath)))
+		return groups;
+
+	// Meme geometrie, memes textures et memes UBO, a l'exception de l'UBO de matrice model que remplace l'instance
+	std::map<std::vector<uint64_t>, std::vector<int>> candidates;
+	for (int i(0); i < meshes.size(); ++i)
+	{
+		MeshPBR* mesh = meshes[i].mesh;
+		std::vector<uint64_t> key = { static_cast<uint32_t>(mesh->getVertexOffset()), mesh->getFirstIndex(), mesh->getNumIndices(),
+			static_cast<uint64_t>(mesh->getIndexType()) };
+
+		int nbModelUbos = 0;
+		for (int u(0); u < meshes[i].ubos.size(); ++u)
+		{
+			if (dynamic_cast<UniformBufferObject<UniformBufferObjectModel>*>(meshes[i].ubos[u]))
+			{
+				nbModelUbos++;
+				key.push_back(0);
+			}
+			else
+				key.push_back((uint64_t)meshes[i].ubos[u]);
+		}
+		std::vector<VkImageView> imageViews = mesh->getImageView();
+		if (nbModelUbos != 1 || imageViews.size() < nbTexture)
+			continue;
+
+		for (int t(0); t < nbTexture; ++t)
+			key.push_back((uint64_t)imageViews[t]);
+		if (nbTexture > 0)
+			key.push_back((uint64_t)mesh->getSampler());
+
+		candidates[key].push_back(i);
+	}
+
+	for (auto it = candidates.begin(); it != candidates.end(); ++it)
+		if (it->second.size() > 1)
+			groups.push_back(it->second);
+
+	return groups;
+}
+
+std::string RenderPass::getInstancedShaderPath(std::string vertPath)
+{
+	// "Shaders/vertSphere.spv" -> "Shaders/vertSphereInstanced.spv"
+	size_t extension = vertPath.find_last_of('.');
+	if (extension == std::string::npos)
+		return vertPath + "Instanced";
+	return vertPath.substr(0, extension) + "Instanced" + vertPath.substr(extension);
+}
+
+std::vector<uint32_t> RenderPass::getUboOffsets(std::vector<UboBase*> uniformBuffers)
+{
+	std::vector<uint32_t> uboOffsets(uniformBuffers.size());
+	for (int i(0); i < uniformBuffers.size(); ++i)
+		uboOffsets[i] = uniformBuffers[i]->getOffset();
+	return uboOffsets;
 }
 
 VkDescriptorSet RenderPass::createDescriptorSet(VkDevice device, VkDescriptorSetLayout decriptorSetLayout, std::vector<VkImageView> imageView,
 	VkSampler sampler, std::vector<UboBase*> uniformBuffer, int nbTexture)
 {
+	// Les ubos sont des tranches du meme buffer designees par l'offset dynamique : deux draws avec
+	// les memes textures et des ubos de meme taille partagent le descriptor set
+	m_nbDescriptorSetRequests++;
+	std::vector<uint64_t> key;
+	key.push_back((uint64_t)decriptorSetLayout);
+	for (int u(0); u < uniformBuffer.size(); ++u)
+	{
+		key.push_back((uint64_t)uniformBuffer[u]->getUniformBuffer());
+		key.push_back(uniformBuffer[u]->getSize());
+	}
+	for (int t(0); t < nbTexture; ++t)
+		key.push_back((uint64_t)imageView[t]);
+	if (nbTexture > 0)
+		key.push_back((uint64_t)sampler);
+	auto cached = m_descriptorSetCache.find(key);
+	if (cached != m_descriptorSetCache.end())
+		return cached->second;
+
 	VkDescriptorSetLayout layouts[] = { decriptorSetLayout };
 	VkDescriptorSetAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
@@ -447,11 +979,11 @@ VkDescriptorSet RenderPass::createDescriptorSet(VkDevice device, VkDescriptorSet
 	std::vector<VkWriteDescriptorSet> descriptorWrites;
 
 	int i = 0;
-	std::vector<VkDescriptorBufferInfo> bufferInfo(uniformBuffer.size()); // ne doit pas tre dtruit avant l'appel de vkUpdateDescriptorSets
+	std::vector<VkDescriptorBufferInfo> bufferInfo(uniformBuffer.size()); // ne doit pas être détruit avant l'appel de vkUpdateDescriptorSets
 	for(; i < uniformBuffer.size(); ++i)
 	{
 		bufferInfo[i].buffer = uniformBuffer[i]->getUniformBuffer();
-		bufferInfo[i].offset = 0;
+		bufferInfo[i].offset = 0; // + offset dynamique de la frame au bind
 		bufferInfo[i].range = uniformBuffer[i]->getSize();
 
 		VkWriteDescriptorSet descriptorWrite;
@@ -459,7 +991,7 @@ VkDescriptorSet RenderPass::createDescriptorSet(VkDevice device, VkDescriptorSet
 		descriptorWrite.dstSet = descriptorSet;
 		descriptorWrite.dstBinding = i;
 		descriptorWrite.dstArrayElement = 0;
-		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		descriptorWrite.descriptorCount = 1;
 		descriptorWrite.pBufferInfo = &bufferInfo[i];
 		descriptorWrite.pNext = NULL;
@@ -489,6 +1021,8 @@ VkDescriptorSet RenderPass::createDescriptorSet(VkDevice device, VkDescriptorSet
 	
 	vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 
+	m_descriptorSetCache[key] = descriptorSet;
+
 	return descriptorSet;
 }
 
@@ -503,13 +1037,19 @@ void RenderPass::fillCommandBuffer(Vulkan * vk)
 	if (vkAllocateCommandBuffers(vk->getDevice(), &allocInfo, m_commandBuffer.data()) != VK_SUCCESS)
 		throw std::runtime_error("Erreur : allocation des command buffers");
 
-	for (int i(0); i < m_frameBuffers.size(); ++i)
+	for (int c(0); c < m_commandBuffer.size(); ++c)
 	{
+		uint32_t frame = static_cast<uint32_t>(c / m_frameBuffers.size());
+		int i = c % m_frameBuffers.size();
+
 		VkCommandBufferBeginInfo beginInfo = {};
 		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
 
-		vkBeginCommandBuffer(m_commandBuffer[i], &beginInfo);
+		vkBeginCommandBuffer(m_commandBuffer[c], &beginInfo);
+
+		if (hasPrePass())
+			recordPrePass(m_commandBuffer[c], frame);
 
 		VkRenderPassBeginInfo renderPassInfo = {};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -525,46 +1065,32 @@ void RenderPass::fillCommandBuffer(Vulkan * vk)
 		renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 		renderPassInfo.pClearValues = clearValues.data();
 
-		vkCmdBeginRenderPass(m_commandBuffer[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBeginRenderPass(m_commandBuffer[c], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-		for (int j = 0; j < m_meshesPipeline.size(); ++j)
-		{
-			if (m_meshesPipeline[j].frameBufferID != i)
-				continue;
-
-			for (int k(0); k < m_meshesPipeline[j].vertexBuffer.size(); ++k)
-			{
-				vkCmdBindPipeline(m_commandBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS, m_meshesPipeline[j].pipeline);
-
-				VkBuffer vertexBuffers[] = { m_meshesPipeline[j].vertexBuffer[k] };
-				VkDeviceSize offsets[] = { 0 };
-				vkCmdBindVertexBuffers(m_commandBuffer[i], 0, 1, vertexBuffers, offsets);
-
-				vkCmdBindIndexBuffer(m_commandBuffer[i], m_meshesPipeline[j].indexBuffer[k], 0, VK_INDEX_TYPE_UINT32);
+		// Quelques draws enregistres une fois au chargement : pas de secondaires
+		CommandRecorder recorder(m_commandBuffer[c]);
+		vk->recordDraws(recorder, m_meshesPipeline, m_renderQueue.getItems(), 0, m_renderQueue.getItems().size(), frame, m_extent, i);
 
-				vkCmdBindDescriptorSets(m_commandBuffer[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-					m_meshesPipeline[j].pipelineLayout, 0, 1, &m_meshesPipeline[j].descriptorSet[k], 0, nullptr);
+		vkCmdEndRenderPass(m_commandBuffer[c]);
 
-				vkCmdDrawIndexed(m_commandBuffer[i], m_meshesPipeline[j].nbIndices[k], 1, 0, 0, 0);
-			}
-		}
-
-		vkCmdEndRenderPass(m_commandBuffer[i]);
-
-		if (vkEndCommandBuffer(m_commandBuffer[i]) != VK_SUCCESS)
+		if (vkEndCommandBuffer(m_commandBuffer[c]) != VK_SUCCESS)
 			throw std::runtime_error("Erreur : record command buffer");
 	}
 }
 
 void RenderPass::drawFrame(Vulkan * vk)
 {
+	// Les copies en attente doivent preceder le rendu dans la file
+	vk->flushUploadBatch();
+
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 	VkSemaphore renderFinishedSemaphore[] = { vk->getRenderFinishedSemaphore() };
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = &m_renderCompleteSemaphore; // renderPass
-	submitInfo.commandBufferCount = m_commandBuffer.size();
-	submitInfo.pCommandBuffers = m_commandBuffer.data();
+	// Les command buffers de la frame courante, qui lient ses tranches d'UBO
+	submitInfo.commandBufferCount = m_frameBuffers.size();
+	submitInfo.pCommandBuffers = &m_commandBuffer[vk->getCurrentFrame() * m_frameBuffers.size()];
 
 	if (m_firstDraw)
 	{
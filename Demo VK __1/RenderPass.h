@@ -2,6 +2,8 @@
 
 #include <array>
 #include <chrono>
+#include <map>
+#include <memory>
 
 #include "Vulkan.h"
 #include "Pipeline.h"
@@ -9,6 +11,9 @@
 #include "Text.h"
 #include "UniformBufferObject.h"
 #include "Instance.h"
+#include "GpuCulling.h"
+#include "FrustumCuller.h"
+#include "InstanceAnimator.h"
 
 struct MeshRender
 {
@@ -17,6 +22,24 @@ struct MeshRender
 	Instance* instance = nullptr;
 };
 
+// Origine d'un draw, pour sa distance a la camera
+struct DrawSource
+{
+	MeshPBR* mesh = nullptr;
+	Instance* instance = nullptr;
+	int bucketID = -1;
+	int cullingID = -1; // -1 : jamais culle (skybox, draws indirects)
+};
+
+struct LodDraw
+{
+	int pipelineID;
+	int drawID;
+	MeshPBR* mesh;
+	Instance* instance = nullptr;
+	int bucketID = -1;
+};
+
 class RenderPass
 {
 public:
@@ -24,11 +47,31 @@ public:
 
 	void initialize(Vulkan* vk, bool createFrameBuffer = false, VkExtent2D extent = { 0, 0 }, bool present = true, VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT, int nbFramebuffer = 1);
 
-	int addMesh(Vulkan * vk, std::vector<MeshRender> mesh, std::string vertPath, std::string fragPath, int nbTexture, int frameBufferID = 0);
-	int addMeshInstanced(Vulkan* vk, std::vector<MeshRender> meshes, std::string vertPath, std::string fragPath, int nbTexture);
+	// Les meshes de meme geometrie qui ne different que par leur UBO de matrice model sont fusionnes en un draw instancie
+	// si la variante "...Instanced.spv" du vertex shader existe. Renvoie le pipeline des draws non fusionnes s'il y en a.
+	// Les matrices model (et la couleur) des meshes fusionnes sont copiees dans le buffer d'instances a l'appel :
+	// une mise a jour ulterieure de leur UBO n'a plus d'effet. Les objets animes passent par addMeshInstanced
+	int addMesh(Vulkan * vk, std::vector<MeshRender> mesh, std::string vertPath, std::string fragPath, int nbTexture, int frameBufferID = 0,
+		RenderLayer layer = RENDER_LAYER_OPAQUE);
+	int addMeshInstanced(Vulkan* vk, std::vector<MeshRender> meshes, std::string vertPath, std::string fragPath, int nbTexture,
+		InstanceLayout instanceLayout = INSTANCE_LAYOUT_MODEL);
+	// Comme addMeshInstanced, mais culling et LOD des instances par un compute shader et draws indirects
+	int addMeshIndirect(Vulkan* vk, std::vector<MeshRender> meshes, std::string vertPath, std::string fragPath, int nbTexture);
+	// Declare a l'avance un pipeline que addMesh* demandera avec les memes parametres : les pipelines declares
+	// sont compiles en parallele a partir de PipelineLibrary::compilePreparedPipelines
+	void preparePipeline(Vulkan* vk, std::vector<UboBase*> ubos, std::string vertPath, std::string fragPath, int nbTexture, bool instanced = false,
+		InstanceLayout instanceLayout = INSTANCE_LAYOUT_MODEL);
 	int addText(Vulkan * vk, Text * text);
+	// Sans instanciation automatique, addMesh garde un draw par mesh (benchmark d'enregistrement)
+	void setAutomaticInstancing(bool automaticInstancing) { m_automaticInstancing = automaticInstancing; }
+	// Animation des instances enregistree avant les draws de chaque frame
+	void addInstanceAnimator(InstanceAnimator* instanceAnimator) { m_instanceAnimators.push_back(instanceAnimator); }
 
 	void recordDraw(Vulkan * vk);
+	// Culling, LODs et tri des draws pour la camera courante, reenregistre si besoin
+	void updateDraws(Vulkan* vk, glm::vec3 cameraPosition, glm::mat4 view, glm::mat4 projection);
+	// Remplace les pipelines de la passe qui utilisent l'un des .spv modifies, puis reenregistre
+	void reloadShaders(Vulkan* vk, std::vector<std::string> shaderPaths);
 
 	void drawCall(Vulkan * vk);
 
@@ -37,16 +80,34 @@ public:
 private:
 	void createRenderPass(VkDevice device, VkImageLayout finalLayout);
 	void createColorResources(Vulkan * vk, VkExtent2D extent);
-	VkDescriptorSetLayout createDescriptorSetLayout(VkDevice device, std::vector<UboBase*> uniformBuffers, int nbTexture);
+	VkDescriptorSetLayout createDescriptorSetLayout(Vulkan* vk, std::vector<UboBase*> uniformBuffers, int nbTexture);
+	std::vector<uint64_t> getRenderPassCompatibility();
+	// Sommets, suivis des instances pour les draws instancies
+	static void getVertexInput(bool instanced, InstanceLayout instanceLayout, std::vector<VkVertexInputBindingDescription>& bindingDescription,
+		std::vector<VkVertexInputAttributeDescription>& attributeDescription);
 	void createDescriptorPool(VkDevice device);
 	VkDescriptorSet createDescriptorSet(VkDevice device, VkDescriptorSetLayout decriptorSetLayout, std::vector<VkImageView> imageView,
 		VkSampler sampler, std::vector<UboBase*> uniformBuffers, int nbTexture);
+	std::vector<uint32_t> getUboOffsets(std::vector<UboBase*> uniformBuffers);
+	// Groupes d'au moins deux meshes pouvant etre rendus par un seul draw instancie
+	std::vector<std::vector<int>> findInstancingGroups(Vulkan* vk, std::vector<MeshRender>& meshes, std::string vertPath, int nbTexture);
+	static std::string getInstancedShaderPath(std::string vertPath);
+	void getBoundingSphere(MeshPBR* mesh, Instance* instance, int bucketID, glm::vec3& center, float& radius, float& instanceRadius);
+	// Reconstruit la file de rendu, renvoie true si l'ordre des draws a change
+	bool sortDraws();
+	// Recopie les instances dynamiques de la frame, renvoie true si un nombre d'instances a change
+	bool updateInstances(Vulkan* vk);
+	void buildCulling();
+	void recordSortedDraw(Vulkan * vk);
+	// Compute shaders a executer avant la passe de rendu : animation puis culling des instances
+	bool hasPrePass() { return !m_instanceAnimators.empty() || m_gpuCulling.hasBatches(); }
+	void recordPrePass(VkCommandBuffer commandBuffer, uint32_t frame);
 	void fillCommandBuffer(Vulkan * vk);
 	void drawFrame(Vulkan * vk);
 
 public:
 	VkRenderPass getRenderPass() { return m_renderPass; }
-	FrameBuffer getFrameBuffer(int index) { return m_frameBuffers[index]; }
+	FrameBuffer& getFrameBuffer(int index) { return m_frameBuffers[index]; }
 
 private:
 	bool m_isDestroyed = false;
@@ -56,12 +117,28 @@ private:
 
 	VkRenderPass m_renderPass;
 	VkDescriptorPool m_descriptorPool;
+	std::map<std::vector<uint64_t>, VkDescriptorSetLayout> m_descriptorSetLayoutCache;
+	std::map<std::vector<uint64_t>, VkDescriptorSet> m_descriptorSetCache; // liberes avec le pool
+	uint32_t m_nbDescriptorSetRequests = 0;
 	
 	std::vector<MeshPipeline> m_meshesPipeline;
 
 	std::vector<int> m_textID;
 	Text * m_text = nullptr;
 	std::vector<MeshRender> m_meshes;
+	std::vector<LodDraw> m_lodDraws;
+	std::vector<std::vector<DrawSource>> m_drawSources; // par MeshPipeline et par draw, vide pour le texte
+	RenderQueue m_renderQueue;
+	glm::vec3 m_cameraPosition = glm::vec3(0.0f);
+	FrustumCuller m_frustumCuller;
+	std::vector<uint8_t> m_visibleDraws; // par cullingID, vide tant que rien n'a ete culle
+	bool m_cullingDirty = false;
+
+	GpuCulling m_gpuCulling;
+	std::vector<InstanceAnimator*> m_instanceAnimators;
+	std::vector<int> m_indirectPipelineIDs;
+	std::vector<std::unique_ptr<Instance>> m_generatedInstances; // instanciation automatique de addMesh
+	bool m_automaticInstancing = true;
 
 	Pipeline m_textPipeline;
 	VkDescriptorSetLayout m_textDescriptorSetLayout;
@@ -79,7 +156,7 @@ private:
 
 	VkSampleCountFlagBits m_msaaSamples = VK_SAMPLE_COUNT_1_BIT;
 	VkImage m_colorImage;
-	VkDeviceMemory m_colorImageMemory;
+	Allocation m_colorImageMemory;
 	VkImageView m_colorImageView;
 };
 
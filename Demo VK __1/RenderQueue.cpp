@@ -0,0 +1,50 @@
+#include "RenderQueue.h"
+
+#include <array>
+#include <cstring>
+
+void RenderQueue::sort()
+{
+	if (m_items.size() < 2)
+		return;
+
+	m_sortBuffer.resize(m_items.size());
+	for (int shift(0); shift < 64; shift += 8)
+	{
+		std::array<size_t, 256> offsets = {};
+		for (size_t i(0); i < m_items.size(); ++i)
+			offsets[(m_items[i].sortKey >> shift) & 0xFF]++;
+
+		// Octet identique pour tous les draws (couches, pipelines peu nombreux) : passe inutile
+		if (offsets[(m_items[0].sortKey >> shift) & 0xFF] == m_items.size())
+			continue;
+
+		size_t offset = 0;
+		for (int digit(0); digit < 256; ++digit)
+		{
+			size_t count = offsets[digit];
+			offsets[digit] = offset;
+			offset += count;
+		}
+
+		for (size_t i(0); i < m_items.size(); ++i)
+			m_sortBuffer[offsets[(m_items[i].sortKey >> shift) & 0xFF]++] = m_items[i];
+		m_items.swap(m_sortBuffer);
+	}
+}
+
+uint64_t RenderQueue::makeSortKey(RenderLayer layer, uint32_t pipelineID, uint32_t materialID, uint32_t sequence)
+{
+	return (static_cast<uint64_t>(layer & 0xF) << 60) | (static_cast<uint64_t>(pipelineID & 0xFFF) << 48) |
+		(static_cast<uint64_t>(materialID & 0xFFFF) << 32) | sequence;
+}
+
+uint64_t RenderQueue::makeDepthSortKey(RenderLayer layer, uint32_t pipelineID, uint32_t materialID, float depth)
+{
+	// Les bits d'un float positif sont dans le meme ordre que sa valeur
+	uint32_t depthBits = 0;
+	if (depth > 0.0f)
+		memcpy(&depthBits, &depth, sizeof(depthBits));
+
+	return makeSortKey(layer, pipelineID, materialID, depthBits);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+// Ordre des couches : le skybox passe apres tous les opaques, le texte par-dessus tout
+enum RenderLayer
+{
+	RENDER_LAYER_OPAQUE = 0,
+	RENDER_LAYER_SKYBOX = 1,
+	RENDER_LAYER_OVERLAY = 2
+};
+
+struct DrawItem
+{
+	uint64_t sortKey;
+	uint32_t meshPipelineID;
+	uint32_t drawID;
+};
+
+// Draws d'une passe tries par cle : couche (4 bits), pipeline (12), descriptor set (16) puis profondeur (32).
+// Les opaques sont groupes par etat puis du plus proche au plus lointain pour l'early-z
+class RenderQueue
+{
+public:
+	void clear() { m_items.clear(); }
+	void push(uint64_t sortKey, uint32_t meshPipelineID, uint32_t drawID) { m_items.push_back({ sortKey, meshPipelineID, drawID }); }
+	// Radix sort stable : a cle egale, l'ordre de soumission est garde
+	void sort();
+
+	const std::vector<DrawItem>& getItems() { return m_items; }
+
+	// sequence : ordre de soumission, pour le texte dont l'ordre de blending compte
+	static uint64_t makeSortKey(RenderLayer layer, uint32_t pipelineID, uint32_t materialID, uint32_t sequence);
+	// depth : distance a la camera, les draws proches d'abord
+	static uint64_t makeDepthSortKey(RenderLayer layer, uint32_t pipelineID, uint32_t materialID, float depth);
+
+private:
+	std::vector<DrawItem> m_items;
+	std::vector<DrawItem> m_sortBuffer;
+};
@@ -0,0 +1,321 @@
+#include "ShaderCompiler.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iterator>
+#include <cstdio>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+const std::string SHADER_COMPILE_SCRIPT = "compile.bat";
+const std::string SHADER_CACHE_DIRECTORY = "Cache";
+const uint64_t SHADER_CACHE_VERSION = 1; // a incrementer si les options de compilation changent
+const int SHADER_POLL_INTERVAL_MS = 500;
+
+#ifdef SHADER_RUNTIME_COMPILATION
+// Hash stable d'une execution a l'autre, contrairement a std::hash
+static uint64_t hashFNV1a(const std::string& data, uint64_t hash = 0xcbf29ce484222325ull)
+{
+	for (size_t i(0); i < data.size(); ++i)
+	{
+		hash ^= static_cast<unsigned char>(data[i]);
+		hash *= 0x100000001b3ull;
+	}
+
+	return hash;
+}
+#endif
+
+static bool getFileStat(std::string path, int64_t& time, int64_t& size)
+{
+	struct stat fileStat;
+	if (stat(path.c_str(), &fileStat) != 0)
+		return false;
+
+	time = static_cast<int64_t>(fileStat.st_mtime);
+	size = static_cast<int64_t>(fileStat.st_size);
+
+	return true;
+}
+
+bool ShaderCompiler::isAvailable()
+{
+#ifdef SHADER_RUNTIME_COMPILATION
+	return true;
+#else
+	return false;
+#endif
+}
+
+void ShaderCompiler::initialize(std::string shaderDirectory)
+{
+	m_shaderDirectory = shaderDirectory;
+	m_cacheDirectory = shaderDirectory + "/" + SHADER_CACHE_DIRECTORY;
+	m_lastPoll = std::chrono::steady_clock::now();
+
+	parseCompileScript(shaderDirectory + "/" + SHADER_COMPILE_SCRIPT);
+
+#ifdef SHADER_RUNTIME_COMPILATION
+#ifdef _WIN32
+	_mkdir(m_cacheDirectory.c_str());
+#else
+	mkdir(m_cacheDirectory.c_str(), 0755);
+#endif
+	m_compiler = shaderc_compiler_initialize();
+	if (m_compiler == nullptr)
+		throw std::runtime_error("Erreur : initialisation de shaderc");
+#endif
+}
+
+void ShaderCompiler::cleanup()
+{
+#ifdef SHADER_RUNTIME_COMPILATION
+#ifndef NDEBUG
+	std::cout << "[Shaders] " << m_statistics.nbCompilations << " compilations GLSL en " << m_statistics.compileTime << " ms, " << m_statistics.nbCacheHits
+		<< " relus du cache, " << m_statistics.nbErrors << " erreurs" << std::endl;
+#endif
+	if (m_compiler != nullptr)
+		shaderc_compiler_release(m_compiler);
+	m_compiler = nullptr;
+#endif
+	m_shaders.clear();
+}
+
+std::string ShaderCompiler::getSpirvPath(std::string spvPath)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	auto it = m_shaders.find(spvPath);
+	if (it == m_shaders.end())
+		return spvPath;
+
+	// Deja en cours de compilation par un autre thread : meme resultat
+	m_compiledCondition.wait(lock, [this, &spvPath]() { return m_compilingShaders.count(spvPath) == 0; });
+
+	Shader& shader = it->second;
+	if (!shader.spirvPath.empty())
+		return shader.spirvPath;
+
+	getFileStat(shader.sourcePath, shader.sourceTime, shader.sourceSize);
+
+#ifdef SHADER_RUNTIME_COMPILATION
+	// shaderc hors du verrou : les autres shaders se compilent en parallele
+	Shader compiledShader = shader;
+	m_compilingShaders.insert(spvPath);
+	lock.unlock();
+	std::string spirvPath = compile(spvPath, compiledShader);
+	lock.lock();
+	m_compilingShaders.erase(spvPath);
+	m_compiledCondition.notify_all();
+
+	shader.spirvPath = spirvPath.empty() ? spvPath : spirvPath; // le .spv livre en attendant une source qui compile
+#else
+	shader.spirvPath = spvPath;
+#ifndef NDEBUG
+	int64_t spvTime, spvSize;
+	if (getFileStat(spvPath, spvTime, spvSize) && spvTime < shader.sourceTime)
+		std::cout << "[Shaders] " << spvPath << " est plus ancien que " << shader.sourcePath << " : relancer compile.bat" << std::endl;
+#endif
+#endif
+
+	return shader.spirvPath;
+}
+
+bool ShaderCompiler::hasShader(std::string spvPath)
+{
+	int64_t time, size;
+#ifdef SHADER_RUNTIME_COMPILATION
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_shaders.find(spvPath);
+		if (it != m_shaders.end() && getFileStat(it->second.sourcePath, time, size))
+			return true;
+	}
+#endif
+
+	return getFileStat(spvPath, time, size);
+}
+
+std::vector<std::string> ShaderCompiler::poll()
+{
+	std::vector<std::string> changedShaders;
+#ifdef SHADER_RUNTIME_COMPILATION
+	auto currentTime = std::chrono::steady_clock::now();
+	if (std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - m_lastPoll).count() < SHADER_POLL_INTERVAL_MS)
+		return changedShaders;
+	m_lastPoll = currentTime;
+
+	std::vector<std::pair<std::string, Shader>> modifiedShaders;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto it = m_shaders.begin(); it != m_shaders.end(); ++it)
+		{
+			Shader& shader = it->second;
+			int64_t sourceTime, sourceSize;
+			// Jamais charge : il sera compile a sa premiere utilisation
+			if (shader.spirvPath.empty() || !getFileStat(shader.sourcePath, sourceTime, sourceSize) ||
+				(sourceTime == shader.sourceTime && sourceSize == shader.sourceSize))
+				continue;
+
+			shader.sourceTime = sourceTime;
+			shader.sourceSize = sourceSize;
+			modifiedShaders.push_back({ it->first, shader });
+		}
+	}
+
+	for (int i(0); i < modifiedShaders.size(); ++i)
+	{
+		// En cas d'erreur, l'ancien SPIR-V reste en place jusqu'a la prochaine modification
+		std::string spirvPath = compile(modifiedShaders[i].first, modifiedShaders[i].second);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Shader& shader = m_shaders[modifiedShaders[i].first];
+		if (spirvPath.empty() || spirvPath == shader.spirvPath)
+			continue;
+
+		shader.spirvPath = spirvPath;
+		changedShaders.push_back(modifiedShaders[i].first);
+#ifndef NDEBUG
+		std::cout << "[Shaders] " << shader.sourcePath << " recompile" << std::endl;
+#endif
+	}
+#endif
+
+	return changedShaders;
+}
+
+void ShaderCompiler::parseCompileScript(std::string scriptPath)
+{
+	std::ifstream file(scriptPath);
+	if (!file.is_open())
+		return;
+
+	// Lignes "glslangValidator.exe -V [-DNOM[=VALEUR]] source [-o sortie]"
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream tokens(line);
+		std::vector<std::string> arguments;
+		std::string token;
+		while (tokens >> token)
+			arguments.push_back(token);
+		if (arguments.empty() || arguments[0].find("glslangValidator") == std::string::npos)
+			continue;
+
+		Shader shader;
+		std::string output;
+		for (size_t i(1); i < arguments.size(); ++i)
+		{
+			if (arguments[i] == "-o" && i + 1 < arguments.size())
+				output = arguments[++i];
+			else if (arguments[i].compare(0, 2, "-D") == 0 && arguments[i].size() > 2)
+				shader.defines.push_back(arguments[i].substr(2));
+			else if (arguments[i][0] != '-')
+				shader.sourcePath = arguments[i];
+		}
+
+		size_t extension = shader.sourcePath.find_last_of('.');
+		if (extension == std::string::npos)
+			continue;
+		shader.stage = shader.sourcePath.substr(extension + 1);
+		if (output.empty())
+			output = shader.stage + ".spv"; // nom par defaut de glslangValidator
+
+		shader.sourcePath = m_shaderDirectory + "/" + shader.sourcePath;
+		m_shaders[m_shaderDirectory + "/" + output] = shader;
+	}
+}
+
+std::string ShaderCompiler::compile(std::string spvPath, const Shader& shader)
+{
+#ifdef SHADER_RUNTIME_COMPILATION
+	std::ifstream sourceFile(shader.sourcePath, std::ios::binary);
+	if (!sourceFile.is_open())
+		return std::string();
+	std::string source((std::istreambuf_iterator<char>(sourceFile)), std::istreambuf_iterator<char>());
+
+	// Meme source, memes defines, meme etape : meme SPIR-V
+	uint64_t hash = hashFNV1a(std::to_string(SHADER_CACHE_VERSION) + shader.stage);
+	for (int i(0); i < shader.defines.size(); ++i)
+		hash = hashFNV1a("-D" + shader.defines[i], hash);
+	hash = hashFNV1a(source, hash);
+
+	std::string name = spvPath.substr(spvPath.find_last_of('/') + 1);
+	name = name.substr(0, name.find_last_of('.'));
+	std::ostringstream cachePath;
+	cachePath << m_cacheDirectory << "/" << name << "_" << std::hex << std::setw(16) << std::setfill('0') << hash << ".spv";
+
+	if (std::ifstream(cachePath.str(), std::ios::binary).good())
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_statistics.nbCacheHits++;
+		return cachePath.str();
+	}
+
+	shaderc_shader_kind kind;
+	if (shader.stage == "vert") kind = shaderc_glsl_vertex_shader;
+	else if (shader.stage == "frag") kind = shaderc_glsl_fragment_shader;
+	else if (shader.stage == "comp") kind = shaderc_glsl_compute_shader;
+	else if (shader.stage == "geom") kind = shaderc_glsl_geometry_shader;
+	else if (shader.stage == "tesc") kind = shaderc_glsl_tess_control_shader;
+	else if (shader.stage == "tese") kind = shaderc_glsl_tess_evaluation_shader;
+	else
+		return std::string();
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	// Memes options que glslangValidator -V : Vulkan 1.0, sans optimisation
+	shaderc_compile_options_t options = shaderc_compile_options_initialize();
+	shaderc_compile_options_set_target_env(options, shaderc_target_env_vulkan, shaderc_env_version_vulkan_1_0);
+	for (int i(0); i < shader.defines.size(); ++i)
+	{
+		size_t separator = shader.defines[i].find('=');
+		std::string defineName = shader.defines[i].substr(0, separator);
+		std::string defineValue = separator == std::string::npos ? std::string() : shader.defines[i].substr(separator + 1);
+		shaderc_compile_options_add_macro_definition(options, defineName.c_str(), defineName.size(), defineValue.c_str(), defineValue.size());
+	}
+
+	shaderc_compilation_result_t result = shaderc_compile_into_spv(m_compiler, source.c_str(), source.size(), kind, shader.sourcePath.c_str(), "main", options);
+	shaderc_compile_options_release(options);
+
+	bool compiled = shaderc_result_get_compilation_status(result) == shaderc_compilation_status_success;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_statistics.compileTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+		if (compiled)
+			m_statistics.nbCompilations++;
+		else
+			m_statistics.nbErrors++;
+	}
+
+	if (!compiled)
+	{
+		// Pas d'exception : une faute de frappe pendant l'edition ne doit pas fermer la demo
+		std::cout << "[Shaders] Erreur de compilation de " << shader.sourcePath << " :" << std::endl << shaderc_result_get_error_message(result) << std::endl;
+		shaderc_result_release(result);
+		return std::string();
+	}
+
+	// Ecrit a cote puis renomme : un fichier du cache est toujours complet
+	std::string temporaryPath = cachePath.str() + ".tmp";
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		file.write(shaderc_result_get_bytes(result), shaderc_result_get_length(result));
+	}
+	shaderc_result_release(result);
+
+	if (std::rename(temporaryPath.c_str(), cachePath.str().c_str()) != 0)
+	{
+		std::remove(temporaryPath.c_str());
+		return std::string();
+	}
+
+	return cachePath.str();
+#else
+	return std::string();
+#endif
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+
+#ifdef SHADER_RUNTIME_COMPILATION
+#include <shaderc/shaderc.h>
+#endif
+
+// Sources GLSL des .spv, relues dans Shaders/compile.bat.
+// Compile avec SHADER_RUNTIME_COMPILATION (shaderc) : les sources sont compilees au chargement, le SPIR-V est garde
+// dans Shaders/Cache sous un nom tire du hash de la source et des defines, et poll signale les sources modifiees.
+// Sinon les .spv livres sont utilises tels quels et un .spv plus ancien que sa source est signale en debug
+class ShaderCompiler
+{
+public:
+	struct Statistics
+	{
+		uint32_t nbCompilations = 0;
+		uint32_t nbCacheHits = 0;
+		uint32_t nbErrors = 0;
+		double compileTime = 0.0; // ms
+	};
+
+	static bool isAvailable();
+
+	void initialize(std::string shaderDirectory);
+	void cleanup();
+
+	// SPIR-V a charger pour le .spv demande : compile ou relu du cache si la source est connue,
+	// spvPath si elle ne l'est pas ou ne compile pas. Thread-safe
+	std::string getSpirvPath(std::string spvPath);
+	// Le .spv pourra etre charge : livre sur le disque, ou source connue de compile.bat avec SHADER_RUNTIME_COMPILATION
+	bool hasShader(std::string spvPath);
+	// .spv dont la source a change et compile sans erreur depuis le dernier appel, verifie au plus toutes les SHADER_POLL_INTERVAL_MS
+	std::vector<std::string> poll();
+
+	Statistics getStatistics() { return m_statistics; }
+
+private:
+	struct Shader
+	{
+		std::string sourcePath;
+		std::string stage; // extension de la source : vert, frag, comp...
+		std::vector<std::string> defines; // NOM ou NOM=VALEUR
+		std::string spirvPath; // SPIR-V utilise, vide tant qu'il n'a pas ete demande
+		int64_t sourceTime = 0;
+		int64_t sourceSize = 0;
+	};
+
+	void parseCompileScript(std::string scriptPath);
+	// Nouveau chemin du SPIR-V de shader, vide si la compilation echoue. Appele sans m_mutex
+	std::string compile(std::string spvPath, const Shader& shader);
+
+private:
+	std::string m_shaderDirectory;
+	std::string m_cacheDirectory;
+
+	std::mutex m_mutex;
+	std::map<std::string, Shader> m_shaders; // par .spv
+	std::set<std::string> m_compilingShaders; // compiles hors du verrou par getSpirvPath
+	std::condition_variable m_compiledCondition;
+	std::chrono::steady_clock::time_point m_lastPoll;
+#ifdef SHADER_RUNTIME_COMPILATION
+	shaderc_compiler_t m_compiler = nullptr;
+#endif
+
+	Statistics m_statistics;
+};
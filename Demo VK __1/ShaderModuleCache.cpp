@@ -0,0 +1,259 @@
+#include "ShaderModuleCache.h"
+
+#include "ShaderCompiler.h"
+
+#include <iostream>
+#include <chrono>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+const uint32_t SPIRV_MAGIC = 0x07230203;
+const size_t SPIRV_HEADER_SIZE = 5 * sizeof(uint32_t);
+
+VkShaderModule ShaderModuleCache::acquire(VkDevice device, std::string path)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_statistics.nbRequests++;
+
+	// Deux pipelines compiles en parallele ne chargent pas deux fois le meme fichier
+	m_loadedCondition.wait(lock, [this, &path]() { return m_loadingPaths.find(path) == m_loadingPaths.end(); });
+
+	auto it = m_shaderModules.find(path);
+	if (it != m_shaderModules.end())
+	{
+		it->second.nbReferences++;
+		return it->second.shaderModule;
+	}
+
+	// Hors du verrou : la compilation GLSL et la lecture d'un fichier ne bloquent pas les autres shaders
+	m_loadingPaths[path] = false;
+	lock.unlock();
+
+	auto startTime = std::chrono::high_resolution_clock::now();
+	size_t size = 0;
+	VkShaderModule shaderModule;
+	try
+	{
+		shaderModule = load(device, m_shaderCompiler != nullptr ? m_shaderCompiler->getSpirvPath(path) : path, size);
+	}
+	catch (...)
+	{
+		lock.lock();
+		m_loadingPaths.erase(path);
+		m_loadedCondition.notify_all();
+		throw;
+	}
+	double loadTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+
+	lock.lock();
+	m_statistics.loadTime += loadTime;
+	m_statistics.nbLoads++;
+	m_statistics.nbLoadedBytes += size;
+
+	// Invalide pendant le chargement : le SPIR-V lu est peut-etre l'ancien, le prochain acquire relira le fichier
+	if (m_loadingPaths[path])
+		m_staleModules.push_back({ shaderModule, 1 });
+	else
+		m_shaderModules[path] = { shaderModule, 1 };
+	m_loadingPaths.erase(path);
+	m_loadedCondition.notify_all();
+
+	return shaderModule;
+}
+
+void ShaderModuleCache::release(VkShaderModule shaderModule)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto& entry : m_shaderModules)
+	{
+		if (entry.second.shaderModule == shaderModule)
+		{
+			if (entry.second.nbReferences == 0)
+				throw std::runtime_error("Erreur : shader module rendu plus de fois qu'acquis : " + entry.first);
+			entry.second.nbReferences--;
+			return;
+		}
+	}
+	for (int i(0); i < m_staleModules.size(); ++i)
+	{
+		if (m_staleModules[i].shaderModule == shaderModule && m_staleModules[i].nbReferences > 0)
+		{
+			m_staleModules[i].nbReferences--;
+			return;
+		}
+	}
+
+	throw std::runtime_error("Erreur : shader module inconnu du cache");
+}
+
+bool ShaderModuleCache::invalidate(VkDevice device, std::string path)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// Anciennes versions rendues depuis le dernier invalidate
+	for (int i(0); i < m_staleModules.size(); )
+	{
+		if (m_staleModules[i].nbReferences > 0)
+		{
+			++i;
+			continue;
+		}
+		vkDestroyShaderModule(device, m_staleModules[i].shaderModule, nullptr);
+		m_staleModules.erase(m_staleModules.begin() + i);
+	}
+
+	auto loading = m_loadingPaths.find(path);
+	if (loading != m_loadingPaths.end())
+	{
+		loading->second = true;
+		return true;
+	}
+
+	auto it = m_shaderModules.find(path);
+	if (it == m_shaderModules.end())
+		return false;
+
+	if (it->second.nbReferences > 0)
+		m_staleModules.push_back(it->second);
+	else
+		vkDestroyShaderModule(device, it->second.shaderModule, nullptr);
+	m_shaderModules.erase(it);
+
+	return true;
+}
+
+void ShaderModuleCache::cleanup(VkDevice device)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+#ifndef NDEBUG
+	if (m_statistics.nbRequests > 0)
+		std::cout << "[Shaders] " << m_statistics.nbLoads << " modules charges (" << m_statistics.nbLoadedBytes << " octets, " << m_statistics.loadTime
+			<< " ms) pour " << m_statistics.nbRequests << " demandes" << std::endl;
+#endif
+
+	for (auto& entry : m_shaderModules)
+	{
+#ifndef NDEBUG
+		if (entry.second.nbReferences > 0)
+			std::cout << "[Shaders] " << entry.first << " encore utilise " << entry.second.nbReferences << " fois a la destruction" << std::endl;
+#endif
+		vkDestroyShaderModule(device, entry.second.shaderModule, nullptr);
+	}
+	m_shaderModules.clear();
+
+	for (int i(0); i < m_staleModules.size(); ++i)
+		vkDestroyShaderModule(device, m_staleModules[i].shaderModule, nullptr);
+	m_staleModules.clear();
+}
+
+VkShaderModule ShaderModuleCache::load(VkDevice device, std::string path, size_t& size)
+{
+	// Projection du fichier : pas de copie intermediaire, le pilote lit directement les pages du fichier
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("Erreur lors de l'ouverture du fichier : " + path);
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file, &fileSize);
+	size = static_cast<size_t>(fileSize.QuadPart);
+	if (size < SPIRV_HEADER_SIZE)
+	{
+		CloseHandle(file);
+		throw std::runtime_error("Erreur : SPIR-V invalide (fichier trop petit) : " + path);
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	const void* data = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (data == nullptr)
+	{
+		if (mapping != nullptr)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		throw std::runtime_error("Erreur : projection en memoire du fichier : " + path);
+	}
+#else
+	int file = open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		throw std::runtime_error("Erreur lors de l'ouverture du fichier : " + path);
+
+	struct stat fileStat;
+	fstat(file, &fileStat);
+	size = static_cast<size_t>(fileStat.st_size);
+	if (size < SPIRV_HEADER_SIZE)
+	{
+		close(file);
+		throw std::runtime_error("Erreur : SPIR-V invalide (fichier trop petit) : " + path);
+	}
+
+	void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file);
+	if (data == MAP_FAILED)
+		throw std::runtime_error("Erreur : projection en memoire du fichier : " + path);
+#endif
+
+	VkShaderModule shaderModule = VK_NULL_HANDLE;
+	bool created = false;
+	std::string error;
+	try
+	{
+		// Debut de page : l'alignement sur 4 octets demande par pCode est garanti
+		checkSpirv(static_cast<const uint32_t*>(data), size, path);
+
+		VkShaderModuleCreateInfo createInfo = {};
+		createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+		createInfo.codeSize = size;
+		createInfo.pCode = static_cast<const uint32_t*>(data);
+
+		created = vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) == VK_SUCCESS;
+		if (!created)
+			error = "Erreur : shader module : " + path;
+	}
+	catch (const std::exception& e)
+	{
+		error = e.what();
+	}
+
+#ifdef _WIN32
+	UnmapViewOfFile(data);
+	CloseHandle(mapping);
+	CloseHandle(file);
+#else
+	munmap(data, size);
+#endif
+
+	if (!created)
+		throw std::runtime_error(error);
+
+	return shaderModule;
+}
+
+void ShaderModuleCache::checkSpirv(const uint32_t* code, size_t size, std::string path)
+{
+	if (size % sizeof(uint32_t) != 0)
+		throw std::runtime_error("Erreur : SPIR-V invalide (taille non multiple de 4) : " + path);
+	if (code[0] != SPIRV_MAGIC)
+		throw std::runtime_error("Erreur : SPIR-V invalide (nombre magique) : " + path);
+
+	// Version 0x00MMmm00 : SPIR-V 1.0 a 1.6
+	uint32_t version = code[1];
+	uint32_t major = (version >> 16) & 0xFF;
+	uint32_t minor = (version >> 8) & 0xFF;
+	if ((version & 0xFF0000FF) != 0 || major != 1 || minor > 6)
+		throw std::runtime_error("Erreur : SPIR-V invalide (version) : " + path);
+
+	// code[2] : generateur, libre. Borne des identifiants non nulle et schema reserve a 0
+	if (code[3] == 0 || code[4] != 0)
+		throw std::runtime_error("Erreur : SPIR-V invalide (en-tete) : " + path);
+}
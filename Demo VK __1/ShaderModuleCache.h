@@ -0,0 +1,76 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <string>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+class ShaderCompiler;
+
+// Modules SPIR-V partages par tous les pipelines : chaque fichier est projete en memoire, verifie
+// et compile en VkShaderModule une seule fois pour le device. Les modules inutilises restent en cache
+// jusqu'a invalidate ou cleanup, les recreations ne relisent donc pas le disque
+class ShaderModuleCache
+{
+public:
+	struct Statistics
+	{
+		uint32_t nbRequests = 0;
+		uint32_t nbLoads = 0;
+		uint64_t nbLoadedBytes = 0;
+		double loadTime = 0.0; // ms, projection, verification et vkCreateShaderModule
+	};
+
+	// Acquiert le module a la construction et le rend a la destruction, meme si une exception est levee entre les deux
+	class Reference
+	{
+	public:
+		Reference(ShaderModuleCache* shaderModuleCache, VkDevice device, std::string path) :
+			m_shaderModuleCache(shaderModuleCache), m_shaderModule(shaderModuleCache->acquire(device, path)) {}
+		~Reference() { m_shaderModuleCache->release(m_shaderModule); }
+		Reference(const Reference&) = delete;
+		Reference& operator=(const Reference&) = delete;
+
+		VkShaderModule get() { return m_shaderModule; }
+
+	private:
+		ShaderModuleCache* m_shaderModuleCache;
+		VkShaderModule m_shaderModule;
+	};
+
+	// Thread-safe, chaque acquire doit etre suivi d'un release (voir Reference)
+	VkShaderModule acquire(VkDevice device, std::string path);
+	void release(VkShaderModule shaderModule);
+	// Le prochain acquire relira le fichier. Un module encore utilise (pipeline en cours de creation) n'est detruit
+	// qu'une fois rendu, par un invalidate suivant ou cleanup. Renvoie false si le fichier n'etait pas en cache
+	bool invalidate(VkDevice device, std::string path);
+	void cleanup(VkDevice device);
+
+	// Les .spv demandes sont alors traduits en SPIR-V compile depuis leur source
+	void setShaderCompiler(ShaderCompiler* shaderCompiler) { m_shaderCompiler = shaderCompiler; }
+
+	Statistics getStatistics() { return m_statistics; }
+
+private:
+	struct ShaderModule
+	{
+		VkShaderModule shaderModule;
+		uint32_t nbReferences;
+	};
+
+	static VkShaderModule load(VkDevice device, std::string path, size_t& size);
+	static void checkSpirv(const uint32_t* code, size_t size, std::string path);
+
+private:
+	std::mutex m_mutex;
+	std::map<std::string, ShaderModule> m_shaderModules; // par .spv demande
+	std::vector<ShaderModule> m_staleModules; // invalides mais encore utilises
+	std::map<std::string, bool> m_loadingPaths; // charges hors du verrou par un thread, true si invalides entre-temps
+	std::condition_variable m_loadedCondition;
+	ShaderCompiler* m_shaderCompiler = nullptr;
+	Statistics m_statistics;
+};
@@ -1,3 +1,19 @@
 C:\VulkanSDK\1.1.108.0\Bin\glslangValidator.exe -V shader.vert
 C:\VulkanSDK\1.1.108.0\Bin\glslangValidator.exe -V shader.frag
+C:\VulkanSDK\1.1.108.0\Bin\glslangValidator.exe -V cullInstances.comp -o compCullInstances.spv
+C:\VulkanSDK\1.1.108.0\Bin\glslangValidator.exe -V pbrCompact.vert -o vertPBRCompact.spv
+C:\VulkanSDK\1.1.108.0\Bin\glslangValidator.exe -V animateInstances.comp -o compAnimateInstances.spv
+C:\VulkanSDK\1.1.108.0\Bin\glslangValidator.exe -V shaderSphereInstanced.vert -o vertSphereInstanced.spv
+C:\VulkanSDK\1.1.108.0\Bin\glslangValidator.exe -V pbr.vert -o vertPBR.spv
+C:\VulkanSDK\1.1.108.0\Bin\glslangValidator.exe -V pbr.frag -o fragPBR.spv
+C:\VulkanSDK\1.1.108.0\Bin\glslangValidator.exe -V shaderSphere.vert -o vertSphere.spv
+C:\VulkanSDK\1.1.108.0\Bin\glslangValidator.exe -V shaderSphere.frag -o fragSphere.spv
+C:\VulkanSDK\1.1.108.0\Bin\glslangValidator.exe -V skybox.vert -o vertSkybox.spv
+C:\VulkanSDK\1.1.108.0\Bin\glslangValidator.exe -V skybox.frag -o fragSkybox.spv
+C:\VulkanSDK\1.1.108.0\Bin\glslangValidator.exe -V brdfLUT.vert -o vertBrdfLUT.spv
+C:\VulkanSDK\1.1.108.0\Bin\glslangValidator.exe -V brdfLUT.frag -o fragBrdfLUT.spv
+C:\VulkanSDK\1.1.108.0\Bin\glslangValidator.exe -V convolution.vert -o vertConvolution.spv
+C:\VulkanSDK\1.1.108.0\Bin\glslangValidator.exe -V convolution.frag -o fragConvolution.spv
+C:\VulkanSDK\1.1.108.0\Bin\glslangValidator.exe -V cubemapCreation.vert -o vertCubemapCreation.spv
+C:\VulkanSDK\1.1.108.0\Bin\glslangValidator.exe -V cubemapCreation.frag -o fragCubemapCreation.spv
 pause
\ No newline at end of file
@@ -0,0 +1,52 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// pbr.vert avec des instances au format CompactInstance
+
+layout(binding = 0) uniform UniformBufferObjectVP
+{
+    mat4 view;
+    mat4 proj;
+} uboVP;
+
+// Per vertex
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec3 inTangent;
+layout(location = 3) in vec2 inTexCoord;
+
+// Per instance
+layout(location = 4) in vec4 inTransform0;
+layout(location = 5) in vec4 inTransform1;
+layout(location = 6) in vec4 inTransform2;
+layout(location = 7) in vec4 inAlbedo;
+layout(location = 8) in vec2 inRoughnessMetallic;
+
+// Out
+layout(location = 0) out vec3 worldPos;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) out vec3 normal;
+
+layout(location = 5) out vec3 outAlbedo;
+layout(location = 6) out float outRoughness;
+layout(location = 7) out float outMetal;
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+void main() {
+    // Lignes de la transformation affine
+    mat4 model = transpose(mat4(inTransform0, inTransform1, inTransform2, vec4(0.0, 0.0, 0.0, 1.0)));
+
+    worldPos = vec3(model * vec4(inPosition, 1.0));
+    gl_Position = uboVP.proj * uboVP.view * vec4(worldPos, 1.0);
+
+    normal = transpose(inverse(mat3(model))) * inNormal;
+    fragTexCoord = inTexCoord;
+
+    outAlbedo = inAlbedo.rgb;
+    outRoughness = inRoughnessMetallic.x;
+    outMetal = inRoughnessMetallic.y;
+}
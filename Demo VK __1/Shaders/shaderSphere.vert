@@ -4,6 +4,7 @@
 layout(binding = 0) uniform UniformBufferObjectModel
 {
     mat4 model;
+    vec4 color;
 } uboModel;
 
 layout(binding = 1) uniform UniformBufferObjectVP
@@ -27,5 +28,5 @@ out gl_PerVertex
 void main() {
     gl_Position = uboVP.proj * uboVP.view * uboModel.model * vec4(inPosition, 1.0);
 	
-	outColor = inNormal;
+	outColor = uboModel.color.rgb;
 }
\ No newline at end of file
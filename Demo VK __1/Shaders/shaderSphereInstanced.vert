@@ -0,0 +1,33 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Variante instanciee de shaderSphere.vert : la matrice model vient du buffer d'instances
+// genere par RenderPass::addMesh, le binding 0 reste dans le layout mais n'est plus lu
+layout(binding = 1) uniform UniformBufferObjectVP
+{
+    mat4 view;
+    mat4 proj;
+} uboVP;
+
+// Per vertex
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 2) in vec3 inTangent;
+layout(location = 3) in vec2 inTexCoord;
+
+// Per instance
+layout(location = 4) in mat4 model;
+layout(location = 8) in vec3 inColor; // albedo de ModelInstance : couleur de la lumiere
+
+layout(location = 0) out vec3 outColor;
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+void main() {
+    gl_Position = uboVP.proj * uboVP.view * model * vec4(inPosition, 1.0);
+	
+	outColor = inColor;
+}
@@ -0,0 +1,185 @@
+#include "StagingRing.h"
+
+#include "Vulkan.h"
+
+void StagingRing::initialize(Vulkan* vk, VkDeviceSize capacity)
+{
+	vk->createBuffer(capacity, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_buffer, m_memory);
+	m_capacity = capacity;
+	m_head = 0;
+}
+
+void StagingRing::cleanup(VkDevice device)
+{
+	while (!m_submits.empty())
+	{
+		wait(device, m_submits.front().fence);
+		reclaim(device);
+	}
+	for (int i(0); i < m_unsubmittedOversized.size(); ++i)
+	{
+		vkDestroyBuffer(device, m_unsubmittedOversized[i].buffer, nullptr);
+		m_unsubmittedOversized[i].memory.free();
+	}
+	m_unsubmittedOversized.clear();
+	m_ranges.clear();
+	m_nbUnsubmittedRanges = 0;
+
+	for (int i(0); i < m_freeFences.size(); ++i)
+		vkDestroyFence(device, m_freeFences[i], nullptr);
+	m_freeFences.clear();
+	for (int i(0); i < m_freeSemaphores.size(); ++i)
+		vkDestroySemaphore(device, m_freeSemaphores[i], nullptr);
+	m_freeSemaphores.clear();
+
+	vkDestroyBuffer(device, m_buffer, nullptr);
+	m_memory.free();
+}
+
+StagingSlice StagingRing::allocate(Vulkan* vk, VkDeviceSize size, VkDeviceSize alignment)
+{
+	StagingSlice slice;
+	slice.size = size;
+
+	// Les tres grosses images (HDR) passeraient a peine dans l'anneau : buffer dedie
+	if (size > m_capacity / 2)
+	{
+		Oversized oversized;
+		vk->createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, oversized.buffer, oversized.memory);
+		// Avant le deplacement, qui remet memory.mapped a nullptr
+		slice.buffer = oversized.buffer;
+		slice.data = oversized.memory.mapped;
+		m_unsubmittedOversized.push_back(std::move(oversized));
+		return slice;
+	}
+
+	VkDeviceSize offset;
+	while (!tryAllocate(std::max<VkDeviceSize>(size, 1), alignment, offset))
+	{
+		if (m_submits.empty() && m_flushCallback)
+			m_flushCallback();
+		if (m_submits.empty())
+			throw std::runtime_error("Erreur : staging ring plein, les copies en attente doivent etre soumises");
+
+		wait(vk->getDevice(), m_submits.front().fence);
+		reclaim(vk->getDevice());
+	}
+
+	slice.buffer = m_buffer;
+	slice.offset = offset;
+	slice.data = static_cast<char*>(m_memory.mapped) + offset;
+	return slice;
+}
+
+VkFence StagingRing::submit(VkDevice device, std::vector<std::pair<VkCommandPool, VkCommandBuffer>> commandBuffers, VkSemaphore semaphore)
+{
+	VkFence fence;
+	if (!m_freeFences.empty())
+	{
+		fence = m_freeFences.back();
+		m_freeFences.pop_back();
+	}
+	else
+	{
+		VkFenceCreateInfo fenceInfo = {};
+		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+		if (vkCreateFence(device, &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+			throw std::runtime_error("Erreur : creation d'une fence");
+	}
+
+	Submit submit;
+	submit.fence = fence;
+	submit.nbRanges = m_nbUnsubmittedRanges;
+	submit.oversized.swap(m_unsubmittedOversized);
+	submit.commandBuffers.swap(commandBuffers);
+	submit.semaphore = semaphore;
+	m_submits.push_back(std::move(submit));
+	m_nbUnsubmittedRanges = 0;
+
+	return fence;
+}
+
+VkSemaphore StagingRing::getSemaphore(VkDevice device)
+{
+	VkSemaphore semaphore;
+	if (!m_freeSemaphores.empty())
+	{
+		semaphore = m_freeSemaphores.back();
+		m_freeSemaphores.pop_back();
+		return semaphore;
+	}
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS)
+		throw std::runtime_error("Erreur : creation d'un semaphore");
+
+	return semaphore;
+}
+
+void StagingRing::reclaim(VkDevice device)
+{
+	while (!m_submits.empty() && vkGetFenceStatus(device, m_submits.front().fence) == VK_SUCCESS)
+	{
+		release(device, m_submits.front());
+		m_submits.pop_front();
+	}
+}
+
+void StagingRing::wait(VkDevice device, VkFence fence)
+{
+	vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+}
+
+bool StagingRing::tryAllocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset)
+{
+	if (m_ranges.empty())
+		m_head = 0;
+
+	VkDeviceSize alignedHead = (m_head + alignment - 1) / alignment * alignment;
+	if (m_ranges.empty() || m_head > m_ranges.front().begin)
+	{
+		// Libre : [head, capacite) puis [0, debut de la plus ancienne tranche)
+		if (alignedHead + size <= m_capacity)
+			offset = alignedHead;
+		else if (!m_ranges.empty() && size <= m_ranges.front().begin)
+			offset = 0;
+		else
+			return false;
+	}
+	else
+	{
+		// L'anneau a deja fait le tour : libre entre head et la plus ancienne tranche
+		if (m_head == m_ranges.front().begin || alignedHead + size > m_ranges.front().begin)
+			return false;
+		offset = alignedHead;
+	}
+
+	m_ranges.push_back({ offset, offset + size });
+	m_nbUnsubmittedRanges++;
+	m_head = offset + size;
+
+	return true;
+}
+
+void StagingRing::release(VkDevice device, Submit& submit)
+{
+	for (size_t i(0); i < submit.nbRanges; ++i)
+		m_ranges.pop_front();
+
+	for (int i(0); i < submit.oversized.size(); ++i)
+	{
+		vkDestroyBuffer(device, submit.oversized[i].buffer, nullptr);
+		submit.oversized[i].memory.free();
+	}
+
+	for (int i(0); i < submit.commandBuffers.size(); ++i)
+		vkFreeCommandBuffers(device, submit.commandBuffers[i].first, 1, &submit.commandBuffers[i].second);
+
+	// La soumission graphique qui attendait ce semaphore est terminee : il est de nouveau non signale
+	if (submit.semaphore != VK_NULL_HANDLE)
+		m_freeSemaphores.push_back(submit.semaphore);
+
+	vkResetFences(device, 1, &submit.fence);
+	m_freeFences.push_back(submit.fence);
+}
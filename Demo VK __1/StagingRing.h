@@ -0,0 +1,82 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+#include <deque>
+#include <functional>
+#include <utility>
+
+#include "MemoryAllocator.h"
+
+class Vulkan;
+
+// Zone d'ecriture dans le staging buffer, valide jusqu'a la fin de la soumission qui la lit
+struct StagingSlice
+{
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0; // srcOffset / bufferOffset des copies
+	VkDeviceSize size = 0;
+	void* data = nullptr;
+};
+
+// Staging buffer unique mappe en permanence, utilise comme un anneau.
+// Les tranches sont rendues quand la fence de la soumission qui les lit est signalee
+class StagingRing
+{
+public:
+	void initialize(Vulkan* vk, VkDeviceSize capacity);
+	void cleanup(VkDevice device);
+
+	StagingSlice allocate(Vulkan* vk, VkDeviceSize size, VkDeviceSize alignment = 16);
+	// Fence a passer a vkQueueSubmit : elle protege toutes les tranches allouees depuis le dernier appel.
+	// Les command buffers et le semaphore eventuels sont rendus en meme temps que les tranches
+	VkFence submit(VkDevice device, std::vector<std::pair<VkCommandPool, VkCommandBuffer>> commandBuffers = {}, VkSemaphore semaphore = VK_NULL_HANDLE);
+	// Semaphore entre la file de transfert et la file graphique, a passer ensuite a submit
+	VkSemaphore getSemaphore(VkDevice device);
+	void reclaim(VkDevice device);
+	void wait(VkDevice device, VkFence fence);
+
+	// Appele quand l'anneau est plein de tranches pas encore soumises (lot de copies en cours)
+	void setFlushCallback(std::function<void()> flushCallback) { m_flushCallback = flushCallback; }
+
+private:
+	struct Range
+	{
+		VkDeviceSize begin;
+		VkDeviceSize end;
+	};
+	// Tranche trop grande pour l'anneau : buffer temporaire
+	struct Oversized
+	{
+		VkBuffer buffer;
+		Allocation memory;
+	};
+	struct Submit
+	{
+		VkFence fence;
+		size_t nbRanges;
+		std::vector<Oversized> oversized;
+		std::vector<std::pair<VkCommandPool, VkCommandBuffer>> commandBuffers;
+		VkSemaphore semaphore;
+	};
+
+	bool tryAllocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize& offset);
+	void release(VkDevice device, Submit& submit);
+
+private:
+	VkBuffer m_buffer = VK_NULL_HANDLE;
+	Allocation m_memory;
+	VkDeviceSize m_capacity = 0;
+	VkDeviceSize m_head = 0;
+
+	std::deque<Range> m_ranges; // de la plus ancienne a la plus recente
+	size_t m_nbUnsubmittedRanges = 0;
+	std::vector<Oversized> m_unsubmittedOversized;
+	std::deque<Submit> m_submits;
+	std::vector<VkFence> m_freeFences;
+	std::vector<VkSemaphore> m_freeSemaphores;
+
+	std::function<void()> m_flushCallback;
+};
@@ -21,6 +21,9 @@ bool System::mainLoop()
 		glfwPollEvents();
 		m_camera.update(m_vk.GetWindow());
 
+		// Les UBO de cette frame ne sont plus lus par le GPU une fois sa fence passee
+		m_vk.beginFrame();
+
 		m_uboVPData.view = m_camera.getViewMatrix();
 		m_uboVP.update(&m_vk, m_uboVPData);
 
@@ -37,7 +40,9 @@ bool System::mainLoop()
 		if (std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - m_startTimeFPSCounter).count() > 1000.0f)
 		{
 			std::wstring text = L"FPS : " + std::to_wstring(m_fpsCount);
+			m_vk.beginUploadBatch();
 			m_text.changeText(&m_vk, text, m_fpsCounterTextID);
+			m_vk.endUploadBatch();
 
 			m_fpsCount = 0;
 			m_startTimeFPSCounter = currentTime;
@@ -45,6 +50,13 @@ bool System::mainLoop()
 
 		float time = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - startTime).count() / 1000.0f;
 
+		// Shaders modifies pendant l'execution (SHADER_RUNTIME_COMPILATION)
+		std::vector<std::string> changedShaders = m_vk.pollShaderChanges();
+		if (!changedShaders.empty())
+			m_swapChainRenderPass.reloadShaders(&m_vk, changedShaders);
+
+		m_instanceAnimator.update(&m_vk, time);
+		m_swapChainRenderPass.updateDraws(&m_vk, m_camera.getPosition(), m_uboVPData.view, m_uboVPData.proj);
 		m_swapChainRenderPass.drawCall(&m_vk);
 	}
 
@@ -62,8 +74,17 @@ void System::cleanup()
 
 	m_skybox.cleanup(m_vk.getDevice());
 	m_sphere.cleanup(m_vk.getDevice());
+	m_sphereInstance.cleanup(m_vk.getDevice());
 
 	m_swapChainRenderPass.cleanup(&m_vk);
+	m_instanceAnimator.cleanup(&m_vk);
+	m_animatedSphereInstance.cleanup(m_vk.getDevice());
+
+	m_uboVP.cleanup(m_vk.getDevice());
+	m_uboVPSkybox.cleanup(m_vk.getDevice());
+	m_uboLight.cleanup(m_vk.getDevice());
+	for (int i(0); i < m_uboSpheres.size(); ++i)
+		m_uboSpheres[i].cleanup(m_vk.getDevice());
 
 	m_vk.cleanup();
 }
@@ -83,14 +104,19 @@ void System::create(bool recreate)
 
 void System::createRessources()
 {
+	// Copies regroupees et soumises sans attente apres chaque ressource : le GPU copie pendant que le CPU decode la suivante
+	m_vk.beginUploadBatch();
+
 	m_text.initialize(&m_vk, 48, "Fonts/arial.ttf");
 	m_fpsCounterTextID = m_text.addText(&m_vk, L"FPS : 0", glm::vec2(-0.99f, 0.85f), 0.065f);
+	m_vk.flushUploadBatch();
 
-	m_sphere.loadObj(&m_vk, "Models/sphere.obj");
+	m_sphere.loadObj(&m_vk, "Models/sphere.obj", true, &m_meshRegistry);
 	//m_meshes[0]->loadTextureFromFile(&m_vk, { "Textures/bamboo-wood-semigloss-albedo.png", "Textures/bamboo-wood-semigloss-normal.png",  "Textures/bamboo-wood-semigloss-roughness.png",
 	//	"Textures/bamboo-wood-semigloss-metal.png", "Textures/bamboo-wood-semigloss-ao.png" });
 
-	m_skybox.loadObj(&m_vk, "Models/cube.obj");
+	m_skybox.loadObj(&m_vk, "Models/cube.obj", false, &m_meshRegistry);
+	m_vk.flushUploadBatch();
 	//m_skybox.loadCubemapFromFile(&m_vk, { "Textures/skybox/right.jpg", "Textures/skybox/left.jpg", "Textures/skybox/top.jpg", "Textures/skybox/bottom.jpg", "Textures/skybox/front.jpg",
 	//	"Textures/skybox/back.jpg" });
 	//m_meshes[1]->loadHDRTexture(&m_vk, { "Textures/simons_town_rocks_4k.hdr" });
@@ -100,9 +126,12 @@ void System::createRessources()
 	tempCubemapCreation.initialize(&m_vk, true, { CUBEMAP_SIZE_X, CUBEMAP_SIZE_X }, false, VK_SAMPLE_COUNT_8_BIT, 6);
 
 	MeshPBR tempCube;
-	tempCube.loadObj(&m_vk, "Models/cube.obj");
+	tempCube.loadObj(&m_vk, "Models/cube.obj", false, &m_meshRegistry);
 	tempCube.loadHDRTexture(&m_vk, { "Textures/simons_town_rocks_4k.hdr" });
 
+	// Les passes suivantes lisent et detruisent des images : plus de copies differees
+	m_vk.endUploadBatch();
+
 	glm::mat4 captureViews[] =
 	{
 		glm::lookAt(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f,  0.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)),
@@ -185,7 +214,7 @@ void System::createRessources()
 	tempBrdfLUTCreation.initialize(&m_vk, true, { BRDF_LUT_TEXTURE_SIZE_X, BRDF_LUT_TEXTURE_SIZE_X }, false, VK_SAMPLE_COUNT_8_BIT, 1);
 
 	MeshPBR square;
-	square.loadObj(&m_vk, "Models/square.obj", glm::vec3(0.0f, 0.0f, 1.0f));
+	square.loadObj(&m_vk, "Models/square.obj", false, &m_meshRegistry);
 
 	tempBrdfLUTCreation.addMesh(&m_vk, { {&square, { } } }, "Shaders/vertBrdfLUT.spv", "Shaders/fragbrdfLUT.spv", 0);
 	tempBrdfLUTCreation.recordDraw(&m_vk);
@@ -198,12 +227,22 @@ void System::createRessources()
 	tempBrdfLUTCreation.cleanup(&m_vk);
 	square.cleanup(m_vk.getDevice());
 
+	for (int i(0); i < tempUboVP.size(); ++i)
+		tempUboVP[i].cleanup(m_vk.getDevice());
+	uboRoughness.cleanup(m_vk.getDevice());
+
 	//m_skybox.setImageView(0, m_sphere.getImageView(1));
 }
 
 void System::createPasses(bool recreate)
 {
-	if(recreate) m_swapChainRenderPass.cleanup(&m_vk);
+	if (recreate)
+	{
+		m_swapChainRenderPass.cleanup(&m_vk);
+		m_sphereInstance.cleanup(m_vk.getDevice());
+		m_instanceAnimator.cleanup(&m_vk);
+		m_animatedSphereInstance.cleanup(m_vk.getDevice());
+	}
 	m_swapChainRenderPass.initialize(&m_vk, false, { 0, 0 }, true, VK_SAMPLE_COUNT_8_BIT);
 	
 	std::vector<std::pair<glm::vec3, glm::vec3>> pointLights;
@@ -217,7 +256,8 @@ void System::createPasses(bool recreate)
 	m_spherelightMeshes.resize(pointLights.size());
 	for (int i(0); i < pointLights.size(); ++i)
 	{
-		m_spherelightMeshes[i].loadObj(&m_vk, "Models/sphere.obj", pointLights[i].second);
+		// Geometrie de m_sphere partagee, deja en memoire lors d'une recreation
+		m_spherelightMeshes[i].loadObj(&m_vk, "Models/sphere.obj", true, &m_meshRegistry);
 
 		m_spherelightMeshes[i].restoreTransformations();
 		m_spherelightMeshes[i].translate(pointLights[i].first);
@@ -226,7 +266,8 @@ void System::createPasses(bool recreate)
 		MeshRender meshRender;
 		meshRender.mesh = &m_spherelightMeshes[i];
 
-		m_uboSpheres[i].load(&m_vk, { m_spherelightMeshes[i].getModelMatrix() }, VK_SHADER_STAGE_VERTEX_BIT);
+		// La couleur de la lumiere est dans l'UBO : les spheres partagent un seul vertex buffer
+		m_uboSpheres[i].load(&m_vk, { m_spherelightMeshes[i].getModelMatrix(), glm::vec4(pointLights[i].second, 1.0f) }, VK_SHADER_STAGE_VERTEX_BIT);
 
 		meshRender.ubos = { &m_uboSpheres[i], &m_uboVP };
 		spheres.push_back(meshRender);
@@ -250,6 +291,17 @@ void System::createPasses(bool recreate)
 	}
 	m_uboLight.load(&m_vk, m_uboLightsData, VK_SHADER_STAGE_FRAGMENT_BIT);
 
+	// Pipelines de la passe declares une fois les UBO charges : ils sont compiles en parallele
+	// pendant la creation des instances, chaque addMesh* n'attend que le sien
+	m_swapChainRenderPass.preparePipeline(&m_vk, { &m_uboVP, &m_uboLight }, "Shaders/vertPBR.spv", "Shaders/fragPBR.spv", 3, true);
+	if (m_vk.hasShader("Shaders/vertPBRCompact.spv"))
+		m_swapChainRenderPass.preparePipeline(&m_vk, { &m_uboVP, &m_uboLight }, "Shaders/vertPBRCompact.spv", "Shaders/fragPBR.spv", 3, true, INSTANCE_LAYOUT_COMPACT);
+	m_swapChainRenderPass.preparePipeline(&m_vk, spheres[0].ubos, "Shaders/vertSphere.spv", "Shaders/fragSphere.spv", 0);
+	if (m_vk.hasShader("Shaders/vertSphereInstanced.spv"))
+		m_swapChainRenderPass.preparePipeline(&m_vk, spheres[0].ubos, "Shaders/vertSphereInstanced.spv", "Shaders/fragSphere.spv", 0, true);
+	m_swapChainRenderPass.preparePipeline(&m_vk, { &m_uboVPSkybox }, "Shaders/vertSkybox.spv", "Shaders/fragSkybox.spv", 1);
+	m_vk.getPipelineLibrary()->compilePreparedPipelines();
+
 	std::vector <ModelInstance> perInstance;
 	for (int i(0); i < 10; ++i)
 	{
@@ -264,11 +316,43 @@ void System::createPasses(bool recreate)
 			perInstance.push_back(mi);
 		}
 	}
-	m_sphereInstance.load(&m_vk, sizeof(perInstance[0]) * perInstance.size(), perInstance.data());
+	m_sphereInstance.load(&m_vk, sizeof(ModelInstance), static_cast<uint32_t>(perInstance.size()), perInstance.data());
+
+	// Un paquet par colonne de spheres pour le choix du LOD
+	std::vector<glm::mat4> instanceModels;
+	for (int i(0); i < perInstance.size(); ++i)
+		instanceModels.push_back(perInstance[i].model);
+	m_sphereInstance.computeBuckets(instanceModels, m_sphere.getBoundingSphere(), 10);
+
+	if (GpuCulling::isAvailable(&m_vk))
+		m_swapChainRenderPass.addMeshIndirect(&m_vk, { { &m_sphere, { &m_uboVP, &m_uboLight }, &m_sphereInstance } }, "Shaders/vertPBR.spv", "Shaders/fragPBR.spv", 3);
+	else
+		m_swapChainRenderPass.addMeshInstanced(&m_vk, { { &m_sphere, { &m_uboVP, &m_uboLight }, &m_sphereInstance } }, "Shaders/vertPBR.spv", "Shaders/fragPBR.spv", 3);
+
+	// Rangee de spheres animees par le GPU, si les shaders ont ete compiles (compile.bat)
+	if (InstanceAnimator::isAvailable(&m_vk) && m_vk.hasShader("Shaders/vertPBRCompact.spv"))
+	{
+		std::vector<AnimatedInstance> animatedInstances;
+		for (int i(0); i < 10; ++i)
+		{
+			AnimatedInstance animatedInstance;
+			animatedInstance.positionScale = glm::vec4(-i * 0.5f, -0.75f, 0.0f, 0.01f);
+			animatedInstance.rotationAxisSpeed = glm::vec4(0.0f, 1.0f, 0.0f, 1.0f);
+			animatedInstance.oscillation = glm::vec4(0.0f, 0.2f, 0.0f, 0.5f);
+			animatedInstance.albedo = glm::packUnorm4x8(glm::vec4(0.0f, 0.0f, 1.0f, 1.0f));
+			animatedInstance.roughnessMetallic = glm::packUnorm2x16(glm::vec2(glm::clamp((float)i / 10.0f, 0.05f, 1.0f), 0.5f));
+			animatedInstance.phase = i * 0.1f;
+
+			animatedInstances.push_back(animatedInstance);
+		}
+		m_instanceAnimator.initialize(&m_vk, animatedInstances, &m_animatedSphereInstance);
+		m_swapChainRenderPass.addInstanceAnimator(&m_instanceAnimator);
+		m_swapChainRenderPass.addMeshInstanced(&m_vk, { { &m_sphere, { &m_uboVP, &m_uboLight }, &m_animatedSphereInstance } }, "Shaders/vertPBRCompact.spv", "Shaders/fragPBR.spv", 3,
+			INSTANCE_LAYOUT_COMPACT);
+	}
 
-	m_swapChainRenderPass.addMeshInstanced(&m_vk, { { &m_sphere, { &m_uboVP, &m_uboLight }, &m_sphereInstance } }, "Shaders/vertPBR.spv", "Shaders/fragPBR.spv", 3);
 	m_swapChainRenderPass.addMesh(&m_vk, spheres, "Shaders/vertSphere.spv", "Shaders/fragSphere.spv", 0);
-	m_skyboxID = m_swapChainRenderPass.addMesh(&m_vk, { { &m_skybox, { &m_uboVPSkybox } } }, "Shaders/vertSkybox.spv", "Shaders/fragSkybox.spv", 1);
+	m_skyboxID = m_swapChainRenderPass.addMesh(&m_vk, { { &m_skybox, { &m_uboVPSkybox } } }, "Shaders/vertSkybox.spv", "Shaders/fragSkybox.spv", 1, 0, RENDER_LAYER_SKYBOX);
 	m_swapChainRenderPass.addText(&m_vk, &m_text);
 	m_swapChainRenderPass.recordDraw(&m_vk);
 }
\ No newline at end of file
@@ -11,10 +11,12 @@
 #include "Vulkan.h"
 #include "RenderPass.h"
 #include "Mesh.h"
+#include "MeshRegistry.h"
 #include "Text.h"
 #include "UniformBufferObject.h"
 #include "Camera.h"
 #include "Instance.h"
+#include "InstanceAnimator.h"
 
 class System
 {
@@ -36,9 +38,12 @@ private:
 	Vulkan m_vk;
 
 	RenderPass m_swapChainRenderPass;
+	MeshRegistry m_meshRegistry;
 	MeshPBR m_skybox;
 	MeshPBR m_sphere;
 	Instance m_sphereInstance;
+	Instance m_animatedSphereInstance;
+	InstanceAnimator m_instanceAnimator;
 	std::vector<MeshPBR> m_spherelightMeshes;
 	Text m_text;
 
@@ -11,7 +11,7 @@ void Text::initialize(Vulkan * vk, int ySize, std::string path)
 
 	FT_Face face;
 	if (FT_New_Face(ft, path.c_str(), 0, &face))
-		throw std::runtime_error("Erreur : chargement de la police de charactres");
+		throw std::runtime_error("Erreur : chargement de la police de charactères");
 
 	FT_Set_Pixel_Sizes(face, 0, ySize);
 
@@ -22,7 +22,7 @@ void Text::initialize(Vulkan * vk, int ySize, std::string path)
 		Character character;
 
 		if (FT_Load_Char(face, c, FT_LOAD_RENDER))
-			throw std::runtime_error("Erreur : chargement du charactre " + c);
+			throw std::runtime_error("Erreur : chargement du charactère " + c);
 
 		if (FT_Render_Glyph(face->glyph, FT_RENDER_MODE_NORMAL)) /* convert to an anti-aliased bitmap */
 			throw std::runtime_error("Erreur : render glyph " + c);
@@ -37,35 +37,28 @@ void Text::initialize(Vulkan * vk, int ySize, std::string path)
 		character.ySize = texHeight;
 
 		if (!pixels)
-			throw std::runtime_error("Erreur : chargement de la texture du charactre " + c);
-
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		vk->createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, 
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-		void* data;
-		vkMapMemory(vk->getDevice(), stagingBufferMemory, 0, imageSize, 0, &data);
-			memcpy(data, pixels, static_cast<size_t>(imageSize));
-		vkUnmapMemory(vk->getDevice(), stagingBufferMemory);
-
-		delete pixels;
+			throw std::runtime_error("Erreur : chargement de la texture du charactère " + c);
 
 		vk->createImage(texWidth, texHeight, 1, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8_UNORM, VK_IMAGE_TILING_OPTIMAL,
 			VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1, 0,
 			character.image, character.imageMemory);
 
 		vk->transitionImageLayout(character.image, VK_FORMAT_R8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, 1);
-			vk->copyBufferToImage(stagingBuffer, character.image, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 0);
+
+		// Tranche prise apres la transition : hors lot, sa soumission rendrait la tranche avant la copie
+		StagingSlice staging = vk->getStagingRing()->allocate(vk, imageSize);
+		memcpy(staging.data, pixels, static_cast<size_t>(imageSize));
+
+		delete pixels;
+
+			vk->copyBufferToImage(staging.buffer, character.image, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 0, staging.offset);
 		vk->transitionImageLayout(character.image, VK_FORMAT_R8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 			VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1, 1);
 
-		vkDestroyBuffer(vk->getDevice(), stagingBuffer, nullptr);
-		vkFreeMemory(vk->getDevice(), stagingBufferMemory, nullptr);
 
 		character.imageView = vk->createImageView(character.image, VK_FORMAT_R8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, 1, VK_IMAGE_VIEW_TYPE_2D);
 
-		m_characters[c] = character;
+		m_characters[c] = std::move(character);
 	}
 
 	FT_Done_Face(face);
@@ -87,27 +80,12 @@ void Text::initialize(Vulkan * vk, int ySize, std::string path)
 	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 
 	if (vkCreateSampler(vk->getDevice(), &samplerInfo, nullptr, &m_sampler) != VK_SUCCESS)
-		throw std::runtime_error("Erreur : cration d'un sampler");
+		throw std::runtime_error("Erreur : création d'un sampler");
 
-	std::vector<uint32_t> indices = { 0, 2, 1, 1, 2, 3};
+	std::vector<uint16_t> indices = { 0, 2, 1, 1, 2, 3};
 	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	vk->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-	void* data;
-	vkMapMemory(vk->getDevice(), stagingBufferMemory, 0, bufferSize, 0, &data);
-		memcpy(data, indices.data(), (size_t)bufferSize);
-	vkUnmapMemory(vk->getDevice(), stagingBufferMemory);
-
-	vk->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, 
-		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_indexBuffer, m_indexBufferMemory);
-
-	vk->copyBuffer(stagingBuffer, m_indexBuffer, bufferSize);
-
-	vkDestroyBuffer(vk->getDevice(), stagingBuffer, nullptr);
-	vkFreeMemory(vk->getDevice(), stagingBufferMemory, nullptr);
+	m_indexRange = vk->getGeometryArena()->uploadIndices(vk, indices.data(), bufferSize);
 }
 
 int Text::addText(Vulkan * vk, std::wstring text, glm::vec2 pos, float maxSize)
@@ -119,19 +97,16 @@ int Text::addText(Vulkan * vk, std::wstring text, glm::vec2 pos, float maxSize)
 void Text::changeText(Vulkan * vk, std::wstring text, int textID)
 {
 	if (textID >= m_texts.size())
-		throw std::runtime_error("Erreur : Changement d'un texte non allou");
+		throw std::runtime_error("Erreur : Changement d'un texte non alloué");
 
 	glm::vec2 pos = m_texts[textID].pos;
 	float maxSize = m_texts[textID].maxSize;
 
-	for (int i = 0; i < m_texts[textID].vertexBufferMemories.size(); ++i)
-	{
-		vkDestroyBuffer(vk->getDevice(), m_texts[textID].vertexBuffers[i], nullptr);
-		vkFreeMemory(vk->getDevice(), m_texts[textID].vertexBufferMemories[i], nullptr);
-	}
+	// Les frames en vol lisent encore l'ancien texte
+	GeometryArena* arena = vk->getGeometryArena();
+	GeometryRange vertexRange = m_texts[textID].vertexRange;
+	vk->deferDestroy([arena, vertexRange]() { arena->freeVertices(vertexRange); });
 	m_texts[textID].character.clear();
-	m_texts[textID].vertexBufferMemories.clear();
-	m_texts[textID].vertexBuffers.clear();
 
 	m_texts[textID] = createTextStruct(vk, text, pos, maxSize);
 
@@ -179,32 +154,12 @@ Text::TextStruct Text::createTextStruct(Vulkan * vk, std::wstring text, glm::vec
 		}
 	}
 
-	VkDeviceSize bufferSize = 4 * sizeof(TextVertex);
-
-	for (int i = 0; i < vertices.size(); ++i)
+	// Tous les caracteres du texte dans un seul bloc de l'arena
+	VkDeviceSize bufferSize = 4 * sizeof(TextVertex) * vertices.size();
+	if (bufferSize > 0)
 	{
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		vk->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
-
-		void* data;
-		vkMapMemory(vk->getDevice(), stagingBufferMemory, 0, bufferSize, 0, &data);
-		memcpy(data, vertices[i].data(), (size_t)bufferSize);
-		vkUnmapMemory(vk->getDevice(), stagingBufferMemory);
-
-		VkBuffer vertexBuffer;
-		VkDeviceMemory vertexBufferMemory;
-		vk->createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
-
-		vk->copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
-
-		vkDestroyBuffer(vk->getDevice(), stagingBuffer, nullptr);
-		vkFreeMemory(vk->getDevice(), stagingBufferMemory, nullptr);
-
-		textStruct.vertexBuffers.push_back(vertexBuffer);
-		textStruct.vertexBufferMemories.push_back(vertexBufferMemory);
+		textStruct.vertexRange = vk->getGeometryArena()->uploadVertices(vk, vertices.data(), bufferSize, sizeof(TextVertex));
+		textStruct.vertexOffset = static_cast<int32_t>(textStruct.vertexRange.offset / sizeof(TextVertex));
 	}
 
 	vertices.clear();
@@ -11,7 +11,7 @@
 struct Character
 {
 	VkImage image;
-	VkDeviceMemory imageMemory;
+	Allocation imageMemory;
 	VkImageView imageView;
 	int xSize; // en pixel
 	int ySize;
@@ -28,8 +28,9 @@ public:
 public:
 	int GetNbTexts() { return (int)m_texts.size(); }
 	int GetNbCharacters(int index) { return (int)m_texts[index].character.size(); }
-	VkBuffer GetVertexBuffer(int indexI, int indexJ) { return m_texts[indexI].vertexBuffers[indexJ]; }
-	VkBuffer GetIndexBuffer() { return m_indexBuffer; }
+	int32_t GetVertexOffset(int indexI, int indexJ) { return m_texts[indexI].vertexOffset + 4 * indexJ; }
+	uint32_t GetFirstIndex() { return static_cast<uint32_t>(m_indexRange.offset / sizeof(uint16_t)); }
+	VkIndexType GetIndexType() { return VK_INDEX_TYPE_UINT16; }
 	VkImageView GetImageView(int indexI, int indexJ) { return m_characters[m_texts[indexI].character[indexJ]].imageView; }
 	VkSampler GetSampler() { return m_sampler; }
 
@@ -41,8 +42,8 @@ private:
 	{
 		glm::vec2 pos;
 		float maxSize;
-		std::vector<VkBuffer> vertexBuffers;
-		std::vector<VkDeviceMemory> vertexBufferMemories;
+		GeometryRange vertexRange; // 4 sommets par caractere, a la suite dans l'arena
+		int32_t vertexOffset = 0;
 		std::vector<wchar_t> character;
 	};
 
@@ -56,7 +57,6 @@ private:
 	std::vector<TextStruct> m_texts;
 	int m_needUpdate = -1;
 
-	VkBuffer m_indexBuffer;
-	VkDeviceMemory m_indexBufferMemory;
+	GeometryRange m_indexRange;
 };
 
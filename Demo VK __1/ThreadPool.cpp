@@ -0,0 +1,107 @@
+#include "ThreadPool.h"
+
+void ThreadPool::initialize(int nbThreads)
+{
+	m_stop = false;
+	for (int i(0); i < nbThreads; ++i)
+		m_threads.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+}
+
+void ThreadPool::cleanup()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_taskCondition.notify_all();
+
+	for (int i(0); i < m_threads.size(); ++i)
+		m_threads[i].join();
+	m_threads.clear();
+}
+
+void ThreadPool::run(size_t nbTasks, std::function<void(size_t, int)> task)
+{
+	if (nbTasks == 0)
+		return;
+
+	runAsync(nbTasks, task);
+	wait();
+}
+
+void ThreadPool::runAsync(size_t nbTasks, std::function<void(size_t, int)> task)
+{
+	if (nbTasks == 0)
+		return;
+
+	std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+	batch->task = task;
+	batch->nbTasks = nbTasks;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_batches.push_back(batch);
+	m_taskCondition.notify_all();
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_doneCondition.wait(lock, [this]() { return m_batches.empty(); });
+
+	if (m_exception)
+	{
+		std::exception_ptr exception = m_exception;
+		m_exception = nullptr;
+		std::rethrow_exception(exception);
+	}
+}
+
+std::shared_ptr<ThreadPool::Batch> ThreadPool::getPendingBatch()
+{
+	for (int i(0); i < m_batches.size(); ++i)
+		if (m_batches[i]->nextTask < m_batches[i]->nbTasks)
+			return m_batches[i];
+
+	return nullptr;
+}
+
+void ThreadPool::workerLoop(int threadID)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		std::shared_ptr<Batch> batch;
+		m_taskCondition.wait(lock, [this, &batch]() { return m_stop || (batch = getPendingBatch()) != nullptr; });
+		if (m_stop)
+			return;
+
+		size_t taskID = batch->nextTask++;
+
+		lock.unlock();
+		std::exception_ptr exception;
+		try
+		{
+			batch->task(taskID, threadID);
+		}
+		catch (...)
+		{
+			exception = std::current_exception();
+		}
+		lock.lock();
+
+		if (exception && !m_exception)
+			m_exception = exception;
+
+		if (++batch->nbDoneTasks == batch->nbTasks)
+		{
+			for (auto it = m_batches.begin(); it != m_batches.end(); ++it)
+				if (*it == batch)
+				{
+					m_batches.erase(it);
+					break;
+				}
+			if (m_batches.empty())
+				m_doneCondition.notify_all();
+		}
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+
+// Threads de travail permanents pour decouper une boucle en taches.
+// Chaque tache recoit l'indice du thread qui l'execute pour utiliser ses ressources (command pool)
+class ThreadPool
+{
+public:
+	void initialize(int nbThreads);
+	void cleanup();
+
+	// Execute task(i, thread) pour i dans [0, nbTasks) et attend que tout soit fini.
+	// La premiere exception levee par une tache est relancee ici
+	void run(size_t nbTasks, std::function<void(size_t, int)> task);
+	// Comme run sans attendre : le lot est mis a la suite des lots en cours, les threads les traitent dans l'ordre
+	void runAsync(size_t nbTasks, std::function<void(size_t, int)> task);
+	// Attend la fin de tous les lots lances et relance la premiere exception de leurs taches
+	void wait();
+
+	int getNbThreads() { return (int)m_threads.size(); }
+
+private:
+	struct Batch
+	{
+		std::function<void(size_t, int)> task;
+		size_t nbTasks = 0;
+		size_t nextTask = 0;
+		size_t nbDoneTasks = 0;
+	};
+
+	void workerLoop(int threadID);
+	std::shared_ptr<Batch> getPendingBatch();
+
+private:
+	std::vector<std::thread> m_threads;
+	std::mutex m_mutex;
+	std::condition_variable m_taskCondition;
+	std::condition_variable m_doneCondition;
+
+	std::deque<std::shared_ptr<Batch>> m_batches; // lots pas encore termines, dans l'ordre de lancement
+	bool m_stop = false;
+	std::exception_ptr m_exception;
+};
@@ -0,0 +1,38 @@
+#include "UniformArena.h"
+
+#include "Vulkan.h"
+
+void UniformArena::initialize(Vulkan* vk, VkDeviceSize frameSize)
+{
+	m_alignment = vk->getMinUniformBufferOffsetAlignment();
+	m_frameSize = (frameSize + m_alignment - 1) / m_alignment * m_alignment;
+
+	vk->createBuffer(m_frameSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_buffer, m_memory);
+	m_ranges.initialize(m_frameSize);
+}
+
+void UniformArena::cleanup(VkDevice device)
+{
+#ifndef NDEBUG
+	std::cout << "[Uniform] " << m_ranges.getUsed() << " octets encore alloues sur " << m_frameSize << " par frame" << std::endl;
+#endif
+
+	vkDestroyBuffer(device, m_buffer, nullptr);
+	m_memory.free();
+	m_buffer = VK_NULL_HANDLE;
+}
+
+VkDeviceSize UniformArena::allocate(VkDeviceSize size)
+{
+	VkDeviceSize offset;
+	if (!m_ranges.allocate(size, m_alignment, offset))
+		throw std::runtime_error("Erreur : plus de place dans l'arena d'uniformes");
+
+	return offset;
+}
+
+void UniformArena::free(VkDeviceSize offset, VkDeviceSize size)
+{
+	m_ranges.free(offset, size);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include "MemoryAllocator.h"
+#include "RangeAllocator.h"
+
+class Vulkan;
+
+// Un seul uniform buffer mappe en permanence pour tous les UBO, decoupe en une tranche par frame en vol.
+// Un UBO occupe le meme offset dans chaque tranche : offset dynamique = offset + frame * taille d'une tranche
+class UniformArena
+{
+public:
+	void initialize(Vulkan* vk, VkDeviceSize frameSize);
+	void cleanup(VkDevice device);
+
+	VkDeviceSize allocate(VkDeviceSize size);
+	void free(VkDeviceSize offset, VkDeviceSize size);
+
+	void* getData(uint32_t frame, VkDeviceSize offset) { return static_cast<char*>(m_memory.mapped) + frame * m_frameSize + offset; }
+	VkBuffer getBuffer() { return m_buffer; }
+	VkDeviceSize getFrameSize() { return m_frameSize; }
+
+private:
+	VkBuffer m_buffer = VK_NULL_HANDLE;
+	Allocation m_memory;
+	VkDeviceSize m_frameSize = 0;
+	VkDeviceSize m_alignment = 256;
+	RangeAllocator m_ranges;
+};
@@ -23,6 +23,18 @@ struct UniformBufferObjectVP
 struct UniformBufferObjectModel
 {
 	glm::mat4 model;
+	glm::vec4 color = glm::vec4(1.0f); // meshes sans eclairage (spheres des lumieres)
+};
+
+struct UniformBufferObjectCulling
+{
+	std::array<glm::vec4, 6> frustumPlanes; // normale vers l'interieur, w : distance
+	glm::vec4 cameraPosition; // w : taille en pixels d'un objet de rayon 1 a distance 1
+};
+
+struct UniformBufferObjectAnimation
+{
+	glm::vec4 time; // x : secondes
 };
 
 const int MAX_POINTLIGHTS = 32;
@@ -47,14 +59,16 @@ public:
 	//virtual std::string Get() = 0;
 
 	VkBuffer getUniformBuffer() { return m_uniformBuffer; }
-	VkDeviceMemory getUniformBufferMemory() { return m_uniformBufferMemory; }
 	VkDeviceSize getSize() { return m_size; }
+	// Offset dans la tranche de frame de l'arena : offset dynamique = offset + frame * taille d'une tranche
+	uint32_t getOffset() { return static_cast<uint32_t>(m_offset); }
 	VkShaderStageFlags getAccessibility() { return m_accessibility; }
 
 protected:
-	VkBuffer m_uniformBuffer;
-	VkDeviceMemory m_uniformBufferMemory;
+	VkBuffer m_uniformBuffer = VK_NULL_HANDLE; // buffer de l'arena d'uniformes, partage par tous les UBO
+	UniformArena* m_arena = nullptr;
 
+	VkDeviceSize m_offset = 0;
 	VkDeviceSize m_size = 0;
 
 	VkShaderStageFlags m_accessibility = VK_SHADER_STAGE_VERTEX_BIT;
@@ -68,28 +82,37 @@ public:
 
 	void load(Vulkan* vk, T data, VkShaderStageFlags accessibility)
 	{
-		VkDeviceSize bufferSize = sizeof(T);
-		vk->createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_uniformBuffer, m_uniformBufferMemory);
+		// Un nouveau load (recreation de la swapchain) reprend la place de l'ancien
+		cleanup(vk->getDevice());
 
+		m_arena = vk->getUniformArena();
+		m_uniformBuffer = m_arena->getBuffer();
 		m_size = sizeof(T);
+		m_offset = m_arena->allocate(m_size);
 		m_accessibility = accessibility;
+		m_data = data;
 
-		void* pData;
-		vkMapMemory(vk->getDevice(), m_uniformBufferMemory, 0, m_size, 0, &pData);
-			memcpy(pData, &data, m_size);
-		vkUnmapMemory(vk->getDevice(), m_uniformBufferMemory);
+		for (uint32_t frame(0); frame < MAX_FRAMES_IN_FLIGHT; ++frame)
+			memcpy(m_arena->getData(frame, m_offset), &data, m_size);
 	}
 
+	// N'ecrit que la tranche de la frame courante : a appeler a chaque frame tant que la donnee change
 	void update(Vulkan* vk, T data)
 	{
-		void* pData;
-		vkMapMemory(vk->getDevice(), m_uniformBufferMemory, 0, m_size, 0, &pData);
-			memcpy(pData, &data, m_size);
-		vkUnmapMemory(vk->getDevice(), m_uniformBufferMemory);
+		m_data = data;
+		memcpy(m_arena->getData(vk->getCurrentFrame(), m_offset), &data, m_size);
+	}
+
+	void cleanup(VkDevice device)
+	{
+		if (m_arena)
+			m_arena->free(m_offset, m_size);
+		m_arena = nullptr;
 	}
 
-	void cleanup(VkDevice device);
+	// Derniere valeur ecrite, pour les draws qui la recopient dans leurs instances
+	T getData() { return m_data; }
 
 private:
+	T m_data;
 };
\ No newline at end of file
@@ -0,0 +1,74 @@
+#include "UploadBatch.h"
+
+#include "Vulkan.h"
+
+void UploadBatch::end(Vulkan* vk, bool wait)
+{
+	if (m_depth == 0)
+		throw std::runtime_error("Erreur : fin d'un lot de copies non ouvert");
+
+	m_depth--;
+	if (m_depth == 0)
+		flush(vk, wait);
+}
+
+void UploadBatch::flush(Vulkan* vk, bool wait)
+{
+	if (m_commandBuffer == VK_NULL_HANDLE && m_transferCommandBuffer == VK_NULL_HANDLE)
+		return;
+
+	VkCommandBuffer commandBuffer = m_commandBuffer;
+	VkCommandBuffer transferCommandBuffer = m_transferCommandBuffer;
+	std::vector<VkBufferMemoryBarrier> acquireBarriers;
+	acquireBarriers.swap(m_acquireBarriers);
+	m_commandBuffer = VK_NULL_HANDLE;
+	m_transferCommandBuffer = VK_NULL_HANDLE;
+
+#ifndef NDEBUG
+	std::cout << "[Upload] " << m_nbRecords << " enregistrements en une soumission";
+	if (transferCommandBuffer != VK_NULL_HANDLE)
+		std::cout << " (" << acquireBarriers.size() << " copies sur la file de transfert)";
+	std::cout << std::endl;
+#endif
+	m_nbRecords = 0;
+
+	vk->submitUploadCommands(commandBuffer, transferCommandBuffer, acquireBarriers, wait);
+}
+
+VkCommandBuffer UploadBatch::getCommandBuffer(Vulkan* vk)
+{
+	if (m_commandBuffer == VK_NULL_HANDLE)
+		m_commandBuffer = beginCommandBuffer(vk->getDevice(), vk->getCommandPool());
+
+	m_nbRecords++;
+	return m_commandBuffer;
+}
+
+VkCommandBuffer UploadBatch::getTransferCommandBuffer(Vulkan* vk)
+{
+	if (m_transferCommandBuffer == VK_NULL_HANDLE)
+		m_transferCommandBuffer = beginCommandBuffer(vk->getDevice(), vk->getTransferCommandPool());
+
+	m_nbRecords++;
+	return m_transferCommandBuffer;
+}
+
+VkCommandBuffer UploadBatch::beginCommandBuffer(VkDevice device, VkCommandPool commandPool)
+{
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	allocInfo.commandPool = commandPool;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+	return commandBuffer;
+}
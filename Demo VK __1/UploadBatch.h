@@ -0,0 +1,35 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <vector>
+
+class Vulkan;
+
+// Lot de copies, transitions et blits enregistres dans un seul command buffer.
+// Tant qu'un lot est ouvert, begin/endSingleTimeCommands l'utilisent au lieu de soumettre et d'attendre
+class UploadBatch
+{
+public:
+	void begin() { m_depth++; }
+	void end(Vulkan* vk, bool wait = false);
+	// Soumet ce qui a ete enregistre sans attendre : le GPU copie pendant que le CPU prepare la suite
+	void flush(Vulkan* vk, bool wait = false);
+
+	bool isOpen() { return m_depth > 0; }
+	VkCommandBuffer getCommandBuffer(Vulkan* vk);
+	// Copies de buffers sur la file de transfert dediee, rendus a la file graphique a la soumission
+	VkCommandBuffer getTransferCommandBuffer(Vulkan* vk);
+	void addAcquireBarrier(VkBufferMemoryBarrier barrier) { m_acquireBarriers.push_back(barrier); }
+
+private:
+	VkCommandBuffer beginCommandBuffer(VkDevice device, VkCommandPool commandPool);
+
+private:
+	int m_depth = 0; // les lots imbriques sont fusionnes
+	VkCommandBuffer m_commandBuffer = VK_NULL_HANDLE;
+	VkCommandBuffer m_transferCommandBuffer = VK_NULL_HANDLE;
+	std::vector<VkBufferMemoryBarrier> m_acquireBarriers;
+	uint32_t m_nbRecords = 0;
+};
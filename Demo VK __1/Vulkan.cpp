@@ -1,5 +1,21 @@
 #include "Vulkan.h"
 
+#include <chrono>
+
+const VkDeviceSize GEOMETRY_ARENA_VERTEX_SIZE = 64 * 1024 * 1024;
+const VkDeviceSize GEOMETRY_ARENA_INDEX_SIZE = 16 * 1024 * 1024;
+const VkDeviceSize STAGING_RING_SIZE = 32 * 1024 * 1024;
+const VkDeviceSize UNIFORM_ARENA_FRAME_SIZE = 1024 * 1024;
+const int MAX_RECORD_THREADS = 8;
+const int MAX_PIPELINE_COMPILE_THREADS = 8;
+const std::string PIPELINE_CACHE_FILE_NAME = "pipelines.pipelinecache";
+const std::string SHADER_DIRECTORY = "Shaders";
+// Plusieurs plages de draws par thread : un thread en retard n'attarde pas les autres
+const int RECORD_RANGES_PER_THREAD = 4;
+// Buffers envoyes lus comme vertex et index, en SSBO par les compute shaders ou recopies (commandes du culling)
+const VkPipelineStageFlags UPLOAD_DST_STAGES = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+const VkAccessFlags UPLOAD_DST_ACCESS = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+
 void Vulkan::initialize(int width, int height, std::string appName, std::function<void(void*)> recreateCallback, void* instance, bool recreate)
 {
 	m_recreateCallback = recreateCallback;
@@ -27,19 +43,62 @@ void Vulkan::initialize(int width, int height, std::string appName, std::functio
 		setupDebugCallback();
 #endif
 		if (glfwCreateWindowSurface(m_instance, m_window, nullptr, &m_surface) != VK_SUCCESS)
-			throw std::runtime_error("Erreur : Cration de la surface");
+			throw std::runtime_error("Erreur : Création de la surface");
 		pickPhysicalDevice();
 		m_deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 		createDevice();
+		m_memoryAllocator.initialize(m_physicalDevice, m_device);
+		m_shaderCompiler.initialize(SHADER_DIRECTORY);
+		m_shaderModuleCache.setShaderCompiler(&m_shaderCompiler);
+		m_pipelineCache.initialize(m_physicalDevice, m_device, PipelineCache::getUserCachePath(PIPELINE_CACHE_FILE_NAME));
+		m_pipelineLibrary.initialize(std::max(1, std::min((int)std::thread::hardware_concurrency(), MAX_PIPELINE_COMPILE_THREADS)));
 	}
 
 	createSwapChain();
-	if(!recreate) m_commandPool = createCommandPool();
+	if (!recreate)
+	{
+		m_commandPool = createCommandPool();
+		if (hasTransferQueue())
+			m_transferCommandPool = createCommandPool(m_transferFamily);
+
+		setNbRecordThreads(std::max(1, std::min((int)std::thread::hardware_concurrency(), MAX_RECORD_THREADS)));
+	}
+	if (!recreate)
+	{
+		m_stagingRing.initialize(this, STAGING_RING_SIZE);
+		m_stagingRing.setFlushCallback([this]() { m_uploadBatch.flush(this); });
+	}
+	if (!recreate) m_geometryArena.initialize(this, GEOMETRY_ARENA_VERTEX_SIZE, GEOMETRY_ARENA_INDEX_SIZE);
+	if (!recreate) m_uniformArena.initialize(this, UNIFORM_ARENA_FRAME_SIZE);
 	createSemaphores();
 }
 
 void Vulkan::cleanup()
 {
+	flushDeferredDestructions();
+	destroySemaphores();
+
+#ifndef NDEBUG
+	if (m_nbRecords > 0)
+	{
+		std::cout << "[Record] " << m_nbRecords << " enregistrements, " << m_recordStatistics.nbDraws / m_nbRecords << " draws en " << m_recordTime / m_nbRecords
+			<< " ms en moyenne sur " << m_recordThreadPool.getNbThreads() << " threads" << std::endl;
+		std::cout << "[Record] Binds : " << m_recordStatistics.nbBinds << " emis, " << m_recordStatistics.nbSkippedBinds << " evites" << std::endl;
+	}
+#endif
+	destroyRecordThreads();
+
+	m_geometryArena.cleanup(m_device);
+	m_uniformArena.cleanup(m_device);
+	m_stagingRing.cleanup(m_device);
+	m_pipelineLibrary.cleanup(m_device);
+	m_shaderModuleCache.cleanup(m_device);
+	m_shaderCompiler.cleanup();
+	m_pipelineCache.cleanup(m_device);
+	m_memoryAllocator.cleanup();
+	if (m_transferCommandPool != VK_NULL_HANDLE)
+		vkDestroyCommandPool(m_device, m_transferCommandPool, nullptr);
+
 	glfwDestroyWindow(m_window);
 
 	glfwTerminate();	
@@ -72,7 +131,7 @@ void Vulkan::createInstance()
 		createInfo.enabledLayerCount = 0;
 
 	if (vkCreateInstance(&createInfo, nullptr, &m_instance) != VK_SUCCESS)
-		throw std::runtime_error("Erreur : Cration de l'instance !");
+		throw std::runtime_error("Erreur : Création de l'instance !");
 }
 
 void Vulkan::setupDebugCallback()
@@ -85,7 +144,7 @@ void Vulkan::setupDebugCallback()
 	createInfo.pfnCallback = debugCallback;
 
 	if (CreateDebugReportCallbackEXT(m_instance, &createInfo, nullptr, &m_callback) != VK_SUCCESS)
-		throw std::runtime_error("Erreur : Cration du debug callback !");
+		throw std::runtime_error("Erreur : Création du debug callback !");
 }
 
 void Vulkan::pickPhysicalDevice()
@@ -94,7 +153,7 @@ void Vulkan::pickPhysicalDevice()
 	vkEnumeratePhysicalDevices(m_instance, &deviceCount, nullptr);
 
 	if (deviceCount == 0)
-		throw std::runtime_error("Erreur : Aucun GPU supportant Vulkan trouv !");
+		throw std::runtime_error("Erreur : Aucun GPU supportant Vulkan trouvé !");
 
 	std::vector<VkPhysicalDevice> devices(deviceCount);
 	vkEnumeratePhysicalDevices(m_instance, &deviceCount, devices.data());
@@ -105,12 +164,16 @@ void Vulkan::pickPhysicalDevice()
 		{
 			m_physicalDevice = device;
 			m_maxMsaaSamples = getMaxUsableSampleCount();
+
+			VkPhysicalDeviceProperties physicalDeviceProperties;
+			vkGetPhysicalDeviceProperties(m_physicalDevice, &physicalDeviceProperties);
+			m_minUniformBufferOffsetAlignment = physicalDeviceProperties.limits.minUniformBufferOffsetAlignment;
 			break;
 		}
 	}
 
 	if (m_physicalDevice == VK_NULL_HANDLE)
-		throw std::runtime_error("Erreur : Aucun GPU convenable trouv !");
+		throw std::runtime_error("Erreur : Aucun GPU convenable trouvé !");
 }
 
 void Vulkan::createDevice()
@@ -119,6 +182,8 @@ void Vulkan::createDevice()
 
 	std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 	std::set<int> uniqueQueueFamilies = { indices.graphicsFamily, indices.presentFamily };
+	if (indices.transferFamily >= 0)
+		uniqueQueueFamilies.insert(indices.transferFamily);
 
 	float queuePriority = 1.0f;
 	for (int queueFamily : uniqueQueueFamilies)
@@ -131,9 +196,18 @@ void Vulkan::createDevice()
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(m_physicalDevice, &supportedFeatures);
+
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
 	deviceFeatures.sampleRateShading = VK_TRUE;
+	// Sinon les draws indirects d'un lot sont emis un par un
+	deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	m_multiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+	// Le culling GPU range les instances de chaque LOD a partir de firstInstance
+	deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+	m_drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
 
 	VkDeviceCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -155,10 +229,20 @@ void Vulkan::createDevice()
 		createInfo.enabledLayerCount = 0;
 
 	if (vkCreateDevice(m_physicalDevice, &createInfo, nullptr, &m_device) != VK_SUCCESS)
-		throw std::runtime_error("Erreur : Cration du device");
+		throw std::runtime_error("Erreur : Création du device");
 
 	vkGetDeviceQueue(m_device, indices.graphicsFamily, 0, &m_graphicsQueue);
 	vkGetDeviceQueue(m_device, indices.presentFamily, 0, &m_presentQueue);
+
+	// Les chargements passent par la file de transfert quand elle existe pour ne pas retarder le rendu
+	m_graphicsFamily = indices.graphicsFamily;
+	m_transferFamily = indices.transferFamily >= 0 ? indices.transferFamily : indices.graphicsFamily;
+	vkGetDeviceQueue(m_device, m_transferFamily, 0, &m_transferQueue);
+
+#ifndef NDEBUG
+	if (hasTransferQueue())
+		std::cout << "[Upload] File de transfert dediee (famille " << m_transferFamily << ")" << std::endl;
+#endif
 }
 
 void Vulkan::createSwapChain()
@@ -202,7 +286,7 @@ void Vulkan::createSwapChain()
 	createInfo.clipped = VK_TRUE;
 
 	if (vkCreateSwapchainKHR(m_device, &createInfo, nullptr, &m_swapChain) != VK_SUCCESS)
-		throw std::runtime_error("Erreur : Cration de la swap chain !");
+		throw std::runtime_error("Erreur : Création de la swap chain !");
 
 	vkGetSwapchainImagesKHR(m_device, m_swapChain, &imageCount, nullptr);
 	m_swapChainImages.resize(imageCount);
@@ -217,15 +301,19 @@ void Vulkan::createSwapChain()
 		m_swapChainImageViews[i] = createImageView(m_swapChainImages[i], m_swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1, VK_IMAGE_VIEW_TYPE_2D);
 }
 
-VkCommandPool Vulkan::createCommandPool()
+VkCommandPool Vulkan::createCommandPool(int queueFamily)
 {
 	VkCommandPool commandPool;
 
-	QueueFamilyIndices queueFamilyIndices = findQueueFamilies(m_physicalDevice);
+	if (queueFamily < 0)
+	{
+		QueueFamilyIndices queueFamilyIndices = findQueueFamilies(m_physicalDevice);
+		queueFamily = queueFamilyIndices.graphicsFamily;
+	}
 
 	VkCommandPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+	poolInfo.queueFamilyIndex = queueFamily;
 
 	if (vkCreateCommandPool(m_device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
 		throw std::runtime_error("Erreur : command pool");
@@ -237,7 +325,7 @@ void Vulkan::cleanupSwapChain()
 {
 	vkDestroyImageView(m_device, m_depthImageView, nullptr);
 	vkDestroyImage(m_device, m_depthImage, nullptr);
-	vkFreeMemory(m_device, m_depthImageMemory, nullptr);
+	m_depthImageMemory.free();
 
 	for (size_t i = 0; i < m_swapChainFramebuffers.size(); i++)
 	{
@@ -289,7 +377,7 @@ void Vulkan::createSwapchainFramebuffers(VkRenderPass renderPass, VkSampleCountF
 }
 
 void Vulkan::createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
-	uint32_t arrayLayers, VkImageCreateFlags flags, VkImage & image, VkDeviceMemory & imageMemory)
+	uint32_t arrayLayers, VkImageCreateFlags flags, VkImage & image, Allocation & imageMemory)
 {
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -308,20 +396,14 @@ void Vulkan::createImage(uint32_t width, uint32_t height, uint32_t mipLevels, Vk
 	imageInfo.flags = flags;
 
 	if (vkCreateImage(m_device, &imageInfo, nullptr, &image) != VK_SUCCESS)
-		throw std::runtime_error("Erreur : cration de l'image");
+		throw std::runtime_error("Erreur : création de l'image");
 
 	VkMemoryRequirements memRequirements;
 	vkGetImageMemoryRequirements(m_device, image, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
+	imageMemory = m_memoryAllocator.allocate(memRequirements, properties, tiling == VK_IMAGE_TILING_LINEAR);
 
-	if (vkAllocateMemory(m_device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS)
-		throw std::runtime_error("failed to allocate image memory!");
-
-	vkBindImageMemory(m_device, image, imageMemory, 0);
+	vkBindImageMemory(m_device, image, imageMemory.memory, imageMemory.offset);
 }
 
 void Vulkan::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels, uint32_t arrayLayers)
@@ -402,7 +484,7 @@ void Vulkan::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout
 		}
 		else
 		{
-			throw std::runtime_error("Erreur : transition non supporte");
+			throw std::runtime_error("Erreur : transition non supportée");
 		}
 
 		vkCmdPipelineBarrier(
@@ -429,11 +511,14 @@ uint32_t Vulkan::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags prope
 			return i;
 	}
 
-	throw std::runtime_error("Erreur : aucun type de mmoire adquate trouv !");
+	throw std::runtime_error("Erreur : aucun type de mémoire adéquate trouvé !");
 }
 
 VkCommandBuffer Vulkan::beginSingleTimeCommands()
 {
+	if (m_uploadBatch.isOpen())
+		return m_uploadBatch.getCommandBuffer(this);
+
 	VkCommandBufferAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
@@ -454,17 +539,97 @@ VkCommandBuffer Vulkan::beginSingleTimeCommands()
 
 void Vulkan::endSingleTimeCommands(VkCommandBuffer commandBuffer)
 {
-	vkEndCommandBuffer(commandBuffer);
+	// Soumis avec le reste du lot
+	if (m_uploadBatch.isOpen())
+		return;
 
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffer;
+	submitUploadCommands(commandBuffer, VK_NULL_HANDLE, std::vector<VkBufferMemoryBarrier>(), true);
+}
+
+void Vulkan::submitUploadCommands(VkCommandBuffer commandBuffer, VkCommandBuffer transferCommandBuffer, const std::vector<VkBufferMemoryBarrier>& acquireBarriers, bool wait)
+{
+	std::vector<std::pair<VkCommandPool, VkCommandBuffer>> commandBuffers;
+	std::vector<VkSubmitInfo> submitInfos;
+	std::vector<VkCommandBuffer> graphicsCommandBuffers;
+
+	if (commandBuffer != VK_NULL_HANDLE)
+	{
+		// Copies de buffers visibles des draws et des dispatchs soumis ensuite, meme sans attente cote CPU
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = UPLOAD_DST_ACCESS;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, UPLOAD_DST_STAGES, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+		vkEndCommandBuffer(commandBuffer);
+		commandBuffers.push_back({ m_commandPool, commandBuffer });
+		graphicsCommandBuffers.push_back(commandBuffer);
+	}
+
+	VkSemaphore transferSemaphore = VK_NULL_HANDLE;
+	VkPipelineStageFlags waitStage = UPLOAD_DST_STAGES;
+	if (transferCommandBuffer != VK_NULL_HANDLE)
+	{
+		vkEndCommandBuffer(transferCommandBuffer);
+		commandBuffers.push_back({ m_transferCommandPool, transferCommandBuffer });
+
+		transferSemaphore = m_stagingRing.getSemaphore(m_device);
+
+		VkSubmitInfo transferSubmitInfo = {};
+		transferSubmitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		transferSubmitInfo.commandBufferCount = 1;
+		transferSubmitInfo.pCommandBuffers = &transferCommandBuffer;
+		transferSubmitInfo.signalSemaphoreCount = 1;
+		transferSubmitInfo.pSignalSemaphores = &transferSemaphore;
+		if (vkQueueSubmit(m_transferQueue, 1, &transferSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+			throw std::runtime_error("Erreur : soumission sur la file de transfert");
+
+		// Acquisition des buffers liberes par la file de transfert, dans une soumission a part
+		// pour que les copies d'images du lot n'attendent pas le semaphore
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = m_commandPool;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer acquireCommandBuffer;
+		vkAllocateCommandBuffers(m_device, &allocInfo, &acquireCommandBuffer);
+
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+		vkBeginCommandBuffer(acquireCommandBuffer, &beginInfo);
+		vkCmdPipelineBarrier(acquireCommandBuffer, UPLOAD_DST_STAGES, UPLOAD_DST_STAGES, 0, 0, nullptr,
+			static_cast<uint32_t>(acquireBarriers.size()), acquireBarriers.data(), 0, nullptr);
+		vkEndCommandBuffer(acquireCommandBuffer);
+
+		commandBuffers.push_back({ m_commandPool, acquireCommandBuffer });
+		graphicsCommandBuffers.push_back(acquireCommandBuffer);
+	}
 
-	vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(m_graphicsQueue);
+	for (int i(0); i < graphicsCommandBuffers.size(); ++i)
+	{
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &graphicsCommandBuffers[i];
+		if (graphicsCommandBuffers[i] != commandBuffer)
+		{
+			submitInfo.waitSemaphoreCount = 1;
+			submitInfo.pWaitSemaphores = &transferSemaphore;
+			submitInfo.pWaitDstStageMask = &waitStage;
+		}
+		submitInfos.push_back(submitInfo);
+	}
 
-	vkFreeCommandBuffers(m_device, m_commandPool, 1, &commandBuffer);
+	// La fence rend au staging ring les tranches lues par ces commandes, et libere les command buffers.
+	// La soumission graphique attend le semaphore : sa fence couvre aussi les copies de la file de transfert
+	VkFence fence = m_stagingRing.submit(m_device, commandBuffers, transferSemaphore);
+	vkQueueSubmit(m_graphicsQueue, static_cast<uint32_t>(submitInfos.size()), submitInfos.data(), fence);
+	if (wait)
+		m_stagingRing.wait(m_device, fence);
+	m_stagingRing.reclaim(m_device);
 }
 
 bool Vulkan::checkValidationLayerSupport(std::vector<const char*> layers)
@@ -544,6 +709,19 @@ QueueFamilyIndices Vulkan::findQueueFamilies(VkPhysicalDevice device)
 	int i = 0;
 	for (const auto& queueFamily : queueFamilies)
 	{
+		// Famille de transfert pure de preference (moteur DMA), sinon une famille compute sans graphique
+		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT && !(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT))
+		{
+			if (indices.transferFamily < 0 || !(queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT))
+				indices.transferFamily = i;
+		}
+
+		if (indices.isComplete())
+		{
+			i++;
+			continue;
+		}
+
 		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
 			indices.graphicsFamily = i;
 
@@ -553,9 +731,6 @@ QueueFamilyIndices Vulkan::findQueueFamilies(VkPhysicalDevice device)
 		if (queueFamily.queueCount > 0 && presentSupport)
 			indices.presentFamily = i;
 
-		if (indices.isComplete())
-			break;
-
 		i++;
 	}
 
@@ -672,7 +847,7 @@ VkImageView Vulkan::createImageView(VkImage image, VkFormat format, VkImageAspec
 
 	VkImageView imageView;
 	if (vkCreateImageView(m_device, &viewInfo, nullptr, &imageView) != VK_SUCCESS)
-		throw std::runtime_error("Erreur : Cration d'une image view");
+		throw std::runtime_error("Erreur : Création d'une image view");
 
 	return imageView;
 }
@@ -697,7 +872,7 @@ VkFormat Vulkan::findSupportedFormat(const std::vector<VkFormat>& candidates, Vk
 			return format;
 	}
 
-	throw std::runtime_error("Aucun format support !");
+	throw std::runtime_error("Aucun format supporté !");
 }
 
 bool Vulkan::hasStencilComponent(VkFormat format)
@@ -705,7 +880,7 @@ bool Vulkan::hasStencilComponent(VkFormat format)
 	return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
 }
 
-void Vulkan::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer & buffer, VkDeviceMemory & bufferMemory)
+void Vulkan::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer & buffer, Allocation & bufferMemory)
 {
 	VkBufferCreateInfo bufferInfo = {};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -714,39 +889,77 @@ void Vulkan::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryP
 	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
 
 	if (vkCreateBuffer(m_device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS)
-		throw std::runtime_error("Erreur : cration d'un buffer");
+		throw std::runtime_error("Erreur : création d'un buffer");
 
 	VkMemoryRequirements memRequirements;
 	vkGetBufferMemoryRequirements(m_device, buffer, &memRequirements);
 
-	VkMemoryAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-	allocInfo.allocationSize = memRequirements.size;
-	allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-	if (vkAllocateMemory(m_device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS)
-		throw std::runtime_error("Erreur : allocation de mmoire");
+	bufferMemory = m_memoryAllocator.allocate(memRequirements, properties, true);
 
-	vkBindBufferMemory(m_device, buffer, bufferMemory, 0);
+	vkBindBufferMemory(m_device, buffer, bufferMemory.memory, bufferMemory.offset);
 }
 
-void Vulkan::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+void Vulkan::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize dstOffset, VkDeviceSize srcOffset)
 {
+	if (hasTransferQueue())
+	{
+		copyBufferOnTransferQueue(srcBuffer, dstBuffer, size, dstOffset, srcOffset);
+		return;
+	}
+
 	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
 
 	VkBufferCopy copyRegion = {};
 	copyRegion.size = size;
+	copyRegion.srcOffset = srcOffset;
+	copyRegion.dstOffset = dstOffset;
 	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
 	endSingleTimeCommands(commandBuffer);
 }
 
-void Vulkan::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t baseArrayLayer)
+void Vulkan::copyBufferOnTransferQueue(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize dstOffset, VkDeviceSize srcOffset)
+{
+	// Hors lot, un lot d'une seule copie soumis et attendu comme avant
+	bool standalone = !m_uploadBatch.isOpen();
+	if (standalone)
+		m_uploadBatch.begin();
+
+	VkCommandBuffer commandBuffer = m_uploadBatch.getTransferCommandBuffer(this);
+
+	VkBufferCopy copyRegion = {};
+	copyRegion.size = size;
+	copyRegion.srcOffset = srcOffset;
+	copyRegion.dstOffset = dstOffset;
+	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+
+	// Buffers en VK_SHARING_MODE_EXCLUSIVE : la file de transfert libere la zone copiee,
+	// la file graphique l'acquiert avec la meme barriere avant les draws et les dispatchs
+	VkBufferMemoryBarrier barrier = {};
+	barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = 0;
+	barrier.srcQueueFamilyIndex = m_transferFamily;
+	barrier.dstQueueFamilyIndex = m_graphicsFamily;
+	barrier.buffer = dstBuffer;
+	barrier.offset = dstOffset;
+	barrier.size = size;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+	barrier.srcAccessMask = 0;
+	barrier.dstAccessMask = UPLOAD_DST_ACCESS;
+	m_uploadBatch.addAcquireBarrier(barrier);
+
+	if (standalone)
+		m_uploadBatch.end(this, true);
+}
+
+void Vulkan::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t baseArrayLayer, VkDeviceSize bufferOffset)
 {
 	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
 
 	VkBufferImageCopy region = {};
-	region.bufferOffset = 0;
+	region.bufferOffset = bufferOffset;
 	region.bufferRowLength = 0;
 	region.bufferImageHeight = 0;
 
@@ -952,33 +1165,103 @@ VkSampleCountFlagBits Vulkan::getMaxUsableSampleCount()
 	return VK_SAMPLE_COUNT_1_BIT;
 }
 
-void Vulkan::fillCommandBuffer(VkRenderPass renderPass, std::vector<MeshPipeline> meshes)
+void Vulkan::fillCommandBuffer(VkRenderPass renderPass, std::vector<MeshPipeline> meshes, std::vector<DrawItem> drawOrder,
+	std::function<void(VkCommandBuffer, uint32_t)> recordPrePass)
 {
-	if (m_commandBuffersSwapChain.size() > 0)
+	// Les command buffers d'une frame peuvent encore etre executes : chaque frame reenregistre
+	// les siens une fois sa fence passee, juste avant de les soumettre
+	m_recordedRenderPass = renderPass;
+	m_recordedMeshes = meshes;
+	m_recordedDrawOrder = drawOrder;
+	m_recordedPrePass = recordPrePass;
+
+	size_t nbImages = std::max<size_t>(m_swapChainFramebuffers.size(), 1);
+	if (m_commandBuffersSwapChain.size() != MAX_FRAMES_IN_FLIGHT * nbImages)
 	{
-		vkFreeCommandBuffers(m_device, m_commandPool, static_cast<uint32_t>(m_commandBuffersSwapChain.size()), m_commandBuffersSwapChain.data());
+		// Nouvelle swapchain : le device est deja au repos
+		for (size_t c = 0; c < m_commandBuffersSwapChain.size(); c++)
+			if (m_commandBuffersSwapChain[c] != VK_NULL_HANDLE)
+				vkFreeCommandBuffers(m_device, m_commandPool, 1, &m_commandBuffersSwapChain[c]);
+		m_commandBuffersSwapChain.assign(MAX_FRAMES_IN_FLIGHT * nbImages, VK_NULL_HANDLE);
 	}
-	
-	m_commandBuffersSwapChain.resize(m_swapChainFramebuffers.size());
-	if(m_commandBuffersSwapChain.size() == 0)
-		m_commandBuffersSwapChain.resize(1);
+
+	for (int frame(0); frame < MAX_FRAMES_IN_FLIGHT; ++frame)
+		m_commandBuffersDirty[frame] = true;
+}
+
+void Vulkan::recordFrameCommandBuffers(uint32_t frame)
+{
+#ifndef NDEBUG
+	auto startTime = std::chrono::high_resolution_clock::now();
+#endif
+
+	size_t nbImages = std::max<size_t>(m_swapChainFramebuffers.size(), 1);
+	VkCommandBuffer* commandBuffers = &m_commandBuffersSwapChain[frame * nbImages];
+	if (commandBuffers[0] != VK_NULL_HANDLE)
+		vkFreeCommandBuffers(m_device, m_commandPool, static_cast<uint32_t>(nbImages), commandBuffers);
+
+	VkRenderPass renderPass = m_recordedRenderPass;
+	std::vector<MeshPipeline>& meshes = m_recordedMeshes;
+	std::vector<DrawItem>& drawOrder = m_recordedDrawOrder;
+
+	// Les secondaires de cette frame ne sont plus executes : un reset par pool les rend tous
+	for (int i(0); i < m_recordCommandPools[frame].size(); ++i)
+		vkResetCommandPool(m_device, m_recordCommandPools[frame][i], 0);
+
+	// Plages contigues de la file triee : les secondaires executes dans l'ordre gardent l'ordre des draws
+	size_t nbDraws = drawOrder.size();
+	size_t nbRanges = std::min(nbDraws, (size_t)(m_recordThreadPool.getNbThreads() * RECORD_RANGES_PER_THREAD));
+
+	// Les secondaires ne dependent pas de l'image de la swapchain : partages par les primaires de la frame
+	VkCommandBufferInheritanceInfo inheritanceInfo = {};
+	inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+	inheritanceInfo.renderPass = renderPass;
+	inheritanceInfo.subpass = 0;
+	inheritanceInfo.framebuffer = VK_NULL_HANDLE;
+
+	std::vector<VkCommandBuffer> secondaryCommandBuffers(nbRanges);
+	std::vector<CommandRecorder::Statistics> rangeStatistics(nbRanges);
+	std::vector<size_t> nbUsedCommandBuffers(m_recordThreadPool.getNbThreads(), 0);
+	m_recordThreadPool.run(nbRanges, [&](size_t rangeID, int threadID)
+	{
+		VkCommandBuffer commandBuffer = getRecordCommandBuffer(frame, threadID, nbUsedCommandBuffers[threadID]++);
+
+		VkCommandBufferBeginInfo beginInfo = {};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		CommandRecorder recorder(commandBuffer);
+		recordDraws(recorder, meshes, drawOrder, nbDraws * rangeID / nbRanges, nbDraws * (rangeID + 1) / nbRanges, frame, m_swapChainExtent);
+		rangeStatistics[rangeID] = recorder.getStatistics();
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+			throw std::runtime_error("Erreur : record secondary command buffer");
+
+		secondaryCommandBuffers[rangeID] = commandBuffer;
+	});
 
 	VkCommandBufferAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	allocInfo.commandPool = m_commandPool;
 	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandBufferCount = (uint32_t)m_commandBuffersSwapChain.size();
+	allocInfo.commandBufferCount = (uint32_t)nbImages;
 
-	if (vkAllocateCommandBuffers(m_device, &allocInfo, m_commandBuffersSwapChain.data()) != VK_SUCCESS)
+	if (vkAllocateCommandBuffers(m_device, &allocInfo, commandBuffers) != VK_SUCCESS)
 		throw std::runtime_error("Erreur : allocation des command buffers");
 
-	for (size_t i = 0; i < m_commandBuffersSwapChain.size(); i++)
+	for (size_t i = 0; i < nbImages; i++)
 	{
+		size_t c = frame * nbImages + i;
+
 		VkCommandBufferBeginInfo beginInfo = {};
 		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
 
-		vkBeginCommandBuffer(m_commandBuffersSwapChain[i], &beginInfo);
+		vkBeginCommandBuffer(m_commandBuffersSwapChain[c], &beginInfo);
+
+			if (m_recordedPrePass)
+				m_recordedPrePass(m_commandBuffersSwapChain[c], frame);
 
 			VkRenderPassBeginInfo renderPassInfo = {};
 			renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -994,52 +1277,199 @@ void Vulkan::fillCommandBuffer(VkRenderPass renderPass, std::vector<MeshPipeline
 			renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
 			renderPassInfo.pClearValues = clearValues.data();
 
-			vkCmdBeginRenderPass(m_commandBuffersSwapChain[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+			vkCmdBeginRenderPass(m_commandBuffersSwapChain[c], &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 
-				for (int j = 0; j < meshes.size(); ++j)
-				{
-					for (int k(0); k < meshes[j].vertexBuffer.size(); ++k)
-					{
-						vkCmdBindPipeline(m_commandBuffersSwapChain[i], VK_PIPELINE_BIND_POINT_GRAPHICS, meshes[j].pipeline);
+				if (!secondaryCommandBuffers.empty())
+					vkCmdExecuteCommands(m_commandBuffersSwapChain[c], static_cast<uint32_t>(secondaryCommandBuffers.size()), secondaryCommandBuffers.data());
 
-						VkBuffer vertexBuffers[] = { meshes[j].vertexBuffer[k] };
-						VkDeviceSize offsets[] = { 0 };
-						vkCmdBindVertexBuffers(m_commandBuffersSwapChain[i], 0, 1, vertexBuffers, offsets);
-						vkCmdBindIndexBuffer(m_commandBuffersSwapChain[i], meshes[j].indexBuffer[k], 0, VK_INDEX_TYPE_UINT32);
-						if (meshes[j].instanceBuffer.size() > 0)
-						{
-							VkBuffer instanceBuffers[] = { meshes[j].instanceBuffer[k] };
-							vkCmdBindVertexBuffers(m_commandBuffersSwapChain[i], 1, 1, instanceBuffers, offsets);
-						}
+			vkCmdEndRenderPass(m_commandBuffersSwapChain[c]);
 
-						vkCmdBindDescriptorSets(m_commandBuffersSwapChain[i], VK_PIPELINE_BIND_POINT_GRAPHICS, 
-							meshes[j].pipelineLayout, 0, 1, &meshes[j].descriptorSet[k], 0, nullptr);
+		if (vkEndCommandBuffer(m_commandBuffersSwapChain[c]) != VK_SUCCESS)
+			throw std::runtime_error("Erreur : record command buffer");
+	}
+
+	m_commandBuffersDirty[frame] = false;
 
-						vkCmdDrawIndexed(m_commandBuffersSwapChain[i], meshes[j].nbIndices[k], meshes[j].instanceBuffer.size() == 0 ? 1 : 100, 0, 0, 0);
-					}
-				}
+#ifndef NDEBUG
+	m_nbRecords++;
+	for (int i(0); i < rangeStatistics.size(); ++i)
+		m_recordStatistics.add(rangeStatistics[i]);
+	m_recordTime += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+#endif
+}
 
-			vkCmdEndRenderPass(m_commandBuffersSwapChain[i]);
+void Vulkan::setNbRecordThreads(int nbThreads)
+{
+	// Les primaires deja enregistres executent des secondaires des pools detruits ici
+	vkDeviceWaitIdle(m_device);
+	destroyRecordThreads();
 
-		if (vkEndCommandBuffer(m_commandBuffersSwapChain[i]) != VK_SUCCESS)
-			throw std::runtime_error("Erreur : record command buffer");
+	m_recordThreadPool.initialize(nbThreads);
+	for (int frame(0); frame < MAX_FRAMES_IN_FLIGHT; ++frame)
+	{
+		m_recordCommandBuffers[frame].resize(nbThreads);
+		for (int i(0); i < nbThreads; ++i)
+			m_recordCommandPools[frame].push_back(createCommandPool(m_graphicsFamily));
+		if (!m_recordedDrawOrder.empty())
+			m_commandBuffersDirty[frame] = true;
+	}
+}
+
+void Vulkan::destroyRecordThreads()
+{
+	m_recordThreadPool.cleanup();
+	for (int frame(0); frame < MAX_FRAMES_IN_FLIGHT; ++frame)
+	{
+		for (int i(0); i < m_recordCommandPools[frame].size(); ++i)
+			vkDestroyCommandPool(m_device, m_recordCommandPools[frame][i], nullptr);
+		m_recordCommandPools[frame].clear();
+		m_recordCommandBuffers[frame].clear();
+	}
+}
+
+VkCommandBuffer Vulkan::getRecordCommandBuffer(uint32_t frame, int threadID, size_t index)
+{
+	// Appele uniquement par le thread threadID : son pool et sa liste ne sont pas partages
+	std::vector<VkCommandBuffer>& commandBuffers = m_recordCommandBuffers[frame][threadID];
+	if (index < commandBuffers.size())
+		return commandBuffers[index];
+
+	VkCommandBufferAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	allocInfo.commandPool = m_recordCommandPools[frame][threadID];
+	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+	allocInfo.commandBufferCount = 1;
+
+	VkCommandBuffer commandBuffer;
+	if (vkAllocateCommandBuffers(m_device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+		throw std::runtime_error("Erreur : allocation d'un secondary command buffer");
+	commandBuffers.push_back(commandBuffer);
+
+	return commandBuffer;
+}
+
+void Vulkan::recordDraws(CommandRecorder& recorder, const std::vector<MeshPipeline>& meshes, const std::vector<DrawItem>& drawOrder, size_t first, size_t last,
+	uint32_t frame, VkExtent2D extent, int frameBufferID)
+{
+	// L'etat dynamique n'est pas herite par les command buffers secondaires
+	recorder.setViewport(extent);
+	// Toute la geometrie est dans l'arena : un seul bind de vertex buffer
+	recorder.bindVertexBuffer(0, m_geometryArena.getVertexBuffer());
+
+	for (size_t i = first; i < last; ++i)
+	{
+		const MeshPipeline& mesh = meshes[drawOrder[i].meshPipelineID];
+		int k = drawOrder[i].drawID;
+		if (frameBufferID >= 0 && mesh.frameBufferID != frameBufferID)
+			continue;
+
+		recorder.bindPipeline(mesh.pipeline);
+		recorder.bindIndexBuffer(m_geometryArena.getIndexBuffer(), mesh.indexType[k]);
+		if (mesh.instanceBuffer.size() > 0)
+			recorder.bindVertexBuffer(1, mesh.instanceBuffer[k], mesh.instanceFrameStride[k] * frame);
+		recorder.bindDescriptorSet(mesh.pipelineLayout, mesh.descriptorSet[k], mesh.getDynamicOffsets(k, frame));
+
+		if (mesh.indirectBuffer != VK_NULL_HANDLE)
+		{
+			// Commandes ecrites par le culling GPU, une par LOD
+			VkDeviceSize offset = mesh.firstIndirectDraw[k] * sizeof(VkDrawIndexedIndirectCommand);
+			if (m_multiDrawIndirect)
+				recorder.drawIndexedIndirect(mesh.indirectBuffer, offset, mesh.nbIndirectDraws[k]);
+			else
+				for (uint32_t d(0); d < mesh.nbIndirectDraws[k]; ++d)
+					recorder.drawIndexedIndirect(mesh.indirectBuffer, offset + d * sizeof(VkDrawIndexedIndirectCommand), 1);
+		}
+		else
+			recorder.drawIndexed(mesh.nbIndices[k], mesh.nbInstances[k], mesh.firstIndex[k], mesh.vertexOffset[k], mesh.firstInstance[k]);
 	}
 }
 
 void Vulkan::createSemaphores()
 {
+	// Recreation de la swapchain : le device est au repos
+	destroySemaphores();
+
 	VkSemaphoreCreateInfo semaphoreInfo = {};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	if (vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_imageAvailableSemaphore) != VK_SUCCESS ||
-		vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_renderFinishedSemaphore) != VK_SUCCESS)
-		throw std::runtime_error("Erreur : cration des smaphores");
+	// Creees signalees : la premiere attente de chaque frame passe directement
+	VkFenceCreateInfo fenceInfo = {};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	for (int i(0); i < MAX_FRAMES_IN_FLIGHT; ++i)
+	{
+		if (vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_imageAvailableSemaphores[i]) != VK_SUCCESS ||
+			vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_renderFinishedSemaphores[i]) != VK_SUCCESS ||
+			vkCreateFence(m_device, &fenceInfo, nullptr, &m_inFlightFences[i]) != VK_SUCCESS)
+			throw std::runtime_error("Erreur : création des sémaphores");
+	}
+
+	m_imagesInFlight.assign(m_swapChainImages.size(), VK_NULL_HANDLE);
+	m_frameBegun = false;
+}
+
+void Vulkan::destroySemaphores()
+{
+	for (int i(0); i < MAX_FRAMES_IN_FLIGHT; ++i)
+	{
+		if (m_inFlightFences[i] == VK_NULL_HANDLE)
+			continue;
+
+		vkDestroySemaphore(m_device, m_imageAvailableSemaphores[i], nullptr);
+		vkDestroySemaphore(m_device, m_renderFinishedSemaphores[i], nullptr);
+		vkDestroyFence(m_device, m_inFlightFences[i], nullptr);
+		m_inFlightFences[i] = VK_NULL_HANDLE;
+	}
+}
+
+void Vulkan::beginFrame()
+{
+	if (m_frameBegun)
+		return;
+
+	// Le GPU a fini la frame qui utilisait ces tranches d'UBO et ces command buffers
+	vkWaitForFences(m_device, 1, &m_inFlightFences[m_currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+
+	// Frames terminees : jusqu'a m_frameNumber - MAX_FRAMES_IN_FLIGHT
+	while (!m_deferredDestructions.empty() && m_deferredDestructions.front().first + MAX_FRAMES_IN_FLIGHT <= m_frameNumber + 1)
+	{
+		m_deferredDestructions.front().second();
+		m_deferredDestructions.pop_front();
+	}
+
+	m_frameBegun = true;
+}
+
+void Vulkan::deferDestroy(std::function<void()> destroy)
+{
+	m_deferredDestructions.push_back({ m_frameNumber, destroy });
+}
+
+std::vector<std::string> Vulkan::pollShaderChanges()
+{
+	std::vector<std::string> changedShaders = m_shaderCompiler.poll();
+	// Le prochain acquire chargera le nouveau SPIR-V
+	for (int i(0); i < changedShaders.size(); ++i)
+		m_shaderModuleCache.invalidate(m_device, changedShaders[i]);
+
+	return changedShaders;
+}
+
+void Vulkan::flushDeferredDestructions()
+{
+	for (int i(0); i < m_deferredDestructions.size(); ++i)
+		m_deferredDestructions[i].second();
+	m_deferredDestructions.clear();
 }
 
 void Vulkan::drawFrame()
 {
+	beginFrame();
+	flushUploadBatch();
+
 	uint32_t imageIndex;
-	VkResult result = vkAcquireNextImageKHR(m_device, m_swapChain, std::numeric_limits<uint64_t>::max(), m_imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
+	VkResult result = vkAcquireNextImageKHR(m_device, m_swapChain, std::numeric_limits<uint64_t>::max(), m_imageAvailableSemaphores[m_currentFrame], VK_NULL_HANDLE, &imageIndex);
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR)
 	{
@@ -1048,27 +1478,42 @@ void Vulkan::drawFrame()
 	}
 	else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
 	{
-		throw std::runtime_error("Erreur : impossible d'acqurir l'image");
+		throw std::runtime_error("Erreur : impossible d'acquérir l'image");
 	}
 
+	// L'image peut encore etre utilisee par une frame precedente si la swapchain rend les images dans le desordre
+	if (m_imagesInFlight[imageIndex] != VK_NULL_HANDLE)
+		vkWaitForFences(m_device, 1, &m_imagesInFlight[imageIndex], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	m_imagesInFlight[imageIndex] = m_inFlightFences[m_currentFrame];
+
+	if (m_commandBuffersDirty[m_currentFrame])
+		recordFrameCommandBuffers(m_currentFrame);
+
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-	VkSemaphore waitSemaphores[] = { m_imageAvailableSemaphore/*, m_renderFinishedLastRenderPassSemaphore */ };
+	VkSemaphore waitSemaphores[] = { m_imageAvailableSemaphores[m_currentFrame]/*, m_renderFinishedLastRenderPassSemaphore */ };
 	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT/*, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT */ };
 	submitInfo.waitSemaphoreCount = 1;
 	submitInfo.pWaitSemaphores = waitSemaphores;
 	submitInfo.pWaitDstStageMask = waitStages;
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &m_commandBuffersSwapChain[imageIndex];
+	size_t nbImages = std::max<size_t>(m_swapChainFramebuffers.size(), 1);
+	submitInfo.pCommandBuffers = &m_commandBuffersSwapChain[m_currentFrame * nbImages + imageIndex];
 
-	VkSemaphore signalSemaphores[] = { m_renderFinishedSemaphore };
+	VkSemaphore signalSemaphores[] = { m_renderFinishedSemaphores[m_currentFrame] };
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
-	if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	vkResetFences(m_device, 1, &m_inFlightFences[m_currentFrame]);
+	if (vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_inFlightFences[m_currentFrame]) != VK_SUCCESS)
 		throw std::runtime_error("Erreur : draw command");
 
+	// Plus d'attente ici : le CPU prepare la frame suivante pendant que le GPU rend celle-ci
+	m_frameNumber++;
+	m_currentFrame = (m_currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+	m_frameBegun = false;
+
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
@@ -1086,8 +1531,6 @@ void Vulkan::drawFrame()
 		recreateSwapChain();
 	else if (result != VK_SUCCESS)
 		throw std::runtime_error("Erreur : affichage de la swapchain");
-
-	vkQueueWaitIdle(m_presentQueue);
 }
 
 void Vulkan::recreateSwapChain()
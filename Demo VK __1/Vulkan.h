@@ -10,11 +10,30 @@
 #include <array>
 #include <functional>
 #include <cstring>
+#include <deque>
+
+#include "MemoryAllocator.h"
+#include "GeometryArena.h"
+#include "StagingRing.h"
+#include "UploadBatch.h"
+#include "UniformArena.h"
+#include "ThreadPool.h"
+#include "CommandRecorder.h"
+#include "RenderQueue.h"
+#include "PipelineCache.h"
+#include "PipelineLibrary.h"
+#include "ShaderModuleCache.h"
+#include "ShaderCompiler.h"
+
+// Frames que le CPU peut preparer pendant que le GPU rend les precedentes (2 ou 3).
+// Tranches de ressources dynamiques (UBO), command buffers, semaphores et fences sont par frame
+const int MAX_FRAMES_IN_FLIGHT = 2;
 
 struct QueueFamilyIndices
 {
 	int graphicsFamily = -1;
 	int presentFamily = -1;
+	int transferFamily = -1; // famille sans graphique, -1 si le GPU n'en a pas
 
 	bool isComplete()
 	{
@@ -31,33 +50,50 @@ struct SwapChainSupportDetails
 
 struct MeshPipeline
 {
-	std::vector<VkBuffer> vertexBuffer;
-	std::vector<VkBuffer> indexBuffer;
 	std::vector<VkBuffer> instanceBuffer;
+	std::vector<VkDeviceSize> instanceFrameStride; // par draw instancie, 0 pour des instances statiques
+	std::vector<int32_t> vertexOffset; // dans le vertex buffer de l'arena de geometrie
 	std::vector<uint32_t> nbIndices;
+	std::vector<uint32_t> firstIndex; // dans l'index buffer de l'arena, LOD compris
+	std::vector<VkIndexType> indexType;
+	std::vector<uint32_t> firstInstance;
+	std::vector<uint32_t> nbInstances;
 	std::vector<VkDescriptorSet> descriptorSet; // autant de descriptorSet que de mesh
+	std::vector<std::vector<uint32_t>> uboOffsets; // par draw, offset de chaque ubo du descriptorSet dans l'arena d'uniformes
+	uint32_t uboFrameStride = 0; // taille d'une tranche de frame de l'arena
 	VkPipeline pipeline;
 	VkPipelineLayout pipelineLayout;
 
 	int frameBufferID = 0;
-
-	void free(VkDevice device, VkDescriptorPool descriptorPool, bool recreate = false)
+	RenderLayer layer = RENDER_LAYER_OPAQUE;
+	// Draws indirects : commandes ecrites par le culling GPU, un draw par LOD
+	VkBuffer indirectBuffer = VK_NULL_HANDLE;
+	std::vector<uint32_t> firstIndirectDraw;
+	std::vector<uint32_t> nbIndirectDraws;
+
+	// Les pipelines appartiennent a la bibliotheque de pipelines, les descriptor sets au cache de la passe
+	void free()
 	{
-		for (int i = 0; i < vertexBuffer.size(); ++i)
-		{
-			//vkDestroyBuffer(device, vertexBuffer[i], nullptr);
-			//vkDestroyBuffer(device, indexBuffer[i], nullptr);
-		}
-		if (recreate)
-		{
-			vkDestroyPipeline(device, pipeline, nullptr);
-			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-		}
-		vkFreeDescriptorSets(device, descriptorPool, descriptorSet.size(), descriptorSet.data());
-		vertexBuffer.clear();
-		indexBuffer.clear();
+		vertexOffset.clear();
 		nbIndices.clear();
+		firstIndex.clear();
+		indexType.clear();
+		instanceBuffer.clear();
+		instanceFrameStride.clear();
+		firstInstance.clear();
+		nbInstances.clear();
 		descriptorSet.clear();
+		uboOffsets.clear();
+		firstIndirectDraw.clear();
+		nbIndirectDraws.clear();
+	}
+
+	std::vector<uint32_t> getDynamicOffsets(int drawID, uint32_t frame) const
+	{
+		std::vector<uint32_t> dynamicOffsets(uboOffsets[drawID].size());
+		for (int i(0); i < dynamicOffsets.size(); ++i)
+			dynamicOffsets[i] = uboOffsets[drawID][i] + uboFrameStride * frame;
+		return dynamicOffsets;
 	}
 };
 
@@ -65,23 +101,23 @@ struct FrameBuffer
 {
 	VkImageView imageView;
 	VkImage image;
-	VkDeviceMemory imageMemory;
+	Allocation imageMemory;
 	VkFramebuffer framebuffer;
 
 	VkImage depthImage;
-	VkDeviceMemory depthImageMemory;
+	Allocation depthImageMemory;
 	VkImageView depthImageView;
 
 	void free(VkDevice device)
 	{
 		vkDestroyImageView(device, imageView, nullptr);
 		vkDestroyImage(device, image, nullptr);
-		vkFreeMemory(device, imageMemory, nullptr);
+		imageMemory.free();
 		vkDestroyFramebuffer(device, framebuffer, nullptr);
 
 		vkDestroyImageView(device, depthImageView, nullptr);
 		vkDestroyImage(device, depthImage, nullptr);
-		vkFreeMemory(device, depthImageMemory, nullptr);
+		depthImageMemory.free();
 	}
 };
 
@@ -112,8 +148,26 @@ public:
 	VkExtent2D getSwapChainExtend() { return m_swapChainExtent; }
 	GLFWwindow* GetWindow() { return m_window; }
 	VkQueue getGraphicalQueue() { return m_graphicsQueue; }
-	VkSemaphore getRenderFinishedSemaphore() { return m_renderFinishedSemaphore; }
+	VkCommandPool getCommandPool() { return m_commandPool; }
+	VkCommandPool getTransferCommandPool() { return m_transferCommandPool; }
+	bool hasTransferQueue() { return m_transferFamily != m_graphicsFamily; }
+	VkSemaphore getRenderFinishedSemaphore() { return m_renderFinishedSemaphores[m_currentFrame]; }
 	VkSampleCountFlagBits getMaxMsaaSamples() { return m_maxMsaaSamples; }
+	VkDeviceSize getMinUniformBufferOffsetAlignment() { return m_minUniformBufferOffsetAlignment; }
+	bool hasDrawIndirectFirstInstance() { return m_drawIndirectFirstInstance; }
+	uint32_t getCurrentFrame() { return m_currentFrame; }
+	GeometryArena* getGeometryArena() { return &m_geometryArena; }
+	UniformArena* getUniformArena() { return &m_uniformArena; }
+	MemoryAllocator* getMemoryAllocator() { return &m_memoryAllocator; }
+	StagingRing* getStagingRing() { return &m_stagingRing; }
+	PipelineCache* getPipelineCache() { return &m_pipelineCache; }
+	PipelineLibrary* getPipelineLibrary() { return &m_pipelineLibrary; }
+	ShaderModuleCache* getShaderModuleCache() { return &m_shaderModuleCache; }
+	// Shaders optionnels : a tester ici plutot que sur le disque, une source compilable suffit
+	bool hasShader(std::string spvPath) { return m_shaderCompiler.hasShader(spvPath); }
+	// .spv recompiles depuis leur source depuis le dernier appel, leurs modules sont retires du cache.
+	// Toujours vide sans SHADER_RUNTIME_COMPILATION
+	std::vector<std::string> pollShaderChanges();
 
 	void setRenderFinishedLastRenderPassSemaphore(VkSemaphore semaphore) { m_renderFinishedLastRenderPassSemaphore = semaphore; }
 
@@ -125,16 +179,28 @@ private:
 	void createSwapChain();
 
 	void cleanupSwapChain();
+	void destroySemaphores();
+	// Le benchmark d'enregistrement mesure recordFrameCommandBuffers seul, sans soumission
+	friend class Benchmark;
+	void recordFrameCommandBuffers(uint32_t frame);
+	VkCommandBuffer getRecordCommandBuffer(uint32_t frame, int threadID, size_t index);
+	void destroyRecordThreads();
+	void flushDeferredDestructions();
 
 public :
-	VkCommandPool createCommandPool();
+	VkCommandPool createCommandPool(int queueFamily = -1);
 
 	void createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, 
-		uint32_t arrayLayers, VkImageCreateFlags flags, VkImage& image, VkDeviceMemory& imageMemory);
+		uint32_t arrayLayers, VkImageCreateFlags flags, VkImage& image, Allocation& imageMemory);
 	void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLevels, uint32_t arrayLayers);
 	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 	VkCommandBuffer beginSingleTimeCommands();
 	void endSingleTimeCommands(VkCommandBuffer commandBuffer);
+	void submitUploadCommands(VkCommandBuffer commandBuffer, VkCommandBuffer transferCommandBuffer, const std::vector<VkBufferMemoryBarrier>& acquireBarriers, bool wait);
+	// Entre begin et end, les copies et transitions sont regroupees en une seule soumission
+	void beginUploadBatch() { m_uploadBatch.begin(); }
+	void endUploadBatch(bool wait = false) { m_uploadBatch.end(this, wait); }
+	void flushUploadBatch(bool wait = false) { m_uploadBatch.flush(this, wait); }
 	bool checkValidationLayerSupport(std::vector<const char*> layers);
 	std::vector<const char*> getRequiredExtensions();
 	bool isDeviceSuitable(VkPhysicalDevice physicalDevice);
@@ -148,18 +214,32 @@ public :
 	VkFormat findDepthFormat();
 	VkFormat findSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 	bool hasStencilComponent(VkFormat format);
-	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
-	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t baseArrayLayer);
+	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, Allocation& bufferMemory);
+	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize dstOffset = 0, VkDeviceSize srcOffset = 0);
+	void copyBufferOnTransferQueue(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize dstOffset, VkDeviceSize srcOffset);
+	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t baseArrayLayer, VkDeviceSize bufferOffset = 0);
 	void copyImage(VkImage source, VkImage dst, uint32_t width, uint32_t height, uint32_t baseArrayLayer, uint32_t mipLevel);
 	FrameBuffer createFrameBuffer(VkExtent2D extent, VkRenderPass renderPass, VkSampleCountFlagBits msaaSamples, VkImageView colorImageView);
 	void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels, uint32_t baseArrayLayer);
 	VkSampleCountFlagBits getMaxUsableSampleCount();
 
-	void fillCommandBuffer(VkRenderPass renderPass, std::vector<MeshPipeline> meshes);
+	// drawOrder : draws de meshes dans l'ordre de la file de rendu triee.
+	// recordPrePass enregistre le travail a faire avant la passe (culling GPU)
+	void fillCommandBuffer(VkRenderPass renderPass, std::vector<MeshPipeline> meshes, std::vector<DrawItem> drawOrder,
+		std::function<void(VkCommandBuffer, uint32_t)> recordPrePass = nullptr);
+	// Enregistre les draws [first, last) de drawOrder dans une passe deja commencee (-1 : tous les framebuffers)
+	void recordDraws(CommandRecorder& recorder, const std::vector<MeshPipeline>& meshes, const std::vector<DrawItem>& drawOrder, size_t first, size_t last,
+		uint32_t frame, VkExtent2D extent, int frameBufferID = -1);
 	void createSemaphores();
+	// Nombre de threads qui enregistrent les draws de la swapchain. Attend que le device soit au repos
+	void setNbRecordThreads(int nbThreads);
 
+	// Attend que la frame qui utilisait les ressources de la frame courante soit terminee.
+	// A appeler avant d'ecrire les UBO de la frame, sinon drawFrame s'en charge
+	void beginFrame();
 	void drawFrame();
+	// Destruction differee jusqu'a ce que les frames en vol qui peuvent utiliser la ressource soient terminees
+	void deferDestroy(std::function<void()> destroy);
 
 	void recreateSwapChain();
 
@@ -208,6 +288,9 @@ protected:
 
 	VkQueue m_graphicsQueue;
 	VkQueue m_presentQueue;
+	VkQueue m_transferQueue; // = m_graphicsQueue sans famille de transfert dediee
+	int m_graphicsFamily = -1;
+	int m_transferFamily = -1;
 
 	VkSwapchainKHR m_swapChain;
 	VkFormat m_swapChainImageFormat;
@@ -216,16 +299,52 @@ protected:
 	std::vector<VkImage> m_swapChainImages;
 	std::vector<VkFramebuffer> m_swapChainFramebuffers;
 	VkImage m_depthImage;
-	VkDeviceMemory m_depthImageMemory;
+	Allocation m_depthImageMemory;
 	VkImageView m_depthImageView;
 
 	VkCommandPool m_commandPool;
+	VkCommandPool m_transferCommandPool = VK_NULL_HANDLE;
 	std::vector<VkCommandBuffer> m_commandBuffersSwapChain;
 
-	VkSemaphore m_imageAvailableSemaphore;
-	VkSemaphore m_renderFinishedSemaphore;
+	std::array<VkSemaphore, MAX_FRAMES_IN_FLIGHT> m_imageAvailableSemaphores;
+	std::array<VkSemaphore, MAX_FRAMES_IN_FLIGHT> m_renderFinishedSemaphores;
+	std::array<VkFence, MAX_FRAMES_IN_FLIGHT> m_inFlightFences = {};
+	std::vector<VkFence> m_imagesInFlight; // fence de la derniere frame qui a rendu dans chaque image
+	bool m_frameBegun = false;
+	uint64_t m_frameNumber = 0;
+	std::deque<std::pair<uint64_t, std::function<void()>>> m_deferredDestructions; // numero de frame lors de la demande
+
+	VkRenderPass m_recordedRenderPass;
+	std::vector<MeshPipeline> m_recordedMeshes;
+	std::vector<DrawItem> m_recordedDrawOrder;
+	std::function<void(VkCommandBuffer, uint32_t)> m_recordedPrePass;
+	std::array<bool, MAX_FRAMES_IN_FLIGHT> m_commandBuffersDirty = {};
+
+	// Enregistrement en parallele : chaque thread a un pool par frame, vide quand la fence de la frame est passee
+	ThreadPool m_recordThreadPool;
+	std::array<std::vector<VkCommandPool>, MAX_FRAMES_IN_FLIGHT> m_recordCommandPools;
+	std::array<std::vector<std::vector<VkCommandBuffer>>, MAX_FRAMES_IN_FLIGHT> m_recordCommandBuffers; // secondaires alloues, reutilises
+#ifndef NDEBUG
+	uint32_t m_nbRecords = 0;
+	CommandRecorder::Statistics m_recordStatistics;
+	double m_recordTime = 0.0; // ms
+#endif
 
 	VkSemaphore m_renderFinishedLastRenderPassSemaphore;
 
 	VkSampleCountFlagBits m_maxMsaaSamples = VK_SAMPLE_COUNT_1_BIT;
+	VkDeviceSize m_minUniformBufferOffsetAlignment = 256;
+	bool m_multiDrawIndirect = false;
+	bool m_drawIndirectFirstInstance = false;
+	uint32_t m_currentFrame = 0;
+
+	MemoryAllocator m_memoryAllocator;
+	StagingRing m_stagingRing;
+	UploadBatch m_uploadBatch;
+	GeometryArena m_geometryArena;
+	UniformArena m_uniformArena;
+	PipelineCache m_pipelineCache; // conserve a la recreation de la swapchain
+	PipelineLibrary m_pipelineLibrary;
+	ShaderModuleCache m_shaderModuleCache;
+	ShaderCompiler m_shaderCompiler;
 };
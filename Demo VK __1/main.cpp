@@ -1,9 +1,22 @@
 #include "System.h"
+#include "Benchmark.h"
 
 #include <iostream>
 
-int main()
+int main(int argc, char** argv)
 {
+	// --benchmark <nom> [taille] : mesure seule, sans la demo
+	try
+	{
+		if (Benchmark::run(argc, argv))
+			return EXIT_SUCCESS;
+	}
+	catch (const std::runtime_error& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return EXIT_FAILURE;
+	}
+
 	{
 		System s;
 